@@ -46,6 +46,16 @@ function cld_cmd_container.ls(d, options, args)
         table.insert(output, c)
     end
 
+    -- with --format the rows are rendered by the caller, one per line
+    if format ~= nil then
+        if #output == 0 then return "[]" end
+        for _, c in ipairs(output) do
+            c["Ports"] = cld_cmd_container.ports_string(c["Ports"])
+            c["Names"] = cld_cmd_container.names_string(c["Names"])
+        end
+        return json.encode(output)
+    end
+
     local o = nil
     if cld_cmd_util.option_val(options, "quiet") then
         o = cld_cmd_container.ls_format_quiet(output)
@@ -58,6 +68,33 @@ function cld_cmd_container.ls(d, options, args)
     return json.encode(o)
 end
 
+function cld_cmd_container.ports_string(ports)
+    local ports_str = ""
+    for count, p in ipairs(ports) do
+        if p.IP then
+            ports_str = ports_str .. p.IP .. ":"
+        end
+        if p.PublicPort then
+            ports_str = ports_str .. p.PublicPort
+        end
+        if p.PrivatePort then
+            ports_str = ports_str .. "->" .. p.PrivatePort
+        end
+        ports_str = ports_str .. "/" .. p.Type
+        if count < #ports then ports_str = ports_str .. ", " end
+    end
+    return ports_str
+end
+
+function cld_cmd_container.names_string(names)
+    local names_str = ""
+    for count, p in ipairs(names) do
+        names_str = names_str .. p
+        if count < #names then names_str = names_str .. ", " end
+    end
+    return names_str
+end
+
 function cld_cmd_container.ls_format(output, options)
     local o = {
         headers = {
@@ -86,28 +123,8 @@ function cld_cmd_container.ls_format(output, options)
         truncate = false
     }
     for k, c in ipairs(output) do
-        local ports_str = ""
-        local count = 1
-        for _, p in ipairs(c["Ports"]) do
-            if p.IP then
-                ports_str = ports_str .. p.IP .. ":"
-            end
-            if p.PublicPort then
-                ports_str = ports_str .. p.PublicPort
-            end
-            if p.PrivatePort then
-                ports_str = ports_str .. "->" .. p.PrivatePort
-            end
-            ports_str = ports_str .. "/" .. p.Type
-            if count < #c["Ports"] then ports_str = ports_str .. ", " end
-        end
-
-        local names_str = ""
-        count = 1
-        for _, p in ipairs(c["Names"]) do
-            names_str = names_str .. p
-            if count < #c["Names"] then names_str = names_str .. ", " end
-        end
+        local ports_str = cld_cmd_container.ports_string(c["Ports"])
+        local names_str = cld_cmd_container.names_string(c["Names"])
 
         table.insert(o.data["CONTAINER ID"], c["ID"])
         table.insert(o.data["IMAGE"], c["Image"])
@@ -22,6 +22,7 @@
  */
 
 #include <string.h>
+#include <stdlib.h>
 
 #include "docker_all.h"
 #include "cld_common.h"
@@ -32,6 +33,9 @@
 #include "cld_vol.h"
 #include "cld_net.h"
 #include "cld_lua.h"
+#include "cld_agent.h"
+#include "cld_repl.h"
+#include "cld_collect.h"
 #include <coll_arraylist.h>
 
 #define CMD_NOT_FOUND -1
@@ -78,6 +82,14 @@
 #define ZCLK_OPTION_MAIN_INTERACTIVE_SHORT "i"
 #define ZCLK_OPTION_MAIN_INTERACTIVE_DESC "Show REPL"
 
+#define ZCLK_OPTION_MAIN_BATCH_LONG "batch"
+#define ZCLK_OPTION_MAIN_BATCH_SHORT "b"
+#define ZCLK_OPTION_MAIN_BATCH_DESC "Run the commands in a batch file, one per line (\"-\" reads stdin)"
+
+#define ZCLK_OPTION_MAIN_PARALLEL_LONG "parallel"
+#define ZCLK_OPTION_MAIN_PARALLEL_SHORT "P"
+#define ZCLK_OPTION_MAIN_PARALLEL_DESC "Number of batch lines to run concurrently (default 1)"
+
 #define ZCLK_OPTION_MAIN_HOST_LONG "host"
 #define ZCLK_OPTION_MAIN_HOST_SHORT "H"
 #define ZCLK_OPTION_MAIN_HOST_DESC "Set Docker Host"
@@ -86,11 +98,20 @@
 #define ZCLK_OPTION_MAIN_VERSION_SHORT "v"
 #define ZCLK_OPTION_MAIN_VERSION_DESC "Show CLD version."
 
+#define ZCLK_OPTION_AGENT_SOCKET_LONG "socket"
+#define ZCLK_OPTION_AGENT_SOCKET_SHORT "s"
+#define ZCLK_OPTION_AGENT_SOCKET_DESC "Unix socket path to listen at (default $" CLD_AGENT_SOCKET_ENV ")"
+
+#define CLD_AGENT_COMMAND_NAME "agent"
+
 static char *main_command_name;
 static docker_context *ctx;
 static bool connected = false;
 static arraylist *CLI_COMMANDS;
 static int loglevel = LOG_ERROR;
+static bool interactive = false;
+static char *batch_path = NULL;
+static int batch_parallel = 1;
 
 void docker_result_handler(docker_context *ctx, docker_result *res)
 {
@@ -129,6 +150,24 @@ zclk_res main_cmd_handler(zclk_command* cmd, void *handler_args)
         }
     }
 
+    zclk_option *interactive_option = get_option_by_name(cmd->options, ZCLK_OPTION_MAIN_INTERACTIVE_LONG);
+    if (zclk_option_get_val_flag(interactive_option))
+    {
+        interactive = true;
+    }
+
+    zclk_option *batch_option = get_option_by_name(cmd->options, ZCLK_OPTION_MAIN_BATCH_LONG);
+    if (batch_path == NULL && zclk_option_get_val_string(batch_option) != NULL)
+    {
+        batch_path = str_clone(zclk_option_get_val_string(batch_option));
+        zclk_option *parallel_option = get_option_by_name(cmd->options, ZCLK_OPTION_MAIN_PARALLEL_LONG);
+        batch_parallel = zclk_option_get_val_int(parallel_option);
+        if (batch_parallel < 1)
+        {
+            batch_parallel = 1;
+        }
+    }
+
     zclk_option *host_option = get_option_by_name(cmd->options, ZCLK_OPTION_MAIN_HOST_LONG);
 
     if (!connected)
@@ -188,47 +227,273 @@ zclk_res main_cmd_handler(zclk_command* cmd, void *handler_args)
     return ZCLK_RES_SUCCESS;
 }
 
-zclk_command *create_main_command()
+zclk_command *create_main_command_for(int argc, char *argv[]);
+
+/**
+ * Run one complete command line against the shared docker context.
+ * A new command tree, with only the command group used, is created for
+ * every run, so option values do not leak from one command line to the
+ * next.
+ */
+static zclk_res exec_main_command(int argc, char *argv[], void *handler_args)
+{
+    zclk_command *main_command = create_main_command_for(argc, argv);
+    if (main_command == NULL)
+    {
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+    zclk_res err = zclk_command_exec(main_command, handler_args, argc, argv);
+    if (err != ZCLK_RES_SUCCESS)
+    {
+        docker_log_error("Error: invalid command.\n");
+    }
+    free_command(main_command);
+    return err;
+}
+
+zclk_res agent_cmd_handler(zclk_command* cmd, void *handler_args)
+{
+    char *socket_path;
+    zclk_option *socket_option = get_option_by_name(cmd->options, ZCLK_OPTION_AGENT_SOCKET_LONG);
+    if (zclk_option_get_val_string(socket_option) != NULL)
+    {
+        socket_path = str_clone(zclk_option_get_val_string(socket_option));
+    }
+    else
+    {
+        socket_path = cld_agent_socket_path();
+    }
+
+    if (socket_path == NULL)
+    {
+        cmd->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING,
+                           "Agent socket path not available.");
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+
+    // pre-load lua, every forked request then gets it ready to use.
+    start_lua_interpreter();
+
+    zclk_res err = cld_agent_serve(socket_path, main_command_name,
+                                   &exec_main_command, handler_args);
+    free(socket_path);
+    return err;
+}
+
+zclk_command *agent_command()
+{
+    zclk_command *agent_command = new_zclk_command(CLD_AGENT_COMMAND_NAME, CLD_AGENT_COMMAND_NAME,
+                                                   "Run a persistent cld agent serving commands over a unix socket",
+                                                   &agent_cmd_handler);
+    if (agent_command != NULL)
+    {
+        zclk_command_string_option(agent_command, ZCLK_OPTION_AGENT_SOCKET_LONG,
+                                   ZCLK_OPTION_AGENT_SOCKET_SHORT, NULL, ZCLK_OPTION_AGENT_SOCKET_DESC);
+    }
+    return agent_command;
+}
+
+/**
+ * Check if this command line can be sent to a running agent.
+ * Commands which start the agent, need a terminal or stdin, or connect to
+ * a different docker host are always run in-process.
+ */
+static bool should_forward_to_agent(int argc, char *argv[])
+{
+    if (argc < 2 || getenv(CLD_AGENT_DISABLE_ENV) != NULL)
+    {
+        return false;
+    }
+
+    bool positional_seen = false;
+    for (int i = 1; i < argc; i++)
+    {
+        char *arg = argv[i];
+        if (arg[0] == '-')
+        {
+            if (strcmp(arg, "-" ZCLK_OPTION_MAIN_HOST_SHORT) == 0
+                || strncmp(arg, "--" ZCLK_OPTION_MAIN_HOST_LONG, strlen("--" ZCLK_OPTION_MAIN_HOST_LONG)) == 0
+                || strcmp(arg, "-" ZCLK_OPTION_MAIN_INTERACTIVE_SHORT) == 0
+                || strcmp(arg, "--" ZCLK_OPTION_MAIN_INTERACTIVE_LONG) == 0
+                || strcmp(arg, "-" ZCLK_OPTION_MAIN_BATCH_SHORT) == 0
+                || strncmp(arg, "--" ZCLK_OPTION_MAIN_BATCH_LONG, strlen("--" ZCLK_OPTION_MAIN_BATCH_LONG)) == 0)
+            {
+                return false;
+            }
+        }
+        else if (!positional_seen)
+        {
+            positional_seen = true;
+            if (strcmp(arg, CLD_AGENT_COMMAND_NAME) == 0)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+typedef enum
+{
+    CLD_MAIN_OPTION_STRING,
+    CLD_MAIN_OPTION_INT,
+    CLD_MAIN_OPTION_FLAG
+} cld_main_option_type;
+
+/** Descriptor of an option of the main command. */
+typedef struct cld_main_option_t
+{
+    const char *name;
+    const char *short_name;
+    const char *desc;
+    cld_main_option_type type;
+    int default_int;
+} cld_main_option;
+
+static const cld_main_option MAIN_OPTIONS[] = {
+    {ZCLK_OPTION_MAIN_CONFIG_LONG, ZCLK_OPTION_MAIN_CONFIG_SHORT, ZCLK_OPTION_MAIN_CONFIG_DESC, CLD_MAIN_OPTION_STRING, 0},
+    {ZCLK_OPTION_MAIN_DEBUG_LONG, ZCLK_OPTION_MAIN_DEBUG_SHORT, ZCLK_OPTION_MAIN_DEBUG_DESC, CLD_MAIN_OPTION_STRING, 0},
+    {ZCLK_OPTION_MAIN_LOG_LEVEL_LONG, ZCLK_OPTION_MAIN_LOG_LEVEL_SHORT, ZCLK_OPTION_MAIN_LOG_LEVEL_DESC, CLD_MAIN_OPTION_STRING, 0},
+    {ZCLK_OPTION_MAIN_TLS_LONG, ZCLK_OPTION_MAIN_TLS_SHORT, ZCLK_OPTION_MAIN_TLS_DESC, CLD_MAIN_OPTION_STRING, 0},
+    {ZCLK_OPTION_MAIN_TLSCACERT_LONG, ZCLK_OPTION_MAIN_TLSCACERT_SHORT, ZCLK_OPTION_MAIN_TLSCACERT_DESC, CLD_MAIN_OPTION_STRING, 0},
+    {ZCLK_OPTION_MAIN_TLSCERT_LONG, ZCLK_OPTION_MAIN_TLSCERT_SHORT, ZCLK_OPTION_MAIN_TLSCERT_DESC, CLD_MAIN_OPTION_STRING, 0},
+    {ZCLK_OPTION_MAIN_TLSKEY_LONG, ZCLK_OPTION_MAIN_TLSKEY_SHORT, ZCLK_OPTION_MAIN_TLSKEY_DESC, CLD_MAIN_OPTION_STRING, 0},
+    {ZCLK_OPTION_MAIN_TLSVERIFY_LONG, ZCLK_OPTION_MAIN_TLSVERIFY_SHORT, ZCLK_OPTION_MAIN_TLSVERIFY_DESC, CLD_MAIN_OPTION_STRING, 0},
+    {ZCLK_OPTION_MAIN_INTERACTIVE_LONG, ZCLK_OPTION_MAIN_INTERACTIVE_SHORT, ZCLK_OPTION_MAIN_INTERACTIVE_DESC, CLD_MAIN_OPTION_FLAG, 0},
+    {ZCLK_OPTION_MAIN_BATCH_LONG, ZCLK_OPTION_MAIN_BATCH_SHORT, ZCLK_OPTION_MAIN_BATCH_DESC, CLD_MAIN_OPTION_STRING, 0},
+    {ZCLK_OPTION_MAIN_PARALLEL_LONG, ZCLK_OPTION_MAIN_PARALLEL_SHORT, ZCLK_OPTION_MAIN_PARALLEL_DESC, CLD_MAIN_OPTION_INT, 1},
+    {ZCLK_OPTION_MAIN_HOST_LONG, ZCLK_OPTION_MAIN_HOST_SHORT, ZCLK_OPTION_MAIN_HOST_DESC, CLD_MAIN_OPTION_STRING, 0},
+    {ZCLK_OPTION_MAIN_VERSION_LONG, ZCLK_OPTION_MAIN_VERSION_SHORT, ZCLK_OPTION_MAIN_VERSION_DESC, CLD_MAIN_OPTION_STRING, 0},
+    {NULL, NULL, NULL, CLD_MAIN_OPTION_FLAG, 0}
+};
+
+/**
+ * Descriptor of a command group (a sub-command of the main command).
+ * The zclk_command tree of a group is only created when the command line
+ * is routed to it, see create_main_command_for.
+ */
+typedef struct cld_command_group_t
+{
+    const char *name;
+    const char *short_name;
+    zclk_command *(*create)();
+} cld_command_group;
+
+static const cld_command_group COMMAND_GROUPS[] = {
+    {"system", "sys", &sys_commands},
+    {"container", "ctr", &ctr_commands},
+    {"image", "img", &img_commands},
+    {"volume", "vol", &vol_commands},
+    {"network", "net", &net_commands},
+    {"logs", "log", &logs_commands},
+    {CLD_AGENT_COMMAND_NAME, CLD_AGENT_COMMAND_NAME, &agent_command},
+    {NULL, NULL, NULL}
+};
+
+static zclk_command *new_main_command()
 {
     zclk_command *main_command = new_zclk_command(main_command_name, "cld",
                                                  "CLD Docker Client",
                                                  &main_cmd_handler);
-    
+
     if (main_command != NULL)
     {
-        zclk_command_string_option(main_command, ZCLK_OPTION_MAIN_CONFIG_LONG,
-                                   ZCLK_OPTION_MAIN_CONFIG_SHORT, NULL, ZCLK_OPTION_MAIN_CONFIG_DESC);
-        zclk_command_string_option(main_command, ZCLK_OPTION_MAIN_DEBUG_LONG,
-                                   ZCLK_OPTION_MAIN_DEBUG_SHORT, 0, ZCLK_OPTION_MAIN_DEBUG_DESC);
-        zclk_command_string_option(main_command, ZCLK_OPTION_MAIN_LOG_LEVEL_LONG,
-                                   ZCLK_OPTION_MAIN_LOG_LEVEL_SHORT, NULL, ZCLK_OPTION_MAIN_LOG_LEVEL_DESC);
-        zclk_command_string_option(main_command, ZCLK_OPTION_MAIN_TLS_LONG,
-                                   ZCLK_OPTION_MAIN_TLS_SHORT, 0, ZCLK_OPTION_MAIN_TLS_DESC);
-        zclk_command_string_option(main_command, ZCLK_OPTION_MAIN_TLSCACERT_LONG,
-                                   ZCLK_OPTION_MAIN_TLSCACERT_SHORT, NULL, ZCLK_OPTION_MAIN_TLSCACERT_DESC);
-        zclk_command_string_option(main_command, ZCLK_OPTION_MAIN_TLSCERT_LONG,
-                                   ZCLK_OPTION_MAIN_TLSCERT_SHORT, NULL, ZCLK_OPTION_MAIN_TLSCERT_DESC);
-        zclk_command_string_option(main_command, ZCLK_OPTION_MAIN_TLSKEY_LONG,
-                                   ZCLK_OPTION_MAIN_TLSKEY_SHORT, NULL, ZCLK_OPTION_MAIN_TLSKEY_DESC);
-        zclk_command_string_option(main_command, ZCLK_OPTION_MAIN_TLSVERIFY_LONG,
-                                   ZCLK_OPTION_MAIN_TLSVERIFY_SHORT, 0, ZCLK_OPTION_MAIN_TLSVERIFY_DESC);
-        zclk_command_string_option(main_command, ZCLK_OPTION_MAIN_INTERACTIVE_LONG,
-                                   ZCLK_OPTION_MAIN_INTERACTIVE_SHORT, 0, ZCLK_OPTION_MAIN_INTERACTIVE_DESC);
-        zclk_command_string_option(main_command, ZCLK_OPTION_MAIN_HOST_LONG,
-                                   ZCLK_OPTION_MAIN_HOST_SHORT, NULL, ZCLK_OPTION_MAIN_HOST_DESC);
-        zclk_command_string_option(main_command, ZCLK_OPTION_MAIN_VERSION_LONG,
-                                   ZCLK_OPTION_MAIN_VERSION_SHORT, 0, ZCLK_OPTION_MAIN_VERSION_DESC);
-
-        arraylist_add(main_command->sub_commands, sys_commands());
-        arraylist_add(main_command->sub_commands, ctr_commands());
-        arraylist_add(main_command->sub_commands, img_commands());
-        arraylist_add(main_command->sub_commands, vol_commands());
-        arraylist_add(main_command->sub_commands, net_commands());
-        return main_command;
+        for (const cld_main_option *o = MAIN_OPTIONS; o->name != NULL; o++)
+        {
+            switch (o->type)
+            {
+            case CLD_MAIN_OPTION_STRING:
+                zclk_command_string_option(main_command, o->name, o->short_name, NULL, o->desc);
+                break;
+            case CLD_MAIN_OPTION_INT:
+                zclk_command_int_option(main_command, o->name, o->short_name, o->default_int, o->desc);
+                break;
+            case CLD_MAIN_OPTION_FLAG:
+                zclk_command_flag_option(main_command, o->name, o->short_name, o->desc);
+                break;
+            }
+        }
+    }
+    return main_command;
+}
+
+/**
+ * Find the command group the command line is routed to, by skipping the
+ * main command options (and their values) up to the first word.
+ * Returns NULL if there is no group word, or it is not known.
+ */
+static const cld_command_group *route_command_group(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        char *arg = argv[i];
+        if (arg[0] == '-' && arg[1] != '\0')
+        {
+            bool is_long = arg[1] == '-';
+            const char *opt_name = is_long ? arg + 2 : arg + 1;
+            if (strchr(opt_name, '=') != NULL || (!is_long && strlen(opt_name) > 1))
+            {
+                // value given in the same word.
+                continue;
+            }
+            for (const cld_main_option *o = MAIN_OPTIONS; o->name != NULL; o++)
+            {
+                const char *match = is_long ? o->name : o->short_name;
+                if (match != NULL && strcmp(match, opt_name) == 0)
+                {
+                    if (o->type != CLD_MAIN_OPTION_FLAG)
+                    {
+                        i++;
+                    }
+                    break;
+                }
+            }
+        }
+        else
+        {
+            for (const cld_command_group *g = COMMAND_GROUPS; g->name != NULL; g++)
+            {
+                if (strcmp(g->name, arg) == 0 || strcmp(g->short_name, arg) == 0)
+                {
+                    return g;
+                }
+            }
+            return NULL;
+        }
     }
     return NULL;
 }
 
+zclk_command *create_main_command()
+{
+    zclk_command *main_command = new_main_command();
+    if (main_command != NULL)
+    {
+        for (const cld_command_group *g = COMMAND_GROUPS; g->name != NULL; g++)
+        {
+            arraylist_add(main_command->sub_commands, g->create());
+        }
+    }
+    return main_command;
+}
+
+zclk_command *create_main_command_for(int argc, char *argv[])
+{
+    const cld_command_group *group = route_command_group(argc, argv);
+    if (group == NULL)
+    {
+        // no (known) group, all of them are needed for help and errors.
+        return create_main_command();
+    }
+
+    zclk_command *main_command = new_main_command();
+    if (main_command != NULL)
+    {
+        arraylist_add(main_command->sub_commands, group->create());
+    }
+    return main_command;
+}
+
 arraylist *create_commands()
 {
     int err = arraylist_new(&CLI_COMMANDS, (void (*)(void *)) & free_command);
@@ -245,8 +510,21 @@ arraylist *create_commands()
 
 int main(int argc, char *argv[])
 {
+    int exit_code = 0;
     docker_log_set_level(LOG_INFO);
 
+    if (should_forward_to_agent(argc, argv))
+    {
+        char *socket_path = cld_agent_socket_path();
+        int status;
+        zclk_res fwd = cld_agent_forward(socket_path, argc, argv, &status);
+        free(socket_path);
+        if (fwd == ZCLK_RES_SUCCESS)
+        {
+            return status;
+        }
+    }
+
     d_err_t res = docker_api_init();
 
     if (res == 0)
@@ -256,14 +534,30 @@ int main(int argc, char *argv[])
             docker_log_debug("command name is %s\n", argv[0]);
             main_command_name = argv[0];
 
-            start_lua_interpreter();
-
-
-            zclk_res err = zclk_command_exec(create_main_command(), &ctx, argc, argv);
+            if (exec_main_command(argc, argv, &ctx) != ZCLK_RES_SUCCESS)
+            {
+                exit_code = 1;
+            }
 
-            if (err != ZCLK_RES_SUCCESS)
+            // the connection and the lua interpreter set up by the first
+            // command are reused by every batch line or REPL command.
+            if (batch_path != NULL && connected)
+            {
+                // start lua before forking, so parallel lines share it.
+                if (batch_parallel > 1)
+                {
+                    start_lua_interpreter();
+                }
+                if (cld_batch(batch_path, batch_parallel, main_command_name,
+                              &exec_main_command, &ctx) != ZCLK_RES_SUCCESS)
+                {
+                    exit_code = 1;
+                }
+                free(batch_path);
+            }
+            else if (interactive && connected)
             {
-                docker_log_error("Error: invalid command.\n");
+                cld_repl(main_command_name, &exec_main_command, &ctx);
             }
 
             stop_lua_interpreter();
@@ -276,5 +570,5 @@ int main(int argc, char *argv[])
 
     docker_api_cleanup();
 
-    return 0;
+    return exit_code;
 }
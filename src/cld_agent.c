@@ -0,0 +1,548 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <docker_log.h>
+#include "cld_agent.h"
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define CLD_AGENT_SOCKET_NAME "cld-agent.sock"
+#define CLD_AGENT_BACKLOG 64
+#define CLD_AGENT_MAX_ARGS 1024
+#define CLD_AGENT_MAX_ARG_LEN (64 * 1024)
+#define CLD_AGENT_COPY_BUF_LEN (16 * 1024)
+
+/* Tags of the response frames. */
+#define CLD_AGENT_FRAME_STDOUT 1
+#define CLD_AGENT_FRAME_STDERR 2
+#define CLD_AGENT_FRAME_EXIT 3
+
+static volatile sig_atomic_t agent_stop = 0;
+
+static void agent_stop_handler(int sig)
+{
+    agent_stop = 1;
+}
+
+char *cld_agent_socket_path()
+{
+    char *path;
+    char *env_path = getenv(CLD_AGENT_SOCKET_ENV);
+    if (env_path != NULL && env_path[0] != '\0')
+    {
+        return strdup(env_path);
+    }
+
+    char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    path = (char *)calloc(1024, sizeof(char));
+    if (path != NULL)
+    {
+        if (runtime_dir != NULL && runtime_dir[0] != '\0')
+        {
+            snprintf(path, 1024, "%s/%s", runtime_dir, CLD_AGENT_SOCKET_NAME);
+        }
+        else
+        {
+            snprintf(path, 1024, "/tmp/cld-agent-%lu.sock", (unsigned long)getuid());
+        }
+    }
+    return path;
+}
+
+static int fill_sockaddr(struct sockaddr_un *addr, const char *socket_path)
+{
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr->sun_path))
+    {
+        return -1;
+    }
+    strcpy(addr->sun_path, socket_path);
+    return 0;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = (const char *)buf;
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *buf, size_t len)
+{
+    char *p = (char *)buf;
+    while (len > 0)
+    {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int write_str(int fd, const char *str)
+{
+    uint32_t len = (uint32_t)strlen(str);
+    if (write_all(fd, &len, sizeof(len)) != 0)
+    {
+        return -1;
+    }
+    return write_all(fd, str, len);
+}
+
+static char *read_str(int fd)
+{
+    uint32_t len;
+    if (read_all(fd, &len, sizeof(len)) != 0 || len > CLD_AGENT_MAX_ARG_LEN)
+    {
+        return NULL;
+    }
+    char *str = (char *)calloc(len + 1, sizeof(char));
+    if (str != NULL && read_all(fd, str, len) != 0)
+    {
+        free(str);
+        return NULL;
+    }
+    return str;
+}
+
+static int write_frame(int fd, uint8_t tag, const void *data, uint32_t len)
+{
+    if (write_all(fd, &tag, sizeof(tag)) != 0
+        || write_all(fd, &len, sizeof(len)) != 0)
+    {
+        return -1;
+    }
+    return write_all(fd, data, len);
+}
+
+/**
+ * Run the command in a child with its stdout and stderr on pipes, and
+ * relay both to the client as frames until the child exits. Returns the
+ * exit status of the command.
+ */
+static int agent_run_command(int conn, int argc, char **argv,
+                             cld_command_exec_fn exec_fn, void *exec_args)
+{
+    int out_pipe[2], err_pipe[2];
+    if (pipe(out_pipe) != 0)
+    {
+        return 1;
+    }
+    if (pipe(err_pipe) != 0)
+    {
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        return 1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(conn);
+        close(out_pipe[0]);
+        close(err_pipe[0]);
+        dup2(out_pipe[1], STDOUT_FILENO);
+        dup2(err_pipe[1], STDERR_FILENO);
+        close(out_pipe[1]);
+        close(err_pipe[1]);
+
+        zclk_res err = exec_fn(argc, argv, exec_args);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(err == ZCLK_RES_SUCCESS ? 0 : 1);
+    }
+    close(out_pipe[1]);
+    close(err_pipe[1]);
+    if (pid < 0)
+    {
+        close(out_pipe[0]);
+        close(err_pipe[0]);
+        return 1;
+    }
+
+    struct pollfd fds[2] = {
+        {out_pipe[0], POLLIN, 0},
+        {err_pipe[0], POLLIN, 0},
+    };
+    const uint8_t tags[2] = {CLD_AGENT_FRAME_STDOUT, CLD_AGENT_FRAME_STDERR};
+    int open_count = 2;
+    bool client_gone = false;
+    char buf[CLD_AGENT_COPY_BUF_LEN];
+    while (open_count > 0)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        for (int i = 0; i < 2; i++)
+        {
+            if (fds[i].fd < 0 || fds[i].revents == 0)
+            {
+                continue;
+            }
+            ssize_t len = read(fds[i].fd, buf, sizeof(buf));
+            if (len < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (len <= 0)
+            {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                open_count--;
+                continue;
+            }
+            // keep reading after the client is gone, so the command
+            // does not block on a full pipe.
+            if (!client_gone
+                && write_frame(conn, tags[i], buf, (uint32_t)len) != 0)
+            {
+                client_gone = true;
+            }
+        }
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        if (fds[i].fd >= 0)
+        {
+            close(fds[i].fd);
+        }
+    }
+
+    int wstatus;
+    while (waitpid(pid, &wstatus, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            return 1;
+        }
+    }
+    if (WIFEXITED(wstatus))
+    {
+        return WEXITSTATUS(wstatus);
+    }
+    return WIFSIGNALED(wstatus) ? 128 + WTERMSIG(wstatus) : 1;
+}
+
+/**
+ * Request format (native byte order, both ends are on the same host):
+ *   cwd, argc, argv[1..argc-1]
+ * where strings are a uint32 length followed by the bytes, and argc is a
+ * uint32. The response is a sequence of frames: a uint8 tag, a uint32
+ * length and the bytes. Stdout and stderr frames carry the output of the
+ * command as it is written. The last frame is the exit frame, with the
+ * int32 exit status of the command, and then the agent closes the
+ * connection.
+ */
+static void agent_serve_request(int conn, const char *main_command_name,
+                                cld_command_exec_fn exec_fn, void *exec_args)
+{
+    uint32_t argc;
+    char *cwd = read_str(conn);
+    if (cwd == NULL || read_all(conn, &argc, sizeof(argc)) != 0
+        || argc == 0 || argc > CLD_AGENT_MAX_ARGS)
+    {
+        docker_log_error("Invalid agent request.\n");
+        return;
+    }
+
+    char **argv = (char **)calloc(argc + 1, sizeof(char *));
+    if (argv == NULL)
+    {
+        return;
+    }
+    argv[0] = (char *)main_command_name;
+    for (uint32_t i = 1; i < argc; i++)
+    {
+        argv[i] = read_str(conn);
+        if (argv[i] == NULL)
+        {
+            docker_log_error("Invalid agent request.\n");
+            return;
+        }
+    }
+
+    if (cwd[0] != '\0' && chdir(cwd) != 0)
+    {
+        docker_log_warn("Could not change to client directory %s\n", cwd);
+    }
+
+    int devnull = open("/dev/null", O_RDONLY);
+    if (devnull >= 0)
+    {
+        dup2(devnull, STDIN_FILENO);
+        close(devnull);
+    }
+
+    int32_t status = (int32_t)agent_run_command(conn, (int)argc, argv,
+                                                exec_fn, exec_args);
+    write_frame(conn, CLD_AGENT_FRAME_EXIT, &status, sizeof(status));
+    close(conn);
+}
+
+static int agent_listen(const char *socket_path)
+{
+    struct sockaddr_un addr;
+    if (fill_sockaddr(&addr, socket_path) != 0)
+    {
+        docker_log_error("Agent socket path too long: %s\n", socket_path);
+        return -1;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0)
+    {
+        return -1;
+    }
+
+    // only the owner may talk to the agent, it holds the docker connection.
+    mode_t old_mask = umask(0077);
+    int err = bind(sock, (struct sockaddr *)&addr, sizeof(addr));
+    if (err != 0 && errno == EADDRINUSE)
+    {
+        // a socket file exists, reuse the path only if it is stale.
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (probe >= 0 && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+        {
+            unlink(socket_path);
+            err = bind(sock, (struct sockaddr *)&addr, sizeof(addr));
+        }
+        else
+        {
+            docker_log_error("An agent is already listening at %s\n", socket_path);
+        }
+        if (probe >= 0)
+        {
+            close(probe);
+        }
+    }
+    umask(old_mask);
+
+    if (err != 0 || listen(sock, CLD_AGENT_BACKLOG) != 0)
+    {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+zclk_res cld_agent_serve(const char *socket_path, const char *main_command_name,
+                         cld_command_exec_fn exec_fn, void *exec_args)
+{
+    int sock = agent_listen(socket_path);
+    if (sock < 0)
+    {
+        docker_log_error("Could not listen at %s\n", socket_path);
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+    docker_log_info("cld agent listening at %s\n", socket_path);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = &agent_stop_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    // children are never waited for, let the kernel reap them.
+    signal(SIGCHLD, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+
+    fflush(stdout);
+    fflush(stderr);
+
+    while (!agent_stop)
+    {
+        int conn = accept(sock, NULL, NULL);
+        if (conn < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            docker_log_error("Agent accept failed: %s\n", strerror(errno));
+            break;
+        }
+
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            close(sock);
+            signal(SIGINT, SIG_DFL);
+            signal(SIGTERM, SIG_DFL);
+            signal(SIGCHLD, SIG_DFL);
+            signal(SIGPIPE, SIG_DFL);
+            agent_serve_request(conn, main_command_name, exec_fn, exec_args);
+            _exit(0);
+        }
+        else if (pid < 0)
+        {
+            docker_log_error("Agent fork failed: %s\n", strerror(errno));
+        }
+        close(conn);
+    }
+
+    close(sock);
+    unlink(socket_path);
+    docker_log_info("cld agent stopped.\n");
+    return ZCLK_RES_SUCCESS;
+}
+
+zclk_res cld_agent_forward(const char *socket_path, int argc, char *argv[],
+                           int *status)
+{
+    struct sockaddr_un addr;
+    if (socket_path == NULL || fill_sockaddr(&addr, socket_path) != 0)
+    {
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0)
+    {
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(sock);
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+    {
+        cwd[0] = '\0';
+    }
+    uint32_t n = (uint32_t)argc;
+    int err = write_str(sock, cwd);
+    if (err == 0)
+    {
+        err = write_all(sock, &n, sizeof(n));
+    }
+    for (int i = 1; err == 0 && i < argc; i++)
+    {
+        err = write_str(sock, argv[i]);
+    }
+    if (err != 0)
+    {
+        close(sock);
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+    shutdown(sock, SHUT_WR);
+
+    // a connection closed without an exit frame is a failed command.
+    *status = 1;
+    char buf[CLD_AGENT_COPY_BUF_LEN];
+    uint8_t tag;
+    uint32_t len;
+    while (read_all(sock, &tag, sizeof(tag)) == 0
+           && read_all(sock, &len, sizeof(len)) == 0)
+    {
+        if (tag == CLD_AGENT_FRAME_EXIT)
+        {
+            int32_t exit_status;
+            if (len == sizeof(exit_status)
+                && read_all(sock, &exit_status, sizeof(exit_status)) == 0)
+            {
+                *status = (int)exit_status;
+            }
+            break;
+        }
+        int out_fd = tag == CLD_AGENT_FRAME_STDERR ? STDERR_FILENO : STDOUT_FILENO;
+        while (len > 0)
+        {
+            size_t chunk = len < sizeof(buf) ? len : sizeof(buf);
+            if (read_all(sock, buf, chunk) != 0)
+            {
+                close(sock);
+                return ZCLK_RES_SUCCESS;
+            }
+            write_all(out_fd, buf, chunk);
+            len -= (uint32_t)chunk;
+        }
+    }
+    close(sock);
+    return ZCLK_RES_SUCCESS;
+}
+
+#else
+
+char *cld_agent_socket_path()
+{
+    return NULL;
+}
+
+zclk_res cld_agent_serve(const char *socket_path, const char *main_command_name,
+                         cld_command_exec_fn exec_fn, void *exec_args)
+{
+    docker_log_error("cld agent is not supported on this platform.\n");
+    return ZCLK_RES_ERR_UNKNOWN;
+}
+
+zclk_res cld_agent_forward(const char *socket_path, int argc, char *argv[],
+                           int *status)
+{
+    return ZCLK_RES_ERR_UNKNOWN;
+}
+
+#endif // _WIN32
@@ -0,0 +1,65 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SRC_CLD_AGENT_H_
+#define SRC_CLD_AGENT_H_
+
+#include "cld_common.h"
+
+/** Environment variable naming the agent socket (overrides the default). */
+#define CLD_AGENT_SOCKET_ENV "CLD_AGENT_SOCKET"
+
+/** When set in the environment, the client never forwards to an agent. */
+#define CLD_AGENT_DISABLE_ENV "CLD_NO_AGENT"
+
+/**
+ * Get the path of the agent socket, from the environment if set, or the
+ * per-user default location. The returned string must be freed by the caller.
+ */
+char *cld_agent_socket_path();
+
+/**
+ * Run the agent: listen on the unix socket at socket_path and run every
+ * command line received with exec_fn. Each request is served by a forked
+ * child, so the docker context and lua state prepared by the caller are
+ * shared (warm) and every command starts from the same clean state.
+ *
+ * Returns only when the agent is stopped (SIGINT/SIGTERM) or on error.
+ */
+zclk_res cld_agent_serve(const char *socket_path, const char *main_command_name,
+                         cld_command_exec_fn exec_fn, void *exec_args);
+
+/**
+ * Forward the command line to a running agent and copy the output of the
+ * command to stdout and stderr until the agent closes the connection.
+ *
+ * Returns ZCLK_RES_SUCCESS if the command was handled by the agent, with
+ * its exit status in status (non-zero if the command failed, or if the
+ * agent went away before it completed), or an error if no agent is
+ * listening at socket_path (the caller should then run the command
+ * in-process).
+ */
+zclk_res cld_agent_forward(const char *socket_path, int argc, char *argv[],
+                           int *status);
+
+#endif /* SRC_CLD_AGENT_H_ */
@@ -0,0 +1,593 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <curl/curl.h>
+#include <json-c/json_tokener.h>
+#include "docker_all.h"
+#include "cld_async.h"
+
+#define CLD_ASYNC_UNIX_PREFIX "unix://"
+#define CLD_ASYNC_TCP_PREFIX "tcp://"
+#define CLD_ASYNC_UNIX_HOST "http://localhost"
+#define CLD_ASYNC_WAIT_MS 100
+#define CLD_ASYNC_STREAM_BUFFER (256L * 1024)
+
+struct cld_async_request_t
+{
+    cld_async *async;
+    CURL *easy;
+    struct curl_slist *headers;
+    char *method;
+    char *url;
+    char *body;
+    cld_async_data_fn data_fn;
+    cld_async_done_fn done_fn;
+    void *cbargs;
+    char *resp;
+    size_t resp_len;
+    size_t resp_cap;
+    long status;
+    CURLcode result;
+    bool cancelled;
+    bool aborted;
+    char *message;
+    char errbuf[CURL_ERROR_SIZE];
+    struct cld_async_request_t *prev;
+    struct cld_async_request_t *next;
+};
+
+/* doubly linked list of requests */
+typedef struct cld_async_list_t
+{
+    cld_async_request *head;
+    cld_async_request *tail;
+} cld_async_list;
+
+struct cld_async_t
+{
+    CURLM *multi;
+    char *base_url;
+    char *socket_path;
+    size_t max_active;
+    size_t num_active;
+    cld_async_list queued;
+    cld_async_list active;
+    bool stopped;
+    long tick_ms;
+    long long last_tick;
+    cld_async_tick_fn tick_fn;
+    void *tick_args;
+};
+
+static void list_append(cld_async_list *list, cld_async_request *req)
+{
+    req->next = NULL;
+    req->prev = list->tail;
+    if (list->tail != NULL)
+    {
+        list->tail->next = req;
+    }
+    else
+    {
+        list->head = req;
+    }
+    list->tail = req;
+}
+
+static void list_remove(cld_async_list *list, cld_async_request *req)
+{
+    if (req->prev != NULL)
+    {
+        req->prev->next = req->next;
+    }
+    else
+    {
+        list->head = req->next;
+    }
+    if (req->next != NULL)
+    {
+        req->next->prev = req->prev;
+    }
+    else
+    {
+        list->tail = req->prev;
+    }
+    req->prev = req->next = NULL;
+}
+
+long long cld_async_now_ms()
+{
+#ifdef _WIN32
+    return (long long)clock() * 1000 / CLOCKS_PER_SEC;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+static bool starts_with(const char *str, const char *prefix)
+{
+    return strncmp(str, prefix, strlen(prefix)) == 0;
+}
+
+zclk_res make_cld_async(cld_async **async, docker_context *ctx, size_t max_active)
+{
+    if (ctx == NULL || ctx->url == NULL)
+    {
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+
+    cld_async *a = (cld_async *)calloc(1, sizeof(cld_async));
+    if (a == NULL)
+    {
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+
+    // requests on a unix socket use a dummy host, the daemon ignores it.
+    const char *url = ctx->url;
+    if (starts_with(url, CLD_ASYNC_UNIX_PREFIX))
+    {
+        a->socket_path = str_clone(url + strlen(CLD_ASYNC_UNIX_PREFIX));
+        a->base_url = str_clone(CLD_ASYNC_UNIX_HOST);
+    }
+    else if (url[0] == '/')
+    {
+        a->socket_path = str_clone(url);
+        a->base_url = str_clone(CLD_ASYNC_UNIX_HOST);
+    }
+    else if (starts_with(url, CLD_ASYNC_TCP_PREFIX))
+    {
+        size_t len = strlen("http://") + strlen(url) + 1;
+        a->base_url = (char *)malloc(len);
+        if (a->base_url != NULL)
+        {
+            snprintf(a->base_url, len, "http://%s",
+                     url + strlen(CLD_ASYNC_TCP_PREFIX));
+        }
+    }
+    else
+    {
+        a->base_url = str_clone(url);
+    }
+
+    // strip the trailing slash, paths always start with one.
+    if (a->base_url != NULL)
+    {
+        size_t len = strlen(a->base_url);
+        if (len > 0 && a->base_url[len - 1] == '/')
+        {
+            a->base_url[len - 1] = '\0';
+        }
+    }
+
+    a->multi = curl_multi_init();
+    if (a->base_url == NULL || a->multi == NULL)
+    {
+        free_cld_async(a);
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+    a->max_active = max_active;
+    *async = a;
+    return ZCLK_RES_SUCCESS;
+}
+
+static void free_request(cld_async_request *req)
+{
+    if (req->easy != NULL)
+    {
+        curl_easy_cleanup(req->easy);
+    }
+    curl_slist_free_all(req->headers);
+    free(req->method);
+    free(req->url);
+    free(req->body);
+    free(req->resp);
+    free(req->message);
+    free(req);
+}
+
+void free_cld_async(cld_async *async)
+{
+    if (async == NULL)
+    {
+        return;
+    }
+    while (async->active.head != NULL)
+    {
+        cld_async_request *req = async->active.head;
+        list_remove(&async->active, req);
+        curl_multi_remove_handle(async->multi, req->easy);
+        free_request(req);
+    }
+    while (async->queued.head != NULL)
+    {
+        cld_async_request *req = async->queued.head;
+        list_remove(&async->queued, req);
+        free_request(req);
+    }
+    if (async->multi != NULL)
+    {
+        curl_multi_cleanup(async->multi);
+    }
+    free(async->base_url);
+    free(async->socket_path);
+    free(async);
+}
+
+static size_t request_write_cb(char *data, size_t size, size_t nmemb, void *userp)
+{
+    cld_async_request *req = (cld_async_request *)userp;
+    size_t len = size * nmemb;
+
+    if (req->cancelled)
+    {
+        req->aborted = true;
+        return 0;
+    }
+
+    if (req->status == 0)
+    {
+        curl_easy_getinfo(req->easy, CURLINFO_RESPONSE_CODE, &req->status);
+    }
+
+    // error responses are buffered even for streaming requests, for
+    // cld_async_request_message.
+    if (req->data_fn != NULL && req->status >= 200 && req->status < 300)
+    {
+        if (req->data_fn(req, data, len, req->cbargs) != 0)
+        {
+            req->aborted = true;
+            return 0;
+        }
+        return len;
+    }
+
+    if (req->resp_len + len + 1 > req->resp_cap)
+    {
+        size_t cap = req->resp_cap == 0 ? 4096 : req->resp_cap;
+        while (req->resp_len + len + 1 > cap)
+        {
+            cap *= 2;
+        }
+        char *resp = (char *)realloc(req->resp, cap);
+        if (resp == NULL)
+        {
+            return 0;
+        }
+        req->resp = resp;
+        req->resp_cap = cap;
+    }
+    memcpy(req->resp + req->resp_len, data, len);
+    req->resp_len += len;
+    req->resp[req->resp_len] = '\0';
+    return len;
+}
+
+cld_async_request *cld_async_submit(cld_async *async, const char *method,
+                                    const char *path, const char *body,
+                                    cld_async_data_fn data_fn,
+                                    cld_async_done_fn done_fn, void *cbargs)
+{
+    cld_async_request *req =
+        (cld_async_request *)calloc(1, sizeof(cld_async_request));
+    if (req == NULL)
+    {
+        return NULL;
+    }
+
+    size_t url_len = strlen(async->base_url) + strlen(path) + 1;
+    req->async = async;
+    req->data_fn = data_fn;
+    req->done_fn = done_fn;
+    req->cbargs = cbargs;
+    req->method = str_clone(method == NULL ? "GET" : method);
+    req->url = (char *)malloc(url_len);
+    req->easy = curl_easy_init();
+    if (body != NULL)
+    {
+        req->body = str_clone(body);
+    }
+    if (req->method == NULL || req->url == NULL || req->easy == NULL
+        || (body != NULL && req->body == NULL))
+    {
+        free_request(req);
+        return NULL;
+    }
+    snprintf(req->url, url_len, "%s%s", async->base_url, path);
+
+    CURL *easy = req->easy;
+    curl_easy_setopt(easy, CURLOPT_URL, req->url);
+    if (async->socket_path != NULL)
+    {
+        curl_easy_setopt(easy, CURLOPT_UNIX_SOCKET_PATH, async->socket_path);
+    }
+    curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(easy, CURLOPT_PRIVATE, req);
+    curl_easy_setopt(easy, CURLOPT_ERRORBUFFER, req->errbuf);
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, &request_write_cb);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, req);
+    if (data_fn != NULL)
+    {
+        // larger receives mean fewer, bigger callbacks for streams.
+        curl_easy_setopt(easy, CURLOPT_BUFFERSIZE, CLD_ASYNC_STREAM_BUFFER);
+    }
+    if (strcmp(req->method, "POST") == 0)
+    {
+        // an empty body is still a POST, the daemon requires it.
+        curl_easy_setopt(easy, CURLOPT_POST, 1L);
+        curl_easy_setopt(easy, CURLOPT_POSTFIELDS,
+                         req->body == NULL ? "" : req->body);
+        curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE,
+                         (long)(req->body == NULL ? 0 : strlen(req->body)));
+    }
+    else if (strcmp(req->method, "GET") != 0)
+    {
+        curl_easy_setopt(easy, CURLOPT_CUSTOMREQUEST, req->method);
+        if (req->body != NULL)
+        {
+            curl_easy_setopt(easy, CURLOPT_POSTFIELDS, req->body);
+        }
+    }
+    if (req->body != NULL)
+    {
+        req->headers = curl_slist_append(NULL, "Content-Type: application/json");
+        curl_easy_setopt(easy, CURLOPT_HTTPHEADER, req->headers);
+    }
+
+    list_append(&async->queued, req);
+    return req;
+}
+
+void cld_async_set_tick(cld_async *async, long interval_ms,
+                        cld_async_tick_fn tick_fn, void *cbargs)
+{
+    async->tick_ms = interval_ms;
+    async->tick_fn = tick_fn;
+    async->tick_args = cbargs;
+    async->last_tick = cld_async_now_ms();
+}
+
+void cld_async_stop(cld_async *async)
+{
+    async->stopped = true;
+}
+
+size_t cld_async_pending(cld_async *async)
+{
+    size_t pending = async->num_active;
+    for (cld_async_request *req = async->queued.head; req != NULL; req = req->next)
+    {
+        pending++;
+    }
+    return pending;
+}
+
+void cld_async_request_cancel(cld_async_request *req)
+{
+    req->cancelled = true;
+}
+
+/* Report a request as complete and free it. */
+static void complete_request(cld_async_request *req)
+{
+    if (req->done_fn != NULL)
+    {
+        req->done_fn(req, req->cbargs);
+    }
+    free_request(req);
+}
+
+/* Move queued requests to the multi handle, up to the active limit. */
+static void activate_queued(cld_async *async)
+{
+    while (async->queued.head != NULL
+           && (async->max_active == 0 || async->num_active < async->max_active))
+    {
+        cld_async_request *req = async->queued.head;
+        list_remove(&async->queued, req);
+        if (req->cancelled)
+        {
+            complete_request(req);
+            continue;
+        }
+        if (curl_multi_add_handle(async->multi, req->easy) != CURLM_OK)
+        {
+            req->result = -1;
+            snprintf(req->errbuf, sizeof(req->errbuf), "Could not start request");
+            complete_request(req);
+            continue;
+        }
+        list_append(&async->active, req);
+        async->num_active++;
+    }
+}
+
+static void finish_active(cld_async *async, cld_async_request *req, CURLcode result)
+{
+    list_remove(&async->active, req);
+    async->num_active--;
+    curl_multi_remove_handle(async->multi, req->easy);
+    req->result = result;
+    curl_easy_getinfo(req->easy, CURLINFO_RESPONSE_CODE, &req->status);
+    complete_request(req);
+}
+
+zclk_res cld_async_run(cld_async *async)
+{
+    async->stopped = false;
+    while (!async->stopped)
+    {
+        activate_queued(async);
+        if (async->num_active == 0 && async->queued.head == NULL)
+        {
+            break;
+        }
+
+        int running = 0;
+        if (curl_multi_perform(async->multi, &running) != CURLM_OK)
+        {
+            return ZCLK_RES_ERR_UNKNOWN;
+        }
+
+        CURLMsg *msg;
+        int msgs_left;
+        while (!async->stopped
+               && (msg = curl_multi_info_read(async->multi, &msgs_left)) != NULL)
+        {
+            if (msg->msg == CURLMSG_DONE)
+            {
+                cld_async_request *req = NULL;
+                curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &req);
+                finish_active(async, req, msg->data.result);
+            }
+        }
+
+        // cancelled requests which are not receiving data are ended here.
+        cld_async_request *req = async->active.head;
+        while (!async->stopped && req != NULL)
+        {
+            cld_async_request *next = req->next;
+            if (req->cancelled)
+            {
+                req->aborted = true;
+                finish_active(async, req, -1);
+            }
+            req = next;
+        }
+
+        if (async->tick_fn != NULL && async->tick_ms > 0 && !async->stopped)
+        {
+            long long now = cld_async_now_ms();
+            if (now - async->last_tick >= async->tick_ms)
+            {
+                async->last_tick = now;
+                async->tick_fn(async, async->tick_args);
+            }
+        }
+
+        if (!async->stopped && running > 0)
+        {
+            int timeout = CLD_ASYNC_WAIT_MS;
+            if (async->tick_fn != NULL && async->tick_ms > 0
+                && async->tick_ms < timeout)
+            {
+                timeout = (int)async->tick_ms;
+            }
+            curl_multi_wait(async->multi, NULL, 0, timeout, NULL);
+        }
+    }
+    return ZCLK_RES_SUCCESS;
+}
+
+long cld_async_request_status(cld_async_request *req)
+{
+    return req->status;
+}
+
+bool cld_async_request_ok(cld_async_request *req)
+{
+    return req->result == CURLE_OK && !req->aborted
+           && ((req->status >= 200 && req->status < 300) || req->status == 304);
+}
+
+const char *cld_async_request_error(cld_async_request *req)
+{
+    if (req->aborted)
+    {
+        return "Request cancelled";
+    }
+    if (req->result == CURLE_OK)
+    {
+        return NULL;
+    }
+    if (req->errbuf[0] != '\0')
+    {
+        return req->errbuf;
+    }
+    return curl_easy_strerror(req->result);
+}
+
+const char *cld_async_request_body(cld_async_request *req, size_t *len)
+{
+    if (len != NULL)
+    {
+        *len = req->resp_len;
+    }
+    return req->resp;
+}
+
+json_object *cld_async_request_json(cld_async_request *req)
+{
+    if (req->resp == NULL)
+    {
+        return NULL;
+    }
+    return json_tokener_parse(req->resp);
+}
+
+const char *cld_async_request_message(cld_async_request *req)
+{
+    if (req->message != NULL)
+    {
+        return req->message;
+    }
+
+    const char *err = cld_async_request_error(req);
+    if (err != NULL)
+    {
+        return err;
+    }
+
+    // the daemon reports errors as {"message": "..."}
+    json_object *obj = cld_async_request_json(req);
+    json_object *msg_obj;
+    if (obj != NULL && json_object_object_get_ex(obj, "message", &msg_obj))
+    {
+        req->message = str_clone(json_object_get_string(msg_obj));
+    }
+    else
+    {
+        char status_str[64];
+        snprintf(status_str, sizeof(status_str), "HTTP status %ld", req->status);
+        req->message = str_clone(status_str);
+    }
+    json_object_put(obj);
+    return req->message;
+}
+
+char *cld_async_escape(const char *str)
+{
+    char *escaped = curl_easy_escape(NULL, str, 0);
+    if (escaped == NULL)
+    {
+        return NULL;
+    }
+    char *res = str_clone(escaped);
+    curl_free(escaped);
+    return res;
+}
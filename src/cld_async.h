@@ -0,0 +1,135 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SRC_CLD_ASYNC_H_
+#define SRC_CLD_ASYNC_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <json-c/json_object.h>
+#include "cld_common.h"
+
+/**
+ * cld_async: runs many Docker API requests concurrently on a single
+ * thread, using a curl multi handle. Requests are submitted with a
+ * completion callback (and optionally a callback receiving the response
+ * body as it arrives), then cld_async_run drives all of them.
+ *
+ * Callbacks are always called from cld_async_run, never concurrently, and
+ * may submit new requests.
+ */
+typedef struct cld_async_t cld_async;
+typedef struct cld_async_request_t cld_async_request;
+
+/**
+ * Receives the response body of a streaming request as it arrives.
+ * Return 0 to continue, non-zero to abort the request.
+ */
+typedef int (*cld_async_data_fn)(cld_async_request *req, const char *data,
+                                 size_t len, void *cbargs);
+
+/**
+ * Called once when a request completes, successfully or not. The request
+ * is freed after the callback returns.
+ */
+typedef void (*cld_async_done_fn)(cld_async_request *req, void *cbargs);
+
+/** Called periodically while cld_async_run is running. */
+typedef void (*cld_async_tick_fn)(cld_async *async, void *cbargs);
+
+/**
+ * Create a request engine for the daemon of the docker context.
+ * At most max_active requests are in flight at once, the others wait in
+ * submission order (0 means no limit).
+ */
+zclk_res make_cld_async(cld_async **async, docker_context *ctx, size_t max_active);
+
+/** Free the engine. Requests not yet completed are dropped silently. */
+void free_cld_async(cld_async *async);
+
+/**
+ * Submit a request. path is the API path with query string
+ * (e.g. "/containers/json?all=1"), body is an optional JSON body.
+ *
+ * If data_fn is NULL the response body is buffered and available in
+ * done_fn with cld_async_request_body/cld_async_request_json. Error
+ * responses (non 2xx status) are always buffered.
+ *
+ * Returns the request, or NULL if it could not be created.
+ */
+cld_async_request *cld_async_submit(cld_async *async, const char *method,
+                                    const char *path, const char *body,
+                                    cld_async_data_fn data_fn,
+                                    cld_async_done_fn done_fn, void *cbargs);
+
+/** Call tick_fn every interval_ms while running (NULL to disable). */
+void cld_async_set_tick(cld_async *async, long interval_ms,
+                        cld_async_tick_fn tick_fn, void *cbargs);
+
+/**
+ * Run the event loop until all requests are complete or cld_async_stop is
+ * called.
+ */
+zclk_res cld_async_run(cld_async *async);
+
+/** Make cld_async_run return after the current callback. */
+void cld_async_stop(cld_async *async);
+
+/** Number of submitted requests not yet completed. */
+size_t cld_async_pending(cld_async *async);
+
+/** Abort a request, its done_fn is still called (with an error). */
+void cld_async_request_cancel(cld_async_request *req);
+
+/** HTTP status of the response, 0 if no response was received. */
+long cld_async_request_status(cld_async_request *req);
+
+/** Check if the request completed with a 2xx (or 304) status. */
+bool cld_async_request_ok(cld_async_request *req);
+
+/** Transport error message, or NULL if the transfer succeeded. */
+const char *cld_async_request_error(cld_async_request *req);
+
+/** Buffered response body (always NUL terminated), or NULL if streamed. */
+const char *cld_async_request_body(cld_async_request *req, size_t *len);
+
+/**
+ * Parse the buffered response body as JSON. The returned object is owned
+ * by the caller. Returns NULL if there is no body or it is not JSON.
+ */
+json_object *cld_async_request_json(cld_async_request *req);
+
+/**
+ * Get a short message describing a failed request: the daemon's error
+ * message if any, else the transport error or the HTTP status.
+ * The returned string is valid until the request is freed.
+ */
+const char *cld_async_request_message(cld_async_request *req);
+
+/** Escape a string for use in a request path or query string. */
+char *cld_async_escape(const char *str);
+
+/** Milliseconds from a monotonic clock. */
+long long cld_async_now_ms();
+
+#endif /* SRC_CLD_ASYNC_H_ */
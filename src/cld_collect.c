@@ -0,0 +1,1020 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#include <direct.h>
+#define make_dir(path) _mkdir(path)
+#define truncate_fd(fd, size) _chsize_s(fd, size)
+#else
+#include <unistd.h>
+#define make_dir(path) mkdir(path, 0755)
+#define truncate_fd(fd, size) ftruncate(fd, (off_t)(size))
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+#include <json-c/json_tokener.h>
+#include "docker_all.h"
+#include "cld_async.h"
+#include "cld_logs.h"
+#include "cld_collect.h"
+
+#define NS_PER_SEC 1000000000LL
+
+typedef struct collect_session_t collect_session;
+
+/*
+ * The log of one container, kept until the container is removed so that
+ * it is resumed when the container starts again.
+ */
+typedef struct collect_stream_t
+{
+    collect_session *session;
+    char *id;
+    char *name;
+    char *path;
+    int fd;
+    int64_t size;
+    /* size of the file when the lines up to saved_ns were written */
+    int64_t saved_size;
+    /* timestamp of the last line added to the file */
+    int64_t last_ns;
+    /* timestamp of the last line known to be written to the file */
+    int64_t saved_ns;
+    bool open;
+    /* a write failed, the log is read again from the checkpoint */
+    bool failed;
+    /* the container was removed, freed when its request is done */
+    bool removed;
+    cld_logs_demux demux;
+} collect_stream;
+
+/* A checkpoint read from the file, until a container takes it. */
+typedef struct collect_checkpoint_t
+{
+    char *id;
+    int64_t ns;
+} collect_checkpoint;
+
+struct collect_session_t
+{
+    cld_async *async;
+    const cld_collect_opts *opts;
+    arraylist *containers;
+    arraylist *streams;
+    /* the checkpoints read at start, dropped once containers are listed */
+    arraylist *loaded;
+    char *checkpoint;
+    bool dirty;
+    cld_logs_demux events;
+    json_tokener *tok;
+    /* one sink for all files, flushed before it is used for another */
+    cld_logs_sink sink;
+    zclk_command_output_handler error_handler;
+};
+
+void cld_collect_opts_init(cld_collect_opts *opts)
+{
+    memset(opts, 0, sizeof(cld_collect_opts));
+    opts->max_size = CLD_COLLECT_MAX_SIZE;
+    opts->max_files = CLD_COLLECT_MAX_FILES;
+}
+
+static char *path_join(const char *dir, const char *name)
+{
+    size_t len = strlen(dir) + strlen(name) + 2;
+    char *path = (char *)malloc(len);
+    if (path != NULL)
+    {
+        snprintf(path, len, "%s/%s", dir, name);
+    }
+    return path;
+}
+
+static void free_collect_stream(void *item)
+{
+    collect_stream *stream = (collect_stream *)item;
+    if (stream->fd >= 0)
+    {
+        close(stream->fd);
+    }
+    free(stream->id);
+    free(stream->name);
+    free(stream->path);
+    free(stream);
+}
+
+static void free_collect_checkpoint(void *item)
+{
+    collect_checkpoint *loaded = (collect_checkpoint *)item;
+    free(loaded->id);
+    free(loaded);
+}
+
+static collect_stream *session_find(collect_session *session, const char *id)
+{
+    size_t len = arraylist_length(session->streams);
+    for (size_t i = 0; i < len; i++)
+    {
+        collect_stream *stream =
+            (collect_stream *)arraylist_get(session->streams, i);
+        if (strcmp(stream->id, id) == 0)
+        {
+            return stream;
+        }
+    }
+    return NULL;
+}
+
+static collect_stream *session_stream_new(collect_session *session,
+                                          const char *id)
+{
+    // the line buffers make this too large for the stack.
+    collect_stream *stream = (collect_stream *)calloc(1, sizeof(collect_stream));
+    if (stream == NULL)
+    {
+        return NULL;
+    }
+    stream->session = session;
+    stream->fd = -1;
+    stream->id = str_clone(id);
+    if (stream->id == NULL)
+    {
+        free(stream);
+        return NULL;
+    }
+    // resume from the checkpoint read at start, if any.
+    size_t len = session->loaded == NULL ? 0 : arraylist_length(session->loaded);
+    for (size_t i = 0; i < len; i++)
+    {
+        collect_checkpoint *loaded =
+            (collect_checkpoint *)arraylist_get(session->loaded, i);
+        if (loaded->id != NULL && strcmp(loaded->id, id) == 0)
+        {
+            stream->last_ns = loaded->ns;
+            stream->saved_ns = loaded->ns;
+            free(loaded->id);
+            loaded->id = NULL;
+            break;
+        }
+    }
+    arraylist_add(session->streams, stream);
+    return stream;
+}
+
+/*
+ * Forget the stream of a removed container, and its checkpoint. The
+ * streams are kept in a new list without it.
+ */
+static void session_drop(collect_session *session, collect_stream *stream)
+{
+    arraylist *streams;
+    if (arraylist_new(&streams, NULL) != 0)
+    {
+        return;
+    }
+    size_t len = arraylist_length(session->streams);
+    for (size_t i = 0; i < len; i++)
+    {
+        collect_stream *other =
+            (collect_stream *)arraylist_get(session->streams, i);
+        if (other != stream)
+        {
+            arraylist_add(streams, other);
+        }
+    }
+    arraylist_free(session->streams);
+    session->streams = streams;
+    free_collect_stream(stream);
+    session->dirty = true;
+}
+
+/*
+ * Read the checkpoint file, a line "<id> <ns>" per container. The
+ * checkpoints are only taken by the containers listed or started later.
+ */
+static void session_load(collect_session *session)
+{
+    FILE *fp = fopen(session->checkpoint, "r");
+    if (fp == NULL)
+    {
+        return;
+    }
+    char id[256];
+    long long ns;
+    while (fscanf(fp, "%255s %lld", id, &ns) == 2)
+    {
+        collect_checkpoint *loaded =
+            (collect_checkpoint *)calloc(1, sizeof(collect_checkpoint));
+        if (loaded == NULL || (loaded->id = str_clone(id)) == NULL)
+        {
+            free(loaded);
+            break;
+        }
+        loaded->ns = ns;
+        arraylist_add(session->loaded, loaded);
+    }
+    fclose(fp);
+}
+
+/*
+ * Save the checkpoint file, to a temporary file renamed over the old one so
+ * that it is never left half written.
+ */
+static void session_save(collect_session *session)
+{
+    if (!session->dirty)
+    {
+        return;
+    }
+    size_t len = strlen(session->checkpoint) + 5;
+    char *tmp = (char *)malloc(len);
+    if (tmp == NULL)
+    {
+        return;
+    }
+    snprintf(tmp, len, "%s.tmp", session->checkpoint);
+    FILE *fp = fopen(tmp, "w");
+    if (fp == NULL)
+    {
+        docker_log_error("Could not write %s: %s", tmp, strerror(errno));
+        free(tmp);
+        return;
+    }
+    size_t num = arraylist_length(session->streams);
+    for (size_t i = 0; i < num; i++)
+    {
+        collect_stream *stream =
+            (collect_stream *)arraylist_get(session->streams, i);
+        if (stream->saved_ns > 0 && !stream->removed)
+        {
+            fprintf(fp, "%s %lld\n", stream->id, (long long)stream->saved_ns);
+        }
+    }
+    // checkpoints not taken yet, until the containers are listed.
+    num = session->loaded == NULL ? 0 : arraylist_length(session->loaded);
+    for (size_t i = 0; i < num; i++)
+    {
+        collect_checkpoint *loaded =
+            (collect_checkpoint *)arraylist_get(session->loaded, i);
+        if (loaded->id != NULL)
+        {
+            fprintf(fp, "%s %lld\n", loaded->id, (long long)loaded->ns);
+        }
+    }
+    bool ok = fclose(fp) == 0;
+#ifdef _WIN32
+    // rename does not replace an existing file on windows.
+    remove(session->checkpoint);
+#endif
+    if (ok && rename(tmp, session->checkpoint) == 0)
+    {
+        session->dirty = false;
+    }
+    else
+    {
+        docker_log_error("Could not write %s: %s", session->checkpoint,
+                         strerror(errno));
+    }
+    free(tmp);
+}
+
+/*
+ * Write the pending lines of the stream, then move its checkpoint. If the
+ * write fails the file is cut back to the lines of the checkpoint and the
+ * stream is marked failed, so that its request is aborted and restarted
+ * from the checkpoint rather than appending after the lost lines.
+ */
+static void stream_flush(collect_stream *stream)
+{
+    collect_session *session = stream->session;
+    cld_logs_sink_flush(&session->sink);
+    if (session->sink.failed)
+    {
+        docker_log_error("Could not write %s: %s", stream->path,
+                         strerror(errno));
+        session->sink.failed = false;
+        if (stream->fd >= 0 && truncate_fd(stream->fd, stream->saved_size) != 0)
+        {
+            docker_log_error("Could not truncate %s: %s", stream->path,
+                             strerror(errno));
+        }
+        stream->size = stream->saved_size;
+        stream->last_ns = stream->saved_ns;
+        stream->failed = true;
+        return;
+    }
+    stream->saved_size = stream->size;
+    if (stream->saved_ns != stream->last_ns)
+    {
+        stream->saved_ns = stream->last_ns;
+        session->dirty = true;
+    }
+}
+
+static void stream_sync(void *args)
+{
+    stream_flush((collect_stream *)args);
+}
+
+/*
+ * Timestamp of the last line of a log file, to resume after lines written
+ * since the checkpoint was last saved. Returns 0 if there is none.
+ */
+static int64_t file_last_time(int fd, int64_t size)
+{
+    char buf[CLD_LOGS_LINE_MAX + 64];
+    int64_t start = size > (int64_t)sizeof(buf) ? size - (int64_t)sizeof(buf) : 0;
+    if (lseek(fd, (off_t)start, SEEK_SET) < 0)
+    {
+        return 0;
+    }
+    int n = (int)read(fd, buf, (unsigned)(size - start));
+    // skip the newline ending the file, then find the one before the line.
+    while (n > 0 && buf[n - 1] == '\n')
+    {
+        n--;
+    }
+    int line = n;
+    while (line > 0 && buf[line - 1] != '\n')
+    {
+        line--;
+    }
+    int64_t ns;
+    if (n <= 0 || cld_logs_parse_rfc3339(buf + line, (size_t)(n - line), &ns) == 0)
+    {
+        return 0;
+    }
+    return ns;
+}
+
+static bool stream_open(collect_stream *stream)
+{
+    stream->fd = open(stream->path, O_RDWR | O_CREAT | O_APPEND | O_BINARY,
+                      0644);
+    if (stream->fd < 0)
+    {
+        docker_log_error("Could not open %s: %s", stream->path,
+                         strerror(errno));
+        return false;
+    }
+    struct stat st;
+    stream->size = fstat(stream->fd, &st) == 0 ? (int64_t)st.st_size : 0;
+    stream->saved_size = stream->size;
+    if (stream->size > 0)
+    {
+        int64_t ns = file_last_time(stream->fd, stream->size);
+        if (ns > stream->saved_ns)
+        {
+            stream->saved_ns = ns;
+            stream->session->dirty = true;
+        }
+    }
+    stream->session->sink.fd = stream->fd;
+    return true;
+}
+
+/* Rotate <name>.log to <name>.log.1, <name>.log.1 to <name>.log.2, ... */
+static void stream_rotate(collect_stream *stream)
+{
+    int max_files = stream->session->opts->max_files;
+    stream_flush(stream);
+    close(stream->fd);
+    stream->fd = -1;
+
+    size_t len = strlen(stream->path) + 16;
+    char *from = (char *)malloc(len);
+    char *to = (char *)malloc(len);
+    if (from != NULL && to != NULL)
+    {
+        if (max_files > 1)
+        {
+            snprintf(from, len, "%s.%d", stream->path, max_files - 1);
+            remove(from);
+        }
+        for (int i = max_files - 2; i >= 1; i--)
+        {
+            snprintf(from, len, "%s.%d", stream->path, i);
+            snprintf(to, len, "%s.%d", stream->path, i + 1);
+            rename(from, to);
+        }
+        if (max_files > 1)
+        {
+            snprintf(to, len, "%s.1", stream->path);
+            rename(stream->path, to);
+        }
+        else
+        {
+            remove(stream->path);
+        }
+    }
+    free(from);
+    free(to);
+    stream_open(stream);
+}
+
+/*
+ * Line of a container log, with the daemon timestamp. Lines are added to
+ * the sink by reference, and written with one call per received chunk.
+ */
+static void stream_line(void *args, int stream_id, const char *text, size_t len)
+{
+    static const char newline = '\n';
+    collect_stream *stream = (collect_stream *)args;
+    collect_session *session = stream->session;
+    if (stream->failed)
+    {
+        return;
+    }
+
+    int64_t time_ns;
+    if (cld_logs_parse_rfc3339(text, len, &time_ns) > 0)
+    {
+        // since is inclusive, and may be coarser than the timestamps.
+        if (time_ns <= stream->last_ns)
+        {
+            return;
+        }
+    }
+    else
+    {
+        time_ns = stream->last_ns;
+    }
+
+    if (stream->fd < 0)
+    {
+        return;
+    }
+    if (stream->size > 0
+        && stream->size + (int64_t)len + 1 > session->opts->max_size)
+    {
+        stream_rotate(stream);
+        if (stream->fd < 0 || stream->failed)
+        {
+            return;
+        }
+    }
+    cld_logs_sink_add(&session->sink, text, len);
+    cld_logs_sink_add(&session->sink, &newline, 1);
+    stream->size += (int64_t)len + 1;
+    stream->last_ns = time_ns;
+}
+
+static int collect_stream_data(cld_async_request *req, const char *data,
+                               size_t len, void *cbargs)
+{
+    collect_stream *stream = (collect_stream *)cbargs;
+    stream->session->sink.fd = stream->fd;
+    cld_logs_demux_feed(&stream->demux, data, len);
+    // the lines added in place point into data.
+    stream_flush(stream);
+    return stream->failed ? 1 : 0;
+}
+
+static void collect_stream_done(cld_async_request *req, void *cbargs)
+{
+    collect_stream *stream = (collect_stream *)cbargs;
+    stream->session->sink.fd = stream->fd;
+    cld_logs_demux_flush(&stream->demux);
+    stream_flush(stream);
+    if (!cld_async_request_ok(req) && !stream->failed && !stream->removed)
+    {
+        docker_log_error("Failed to get logs of %s: %s", stream->name,
+                         cld_async_request_message(req));
+    }
+    stream->open = false;
+    // opened again if the container starts again.
+    if (stream->fd >= 0)
+    {
+        close(stream->fd);
+        stream->fd = -1;
+    }
+    if (stream->removed)
+    {
+        session_drop(stream->session, stream);
+    }
+}
+
+/* File name for a container name, in the output directory. */
+static char *stream_path(collect_session *session, const char *name)
+{
+    size_t len = strlen(name) + 5;
+    char *file = (char *)malloc(len);
+    if (file == NULL)
+    {
+        return NULL;
+    }
+    snprintf(file, len, "%s.log", name);
+    for (char *c = file; *c != '\0'; c++)
+    {
+        if (*c == '/' || *c == '\\' || *c == ':')
+        {
+            *c = '_';
+        }
+    }
+    char *path = path_join(session->opts->out, file);
+    free(file);
+    return path;
+}
+
+/*
+ * Start following the log of a container, from just after its checkpoint.
+ * Does nothing if it is already followed.
+ */
+static void session_add(collect_session *session, const char *id,
+                        const char *name)
+{
+    collect_stream *stream = session_find(session, id);
+    if (stream == NULL)
+    {
+        stream = session_stream_new(session, id);
+    }
+    if (stream == NULL || stream->open)
+    {
+        return;
+    }
+    if (name[0] == '/')
+    {
+        name++;
+    }
+    if (stream->name == NULL || strcmp(stream->name, name) != 0)
+    {
+        free(stream->name);
+        free(stream->path);
+        if (stream->fd >= 0)
+        {
+            close(stream->fd);
+            stream->fd = -1;
+        }
+        stream->name = str_clone(name);
+        stream->path = stream->name == NULL ? NULL
+                                            : stream_path(session, name);
+    }
+    if (stream->path == NULL || (stream->fd < 0 && !stream_open(stream)))
+    {
+        return;
+    }
+
+    char path[1024];
+    char *escaped = cld_async_escape(id);
+    if (escaped == NULL)
+    {
+        return;
+    }
+    snprintf(path, sizeof(path),
+             "/containers/%s/logs?stdout=1&stderr=1&follow=1&timestamps=1",
+             escaped);
+    free(escaped);
+    // lines not written before are read again.
+    stream->last_ns = stream->saved_ns;
+    if (stream->saved_ns > 0)
+    {
+        int64_t since = stream->saved_ns + 1;
+        size_t len = strlen(path);
+        snprintf(path + len, sizeof(path) - len, "&since=%lld.%09lld",
+                 (long long)(since / NS_PER_SEC),
+                 (long long)(since % NS_PER_SEC));
+    }
+
+    cld_logs_demux_init(&stream->demux, &stream_line, &stream_sync, stream);
+    if (cld_async_submit(session->async, "GET", path, NULL,
+                         &collect_stream_data, &collect_stream_done,
+                         stream) != NULL)
+    {
+        stream->open = true;
+    }
+}
+
+/* Check if a container is one of those asked for, by name or id prefix. */
+static bool session_wants(collect_session *session, const char *id,
+                          const char *name)
+{
+    size_t len = arraylist_length(session->containers);
+    if (len == 0)
+    {
+        return true;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        const char *container = (const char *)arraylist_get(session->containers,
+                                                            i);
+        if (strcmp(container, name) == 0
+            || strncmp(container, id, strlen(container)) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Forget a removed container. Its stream is freed once its request is
+ * done, if it is still open.
+ */
+static void session_remove(collect_session *session, const char *id)
+{
+    collect_stream *stream = session_find(session, id);
+    if (stream == NULL)
+    {
+        return;
+    }
+    if (stream->open)
+    {
+        stream->removed = true;
+        session->dirty = true;
+    }
+    else
+    {
+        session_drop(session, stream);
+    }
+}
+
+/*
+ * Event of a container start, to follow containers started later, or of
+ * a container removal.
+ */
+static void collect_event_line(void *args, int stream_id, const char *text,
+                               size_t len)
+{
+    collect_session *session = (collect_session *)args;
+    json_tokener_reset(session->tok);
+    json_object *event = json_tokener_parse_ex(session->tok, text, (int)len);
+    json_object *id, *action, *actor, *attrs, *name;
+    if (event != NULL && json_object_object_get_ex(event, "id", &id)
+        && json_object_object_get_ex(event, "Action", &action)
+        && strcmp(json_object_get_string(action), "destroy") == 0)
+    {
+        session_remove(session, json_object_get_string(id));
+    }
+    else if (event != NULL && json_object_object_get_ex(event, "id", &id)
+        && json_object_object_get_ex(event, "Actor", &actor)
+        && json_object_object_get_ex(actor, "Attributes", &attrs)
+        && json_object_object_get_ex(attrs, "name", &name)
+        && session_wants(session, json_object_get_string(id),
+                         json_object_get_string(name)))
+    {
+        session_add(session, json_object_get_string(id),
+                    json_object_get_string(name));
+    }
+    json_object_put(event);
+}
+
+static int collect_events_data(cld_async_request *req, const char *data,
+                               size_t len, void *cbargs)
+{
+    collect_session *session = (collect_session *)cbargs;
+    cld_logs_demux_feed(&session->events, data, len);
+    return 0;
+}
+
+static void collect_events_done(cld_async_request *req, void *cbargs)
+{
+    collect_session *session = (collect_session *)cbargs;
+    char res_str[1024];
+    snprintf(res_str, sizeof(res_str),
+             "Events stream ended, new containers are not collected: %s",
+             cld_async_request_message(req));
+    session->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING, res_str);
+}
+
+static void collect_list_done(cld_async_request *req, void *cbargs)
+{
+    collect_session *session = (collect_session *)cbargs;
+    json_object *ctrs = cld_async_request_ok(req) ?
+        cld_async_request_json(req) : NULL;
+    if (ctrs == NULL || !json_object_is_type(ctrs, json_type_array))
+    {
+        char res_str[1024];
+        snprintf(res_str, sizeof(res_str), "Could not list containers: %s",
+                 cld_async_request_message(req));
+        session->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING, res_str);
+        json_object_put(ctrs);
+        cld_async_stop(session->async);
+        return;
+    }
+
+    size_t num = json_object_array_length(ctrs);
+    for (size_t i = 0; i < num; i++)
+    {
+        json_object *ctr = json_object_array_get_idx(ctrs, i);
+        json_object *id, *names;
+        if (!json_object_object_get_ex(ctr, "Id", &id))
+        {
+            continue;
+        }
+        const char *name = json_object_get_string(id);
+        if (json_object_object_get_ex(ctr, "Names", &names)
+            && json_object_array_length(names) > 0)
+        {
+            name = json_object_get_string(json_object_array_get_idx(names, 0));
+        }
+        if (session_wants(session, json_object_get_string(id),
+                          name[0] == '/' ? name + 1 : name))
+        {
+            session_add(session, json_object_get_string(id), name);
+        }
+    }
+    json_object_put(ctrs);
+    // the containers not listed were removed, or are not collected.
+    arraylist_free(session->loaded);
+    session->loaded = NULL;
+    session->dirty = true;
+}
+
+/* Restart the streams stopped by a write failure, from their checkpoint. */
+static void session_retry(collect_session *session)
+{
+    size_t len = arraylist_length(session->streams);
+    for (size_t i = 0; i < len; i++)
+    {
+        collect_stream *stream =
+            (collect_stream *)arraylist_get(session->streams, i);
+        if (stream->failed && !stream->open && !stream->removed)
+        {
+            stream->failed = false;
+            session_add(session, stream->id, stream->name);
+        }
+    }
+}
+
+static void collect_tick(cld_async *async, void *cbargs)
+{
+    collect_session *session = (collect_session *)cbargs;
+    session_save(session);
+    session_retry(session);
+}
+
+/*
+ * Subscribe to container start and destroy events, then list the
+ * containers. The subscription comes first so that no container starting
+ * in between is missed.
+ */
+static zclk_res session_start(collect_session *session)
+{
+    json_object *filters = json_object_new_object();
+    json_object *type = json_object_new_array();
+    json_object *event = json_object_new_array();
+    json_object_array_add(type, json_object_new_string("container"));
+    json_object_array_add(event, json_object_new_string("start"));
+    json_object_array_add(event, json_object_new_string("destroy"));
+    json_object_object_add(filters, "type", type);
+    json_object_object_add(filters, "event", event);
+    char *escaped = cld_async_escape(json_object_to_json_string(filters));
+    json_object_put(filters);
+    if (escaped == NULL)
+    {
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+    size_t path_len = strlen(escaped) + 32;
+    char *path = (char *)malloc(path_len);
+    if (path == NULL)
+    {
+        free(escaped);
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+    snprintf(path, path_len, "/events?filters=%s", escaped);
+    free(escaped);
+    cld_logs_demux_init(&session->events, &collect_event_line, NULL, session);
+    cld_async_request *req = cld_async_submit(session->async, "GET", path,
+                                              NULL, &collect_events_data,
+                                              &collect_events_done, session);
+    free(path);
+    if (req == NULL)
+    {
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+
+    req = cld_async_submit(session->async, "GET",
+                           session->opts->all ? "/containers/json?all=1"
+                                              : "/containers/json",
+                           NULL, NULL, &collect_list_done, session);
+    return req == NULL ? ZCLK_RES_ERR_ALLOC_FAILED : ZCLK_RES_SUCCESS;
+}
+
+static void session_free(collect_session *session)
+{
+    if (session->async != NULL)
+    {
+        free_cld_async(session->async);
+    }
+    if (session->streams != NULL)
+    {
+        size_t len = arraylist_length(session->streams);
+        for (size_t i = 0; i < len; i++)
+        {
+            free_collect_stream(arraylist_get(session->streams, i));
+        }
+        arraylist_free(session->streams);
+    }
+    if (session->loaded != NULL)
+    {
+        arraylist_free(session->loaded);
+    }
+    if (session->tok != NULL)
+    {
+        json_tokener_free(session->tok);
+    }
+    free(session->checkpoint);
+    free(session);
+}
+
+zclk_res cld_logs_collect(docker_context *ctx, arraylist *containers,
+                          const cld_collect_opts *opts,
+                          zclk_command_output_handler error_handler)
+{
+    if (make_dir(opts->out) != 0 && errno != EEXIST)
+    {
+        char res_str[1024];
+        snprintf(res_str, sizeof(res_str), "Could not create %s: %s",
+                 opts->out, strerror(errno));
+        error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING, res_str);
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+
+    // the sink and the line buffers make this too large for the stack.
+    collect_session *session = (collect_session *)calloc(1,
+                                                         sizeof(collect_session));
+    if (session == NULL)
+    {
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+    session->opts = opts;
+    session->containers = containers;
+    session->error_handler = error_handler;
+    cld_logs_sink_init(&session->sink, -1);
+    session->checkpoint = path_join(opts->out, CLD_COLLECT_CHECKPOINT);
+    session->tok = json_tokener_new();
+    if (session->checkpoint == NULL || session->tok == NULL
+        || arraylist_new(&session->streams, NULL) != 0
+        || arraylist_new(&session->loaded, &free_collect_checkpoint) != 0)
+    {
+        session_free(session);
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+    session_load(session);
+
+    zclk_res res = make_cld_async(&session->async, ctx, 0);
+    if (res == ZCLK_RES_SUCCESS)
+    {
+        res = session_start(session);
+    }
+    if (res == ZCLK_RES_SUCCESS)
+    {
+        cld_async_set_tick(session->async, CLD_COLLECT_CHECKPOINT_MS,
+                           &collect_tick, session);
+        res = cld_async_run(session->async);
+    }
+    session_save(session);
+    session_free(session);
+    return res;
+}
+
+/* Parse a size with an optional k, m or g suffix. */
+static bool parse_size(const char *str, int64_t *size)
+{
+    char *end;
+    errno = 0;
+    long long val = strtoll(str, &end, 10);
+    if (errno != 0 || end == str || val <= 0)
+    {
+        return false;
+    }
+    switch (*end)
+    {
+    case 'g':
+    case 'G':
+        val *= 1024;
+        // fall through
+    case 'm':
+    case 'M':
+        val *= 1024;
+        // fall through
+    case 'k':
+    case 'K':
+        val *= 1024;
+        end++;
+        break;
+    }
+    *size = val;
+    return *end == '\0';
+}
+
+zclk_res logs_collect_cmd_handler(zclk_command *cmd, void *handler_args)
+{
+    docker_context *ctx = get_docker_context(handler_args);
+    cld_collect_opts opts;
+    cld_collect_opts_init(&opts);
+
+    zclk_option *out_option = get_option_by_name(cmd->options,
+                                                 CLD_OPTION_LONG_OUT);
+    opts.out = zclk_option_get_val_string(out_option);
+    if (opts.out == NULL || opts.out[0] == '\0')
+    {
+        cmd->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING,
+                           "Output directory not provided.");
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+    zclk_option *all_option = get_option_by_name(cmd->options,
+                                                 CLD_OPTION_LONG_ALL);
+    opts.all = zclk_option_get_val_flag(all_option);
+
+    zclk_option *max_size_option = get_option_by_name(cmd->options,
+                                                      CLD_OPTION_LONG_MAX_SIZE);
+    char *max_size = zclk_option_get_val_string(max_size_option);
+    if (max_size != NULL && !parse_size(max_size, &opts.max_size))
+    {
+        cmd->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING,
+                           "Max size must be a size in bytes (e.g. 10m).");
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+    zclk_option *max_files_option = get_option_by_name(cmd->options,
+                                                       CLD_OPTION_LONG_MAX_FILES);
+    opts.max_files = zclk_option_get_val_int(max_files_option);
+    if (opts.max_files < 1)
+    {
+        cmd->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING,
+                           "Max files must be at least 1.");
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+
+    arraylist *containers;
+    if (arraylist_new(&containers, NULL) != 0)
+    {
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+    size_t len = arraylist_length(cmd->args);
+    for (size_t i = 0; i < len; i++)
+    {
+        zclk_argument *container_arg =
+            (zclk_argument *)arraylist_get(cmd->args, i);
+        char *container = zclk_argument_get_val_string(container_arg);
+        if (container != NULL && container[0] != '\0')
+        {
+            arraylist_add(containers, container);
+        }
+    }
+
+    zclk_res res = cld_logs_collect(ctx, containers, &opts, cmd->error_handler);
+    arraylist_free(containers);
+    return res;
+}
+
+zclk_command *logs_commands()
+{
+    zclk_command *logs_command = new_zclk_command("logs", "log",
+                                                  "Docker Log Commands", NULL);
+    if (logs_command != NULL)
+    {
+        zclk_command *collect_command = new_zclk_command("collect", "col",
+                                                         "Collect container logs to files",
+                                                         &logs_collect_cmd_handler);
+        if (collect_command != NULL)
+        {
+            zclk_command_string_argument(collect_command, "Container", NULL,
+                                         "Containers to collect (all if none)",
+                                         -1);
+            zclk_command_string_option(collect_command, CLD_OPTION_LONG_OUT,
+                                       CLD_OPTION_SHORT_OUT, NULL,
+                                       "Output directory");
+            zclk_command_flag_option(collect_command, CLD_OPTION_LONG_ALL,
+                                     CLD_OPTION_SHORT_ALL,
+                                     "Collect stopped containers too");
+            zclk_command_string_option(collect_command, CLD_OPTION_LONG_MAX_SIZE,
+                                       NULL, NULL,
+                                       "Size at which a log file is rotated (default 10m)");
+            zclk_command_int_option(collect_command, CLD_OPTION_LONG_MAX_FILES,
+                                    NULL, CLD_COLLECT_MAX_FILES,
+                                    "Number of log files kept per container");
+            zclk_command_subcommand_add(logs_command, collect_command);
+        }
+    }
+    return logs_command;
+}
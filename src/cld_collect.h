@@ -0,0 +1,83 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SRC_CLD_COLLECT_H_
+#define SRC_CLD_COLLECT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <coll_arraylist.h>
+#include "cld_common.h"
+
+/** Default size at which a log file is rotated. */
+#define CLD_COLLECT_MAX_SIZE (10 * 1024 * 1024)
+
+/** Default number of files kept per container, the current one included. */
+#define CLD_COLLECT_MAX_FILES 5
+
+/** Name of the checkpoint file in the output directory. */
+#define CLD_COLLECT_CHECKPOINT "checkpoint"
+
+/** How often the checkpoint file is saved, if it changed. */
+#define CLD_COLLECT_CHECKPOINT_MS 1000
+
+#define CLD_OPTION_LONG_OUT "out"
+#define CLD_OPTION_SHORT_OUT "o"
+#define CLD_OPTION_LONG_ALL "all"
+#define CLD_OPTION_SHORT_ALL "a"
+#define CLD_OPTION_LONG_MAX_SIZE "max-size"
+#define CLD_OPTION_LONG_MAX_FILES "max-files"
+
+/** Where and how to collect logs. */
+typedef struct cld_collect_opts_t
+{
+    /** Output directory, created if missing. */
+    const char *out;
+    /** Collect the stopped containers too. */
+    bool all;
+    int64_t max_size;
+    int max_files;
+} cld_collect_opts;
+
+/** Initialize options with the default rotation. */
+void cld_collect_opts_init(cld_collect_opts *opts);
+
+/**
+ * Follow the logs of the given containers (a list of names or ids), or of
+ * all (running, unless opts->all) containers if the list is empty, and
+ * write them to <out>/<name>.log with the daemon timestamps. The files are
+ * rotated to <name>.log.1 ... when they reach max_size. Containers started
+ * later are picked up from the events stream.
+ *
+ * The timestamp of the last line written for every container is saved in
+ * the checkpoint file, only after the line is written, and is also read
+ * back from the end of the log file when it is opened. A restart resumes
+ * the logs just after it, without duplicates or gaps.
+ */
+zclk_res cld_logs_collect(docker_context *ctx, arraylist *containers,
+                          const cld_collect_opts *opts,
+                          zclk_command_output_handler error_handler);
+
+zclk_command *logs_commands();
+
+#endif /* SRC_CLD_COLLECT_H_ */
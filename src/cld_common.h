@@ -27,6 +27,12 @@
 #include "docker_connection_util.h"
 #include <zclk.h>
 
+/**
+ * Function which runs one complete cld command line, argv[0] being the
+ * main command name as in main(). Used by the agent, REPL and batch modes.
+ */
+typedef zclk_res (*cld_command_exec_fn)(int argc, char *argv[], void *exec_args);
+
 docker_context *get_docker_context(void *handler_args);
 
 void handle_docker_error(docker_result *res,
@@ -28,17 +28,32 @@
 #include "cld_ctr.h"
 #include "zclk_table.h"
 #include "cld_lua.h"
+#include "cld_async.h"
+#include "cld_stats.h"
+#include "cld_stats_ring.h"
+#include "cld_logs.h"
+#include "cld_logs_local.h"
+#include "cld_format.h"
 
 zclk_res ctr_ls_cmd_handler(zclk_command* cmd, void *handler_args)
 {
 
-	json_object *obj;
+	json_object *obj = NULL;
 	zclk_res err = execute_lua_command(&obj, "ctr", "ls", handler_args,
 		cmd->options, cmd->args, cmd->success_handler, cmd->error_handler);
 	if (obj != NULL)
 	{
 		docker_log_debug("Received json object -> %s\n", get_json_string(obj));
 	}
+
+	// with --format, the lua command returns the rows to render
+	char *format = zclk_option_get_val_string(get_option_by_name(cmd->options,
+		CLD_OPTION_LONG_FORMAT));
+	if (err == ZCLK_RES_SUCCESS && format != NULL && obj != NULL)
+	{
+		err = cld_format_output(cmd, format, obj);
+	}
+	json_object_put(obj);
 	return err;
 }
 
@@ -76,112 +91,276 @@ zclk_res ctr_create_cmd_handler(zclk_command* cmd, void *handler_args)
 	return ZCLK_RES_SUCCESS;
 }
 
-zclk_res ctr_start_cmd_handler(zclk_command* cmd, void *handler_args)
+/**
+ * A container lifecycle operation, which can be applied to many containers
+ * at once, see ctr_lifecycle_cmd_handler. path_fmt is the API path, with
+ * the (escaped) container id or name as argument.
+ */
+typedef struct ctr_lifecycle_op_t
 {
-	int quiet = 0;
-	docker_context *ctx = get_docker_context(handler_args);
-	size_t len = arraylist_length(cmd->args);
-	if (len != 1)
+	const char *method;
+	const char *path_fmt;
+	const char *done_fmt;
+	const char *fail_fmt;
+} ctr_lifecycle_op;
+
+static const ctr_lifecycle_op CTR_OP_START = {"POST", "/containers/%s/start",
+	"Started container %s", "Failed to start container %s: %s"};
+static const ctr_lifecycle_op CTR_OP_STOP = {"POST", "/containers/%s/stop",
+	"Stopped container %s", "Failed to stop container %s: %s"};
+static const ctr_lifecycle_op CTR_OP_RESTART = {"POST", "/containers/%s/restart",
+	"Restarted container %s", "Failed to restart container %s: %s"};
+static const ctr_lifecycle_op CTR_OP_KILL = {"POST", "/containers/%s/kill",
+	"Killed container %s", "Failed to kill container %s: %s"};
+static const ctr_lifecycle_op CTR_OP_PAUSE = {"POST", "/containers/%s/pause",
+	"Paused container %s", "Failed to pause container %s: %s"};
+static const ctr_lifecycle_op CTR_OP_UNPAUSE = {"POST", "/containers/%s/unpause",
+	"UnPaused container %s", "Failed to unpause container %s: %s"};
+static const ctr_lifecycle_op CTR_OP_REMOVE = {"DELETE", "/containers/%s",
+	"Removed container %s", "Failed to remove container %s: %s"};
+
+/**
+ * State of a lifecycle command run on the async engine, shared by all of
+ * its requests.
+ */
+typedef struct ctr_bulk_args_t
+{
+	zclk_command *cmd;
+	const ctr_lifecycle_op *op;
+	cld_async *async;
+	size_t submitted;
+	size_t failed;
+} ctr_bulk_args;
+
+/* Per request state, the container as given by the user. */
+typedef struct ctr_bulk_req_t
+{
+	ctr_bulk_args *bargs;
+	char *container;
+} ctr_bulk_req;
+
+static void ctr_bulk_done(cld_async_request *req, void *cbargs)
+{
+	ctr_bulk_req *breq = (ctr_bulk_req *)cbargs;
+	ctr_bulk_args *bargs = breq->bargs;
+	char res_str[1024];
+
+	// 304 means the container was already in the requested state.
+	if (cld_async_request_ok(req))
 	{
-		cmd->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING,
-					  "Container not provided.");
-		return ZCLK_RES_ERR_UNKNOWN;
+		snprintf(res_str, sizeof(res_str), bargs->op->done_fmt, breq->container);
+		bargs->cmd->success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_STRING, res_str);
 	}
 	else
 	{
-		zclk_argument *container_arg = 
-			(zclk_argument *)arraylist_get(cmd->args, 0);
-		char *container = zclk_argument_get_val_string(container_arg);
-		d_err_t e = docker_start_container(ctx, container, NULL);
-		if (e == E_SUCCESS)
-		{
-			char res_str[1024];
-			sprintf(res_str, "Started container %s", container);
-			cmd->success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_STRING, res_str);
-		}
+		snprintf(res_str, sizeof(res_str), bargs->op->fail_fmt, breq->container,
+			cld_async_request_message(req));
+		bargs->cmd->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING, res_str);
+		bargs->failed++;
 	}
-	return ZCLK_RES_SUCCESS;
+	free(breq->container);
+	free(breq);
 }
 
-zclk_res ctr_stop_cmd_handler(zclk_command* cmd, void *handler_args)
+static void ctr_bulk_submit(cld_async *async, ctr_bulk_args *bargs,
+	const char *container)
 {
-	int quiet = 0;
-	docker_context *ctx = get_docker_context(handler_args);
-	size_t len = arraylist_length(cmd->args);
-	if (len != 1)
+	char path[1024];
+	char *escaped = cld_async_escape(container);
+	ctr_bulk_req *breq = (ctr_bulk_req *)calloc(1, sizeof(ctr_bulk_req));
+	if (escaped == NULL || breq == NULL)
 	{
-		cmd->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING,
-					  "Container not provided.");
-		return ZCLK_RES_ERR_UNKNOWN;
+		free(escaped);
+		free(breq);
+		bargs->failed++;
+		return;
 	}
-	else
+	breq->bargs = bargs;
+	breq->container = str_clone(container);
+	snprintf(path, sizeof(path), bargs->op->path_fmt, escaped);
+	free(escaped);
+
+	if (cld_async_submit(async, bargs->op->method, path, NULL, NULL,
+			&ctr_bulk_done, breq) == NULL)
 	{
-		zclk_argument *container_arg = 
-				(zclk_argument *)arraylist_get(cmd->args, 0);
-		char *container = zclk_argument_get_val_string(container_arg);
-		d_err_t e = docker_stop_container(ctx, container, 0);
-		if (e == E_SUCCESS)
+		free(breq->container);
+		free(breq);
+		bargs->failed++;
+		return;
+	}
+	bargs->submitted++;
+}
+
+/* Submits the operation for every container of the --filter list. */
+static void ctr_bulk_filter_done(cld_async_request *req, void *cbargs)
+{
+	ctr_bulk_args *bargs = (ctr_bulk_args *)cbargs;
+	json_object *ctrs = cld_async_request_ok(req) ?
+		cld_async_request_json(req) : NULL;
+	if (ctrs == NULL || !json_object_is_type(ctrs, json_type_array))
+	{
+		char res_str[1024];
+		snprintf(res_str, sizeof(res_str), "Could not list containers: %s",
+			cld_async_request_message(req));
+		bargs->cmd->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING, res_str);
+		bargs->failed++;
+		json_object_put(ctrs);
+		return;
+	}
+
+	size_t num = json_object_array_length(ctrs);
+	for (size_t i = 0; i < num; i++)
+	{
+		json_object *id_obj;
+		if (json_object_object_get_ex(json_object_array_get_idx(ctrs, i),
+				"Id", &id_obj))
 		{
-			char res_str[1024];
-			sprintf(res_str, "Stopped container %s", container);
-			cmd->success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_STRING, res_str);
+			ctr_bulk_submit(bargs->async, bargs, json_object_get_string(id_obj));
 		}
 	}
-	return ZCLK_RES_SUCCESS;
+	json_object_put(ctrs);
 }
 
-zclk_res ctr_restart_cmd_handler(zclk_command* cmd, void *handler_args)
+/**
+ * Submit the container list request for the --filter option (a
+ * "key=value" docker container list filter), if given.
+ */
+static zclk_res ctr_bulk_submit_filter(cld_async *async, ctr_bulk_args *bargs)
 {
-	int quiet = 0;
-	docker_context *ctx = get_docker_context(handler_args);
-	size_t len = arraylist_length(cmd->args);
-	if (len != 1)
+	zclk_command *cmd = bargs->cmd;
+	zclk_option *filter_option = get_option_by_name(cmd->options,
+		CLD_OPTION_LONG_FILTER);
+	char *filter = zclk_option_get_val_string(filter_option);
+	if (filter == NULL)
+	{
+		return ZCLK_RES_SUCCESS;
+	}
+
+	char *filter_val = strchr(filter, '=');
+	if (filter_val == NULL)
 	{
 		cmd->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING,
-					  "Container not provided.");
+				"Filter must be of the form key=value.");
 		return ZCLK_RES_ERR_UNKNOWN;
 	}
-	else
+
+	json_object *filters = json_object_new_object();
+	json_object *vals = json_object_new_array();
+	char *filter_key = str_clone(filter);
+	filter_key[filter_val - filter] = '\0';
+	json_object_array_add(vals, json_object_new_string(filter_val + 1));
+	json_object_object_add(filters, filter_key, vals);
+	free(filter_key);
+
+	char *escaped = cld_async_escape(json_object_to_json_string(filters));
+	json_object_put(filters);
+	if (escaped == NULL)
 	{
-		zclk_argument *container_arg = 
-				(zclk_argument *)arraylist_get(cmd->args, 0);
-		char *container = zclk_argument_get_val_string(container_arg);
-		d_err_t e = docker_restart_container(ctx, container, 0);
-		if (e == E_SUCCESS)
-		{
-			char res_str[1024];
-			sprintf(res_str, "Restarted container %s", container);
-			cmd->success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_STRING, res_str);
-		}
+		return ZCLK_RES_ERR_ALLOC_FAILED;
 	}
-	return ZCLK_RES_SUCCESS;
+	size_t path_len = strlen(escaped) + 64;
+	char *path = (char *)malloc(path_len);
+	if (path == NULL)
+	{
+		free(escaped);
+		return ZCLK_RES_ERR_ALLOC_FAILED;
+	}
+	snprintf(path, path_len, "/containers/json?all=1&filters=%s", escaped);
+	free(escaped);
+
+	cld_async_request *req = cld_async_submit(async, "GET", path, NULL, NULL,
+		&ctr_bulk_filter_done, bargs);
+	free(path);
+	return req == NULL ? ZCLK_RES_ERR_ALLOC_FAILED : ZCLK_RES_SUCCESS;
 }
 
-zclk_res ctr_kill_cmd_handler(zclk_command* cmd, void *handler_args)
+/**
+ * Apply a lifecycle operation to every target container: all the
+ * container arguments and the containers matching --filter. Up to
+ * --parallel requests are in flight at once on a single event loop, and
+ * each result is reported as soon as it arrives.
+ */
+static zclk_res ctr_lifecycle_cmd_handler(zclk_command *cmd, void *handler_args,
+	const ctr_lifecycle_op *op)
 {
-	int quiet = 0;
 	docker_context *ctx = get_docker_context(handler_args);
+
+	zclk_option *parallel_option = get_option_by_name(cmd->options,
+		CLD_OPTION_LONG_PARALLEL);
+	int parallel = zclk_option_get_val_int(parallel_option);
+	if (parallel < 1)
+	{
+		parallel = 1;
+	}
+
+	cld_async *async;
+	zclk_res res = make_cld_async(&async, ctx, (size_t)parallel);
+	if (res != ZCLK_RES_SUCCESS)
+	{
+		return res;
+	}
+
+	ctr_bulk_args bargs;
+	bargs.cmd = cmd;
+	bargs.op = op;
+	bargs.async = async;
+	bargs.submitted = 0;
+	bargs.failed = 0;
+
 	size_t len = arraylist_length(cmd->args);
-	if (len != 1)
+	for (size_t i = 0; i < len; i++)
+	{
+		zclk_argument *container_arg =
+				(zclk_argument *)arraylist_get(cmd->args, i);
+		char *container = zclk_argument_get_val_string(container_arg);
+		if (container != NULL && container[0] != '\0')
+		{
+			ctr_bulk_submit(async, &bargs, container);
+		}
+	}
+
+	zclk_option *filter_option = get_option_by_name(cmd->options,
+		CLD_OPTION_LONG_FILTER);
+	if (bargs.submitted == 0 && zclk_option_get_val_string(filter_option) == NULL)
 	{
 		cmd->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING,
 					  "Container not provided.");
+		free_cld_async(async);
 		return ZCLK_RES_ERR_UNKNOWN;
 	}
-	else
+
+	res = ctr_bulk_submit_filter(async, &bargs);
+	if (res == ZCLK_RES_SUCCESS)
 	{
-		zclk_argument *container_arg = 
-				(zclk_argument *)arraylist_get(cmd->args, 0);
-		char *container = zclk_argument_get_val_string(container_arg);
-		d_err_t e = docker_kill_container(ctx, container, NULL);
-		if (e == E_SUCCESS)
-		{
-			char res_str[1024];
-			sprintf(res_str, "Killed container %s", container);
-			cmd->success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_STRING, res_str);
-		}
+		res = cld_async_run(async);
 	}
-	return ZCLK_RES_SUCCESS;
+	free_cld_async(async);
+
+	if (res == ZCLK_RES_SUCCESS && bargs.failed > 0)
+	{
+		res = ZCLK_RES_ERR_UNKNOWN;
+	}
+	return res;
+}
+
+zclk_res ctr_start_cmd_handler(zclk_command* cmd, void *handler_args)
+{
+	return ctr_lifecycle_cmd_handler(cmd, handler_args, &CTR_OP_START);
+}
+
+zclk_res ctr_stop_cmd_handler(zclk_command* cmd, void *handler_args)
+{
+	return ctr_lifecycle_cmd_handler(cmd, handler_args, &CTR_OP_STOP);
+}
+
+zclk_res ctr_restart_cmd_handler(zclk_command* cmd, void *handler_args)
+{
+	return ctr_lifecycle_cmd_handler(cmd, handler_args, &CTR_OP_RESTART);
+}
+
+zclk_res ctr_kill_cmd_handler(zclk_command* cmd, void *handler_args)
+{
+	return ctr_lifecycle_cmd_handler(cmd, handler_args, &CTR_OP_KILL);
 }
 
 zclk_res ctr_ren_cmd_handler(zclk_command* cmd, void *handler_args)
@@ -214,6 +393,16 @@ zclk_res ctr_ren_cmd_handler(zclk_command* cmd, void *handler_args)
 }
 
 zclk_res ctr_pause_cmd_handler(zclk_command* cmd, void *handler_args)
+{
+	return ctr_lifecycle_cmd_handler(cmd, handler_args, &CTR_OP_PAUSE);
+}
+
+zclk_res ctr_unpause_cmd_handler(zclk_command* cmd, void *handler_args)
+{
+	return ctr_lifecycle_cmd_handler(cmd, handler_args, &CTR_OP_UNPAUSE);
+}
+
+zclk_res ctr_wait_cmd_handler(zclk_command* cmd, void *handler_args)
 {
 	int quiet = 0;
 	docker_context *ctx = get_docker_context(handler_args);
@@ -229,109 +418,132 @@ zclk_res ctr_pause_cmd_handler(zclk_command* cmd, void *handler_args)
 		zclk_argument *container_arg =
 				(zclk_argument *)arraylist_get(cmd->args, 0);
 		char *container = zclk_argument_get_val_string(container_arg);
-		d_err_t e = docker_pause_container(ctx, container);
+		d_err_t e = docker_wait_container(ctx, container, NULL);
 		if (e == E_SUCCESS)
 		{
 			char res_str[1024];
-			sprintf(res_str, "Paused container %s", container);
+			sprintf(res_str, "Waiting for container %s", container);
 			cmd->success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_STRING, res_str);
 		}
 	}
 	return ZCLK_RES_SUCCESS;
 }
 
-zclk_res ctr_unpause_cmd_handler(zclk_command* cmd, void *handler_args)
+/**
+ * Get the non-empty container arguments as a new list of strings, the
+ * strings being owned by the arguments.
+ */
+static arraylist *ctr_arg_list(zclk_command *cmd)
 {
-	int quiet = 0;
-	docker_context *ctx = get_docker_context(handler_args);
-	size_t len = arraylist_length(cmd->args);
-	if (len != 1)
+	arraylist *containers;
+	if (arraylist_new(&containers, NULL) != 0)
 	{
-		cmd->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING,
-					  "Container not provided.");
-		return ZCLK_RES_ERR_UNKNOWN;
+		return NULL;
 	}
-	else
+
+	size_t len = arraylist_length(cmd->args);
+	for (size_t i = 0; i < len; i++)
 	{
 		zclk_argument *container_arg =
-				(zclk_argument *)arraylist_get(cmd->args, 0);
+				(zclk_argument *)arraylist_get(cmd->args, i);
 		char *container = zclk_argument_get_val_string(container_arg);
-		d_err_t e = docker_unpause_container(ctx, container);
-		if (e == E_SUCCESS)
+		if (container != NULL && container[0] != '\0')
 		{
-			char res_str[1024];
-			sprintf(res_str, "UnPaused container %s", container);
-			cmd->success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_STRING, res_str);
+			arraylist_add(containers, container);
 		}
 	}
-	return ZCLK_RES_SUCCESS;
+	return containers;
 }
 
-zclk_res ctr_wait_cmd_handler(zclk_command* cmd, void *handler_args)
+zclk_res ctr_logs_cmd_handler(zclk_command* cmd, void *handler_args)
 {
-	int quiet = 0;
 	docker_context *ctx = get_docker_context(handler_args);
-	size_t len = arraylist_length(cmd->args);
-	if (len != 1)
+	zclk_option *filter_option = get_option_by_name(cmd->options,
+		CLD_OPTION_LONG_FILTER);
+	char *filter = zclk_option_get_val_string(filter_option);
+	if (arraylist_length(cmd->args) == 0 && filter == NULL)
 	{
 		cmd->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING,
 					  "Container not provided.");
 		return ZCLK_RES_ERR_UNKNOWN;
 	}
-	else
+
+	cld_logs_opts opts;
+	cld_logs_opts_init(&opts);
+	zclk_option *follow_option = get_option_by_name(cmd->options,
+		CLD_OPTION_LONG_FOLLOW);
+	opts.follow = zclk_option_get_val_flag(follow_option);
+	zclk_option *timestamps_option = get_option_by_name(cmd->options,
+		CLD_OPTION_LONG_TIMESTAMPS);
+	opts.timestamps = zclk_option_get_val_flag(timestamps_option);
+
+	zclk_option *tail_option = get_option_by_name(cmd->options,
+		CLD_OPTION_LONG_TAIL);
+	char *tail = zclk_option_get_val_string(tail_option);
+	if (tail != NULL && !cld_logs_parse_tail(tail, &opts.tail))
 	{
-		zclk_argument *container_arg =
-				(zclk_argument *)arraylist_get(cmd->args, 0);
-		char *container = zclk_argument_get_val_string(container_arg);
-		d_err_t e = docker_wait_container(ctx, container, NULL);
-		if (e == E_SUCCESS)
-		{
-			char res_str[1024];
-			sprintf(res_str, "Waiting for container %s", container);
-			cmd->success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_STRING, res_str);
-		}
+		cmd->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING,
+				"Tail must be a number of lines or \"all\".");
+		return ZCLK_RES_ERR_UNKNOWN;
 	}
-	return ZCLK_RES_SUCCESS;
-}
-
-void cld_log_line_handler(void *args, int stream_id, int line_num, char *line)
-{
-	zclk_command_output_handler success_handler = (zclk_command_output_handler)args;
-	docker_log_info("Stream %d, line# %d :: %s", stream_id, line_num, line);
-	success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_STRING, line);
-}
 
-zclk_res ctr_logs_cmd_handler(zclk_command* cmd, void *handler_args)
-{
-	int quiet = 0;
-	docker_context *ctx = get_docker_context(handler_args);
-	size_t len = arraylist_length(cmd->args);
-	if (len != 1)
+	zclk_option *since_option = get_option_by_name(cmd->options,
+		CLD_OPTION_LONG_SINCE);
+	char *since = zclk_option_get_val_string(since_option);
+	zclk_option *until_option = get_option_by_name(cmd->options,
+		CLD_OPTION_LONG_UNTIL);
+	char *until = zclk_option_get_val_string(until_option);
+	if ((since != NULL && !cld_logs_parse_time(since, &opts.since_ns))
+		|| (until != NULL && !cld_logs_parse_time(until, &opts.until_ns)))
 	{
 		cmd->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING,
-					  "Container not provided.");
+				"Times must be unix timestamps, RFC3339 timestamps or durations (e.g. 10m).");
 		return ZCLK_RES_ERR_UNKNOWN;
 	}
-	else
+
+	zclk_option *grep_option = get_option_by_name(cmd->options,
+		CLD_OPTION_LONG_GREP);
+	opts.grep = zclk_option_get_val_string(grep_option);
+	zclk_option *grep_v_option = get_option_by_name(cmd->options,
+		CLD_OPTION_LONG_GREP_V);
+	opts.grep_v = zclk_option_get_val_string(grep_v_option);
+	zclk_option *json_field_option = get_option_by_name(cmd->options,
+		CLD_OPTION_LONG_JSON_FIELD);
+	opts.json_fields = zclk_option_get_val_string(json_field_option);
+	zclk_option *fields_option = get_option_by_name(cmd->options,
+		CLD_OPTION_LONG_FIELDS);
+	opts.fields = zclk_option_get_val_string(fields_option);
+
+	arraylist *containers = ctr_arg_list(cmd);
+	if (containers == NULL)
 	{
-		zclk_argument *container_arg =
-				(zclk_argument *)arraylist_get(cmd->args, 0);
-		char *container = zclk_argument_get_val_string(container_arg);
-		char *log;
-		size_t log_len;
-		d_err_t e = docker_container_logs(ctx, &log, &log_len, container, 0, 1, 1, -1, -1, 1,
-										  10);
-		if (e == E_SUCCESS)
+		return ZCLK_RES_ERR_ALLOC_FAILED;
+	}
+
+	zclk_option *local_option = get_option_by_name(cmd->options,
+		CLD_OPTION_LONG_LOCAL);
+	if (zclk_option_get_val_flag(local_option))
+	{
+		if (arraylist_length(containers) != 1 || filter != NULL)
 		{
-			char res_str[1024];
-			sprintf(res_str, "Logs for container %s", container);
-			cmd->success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_STRING, res_str);
-			// success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_STRING, log);
-			docker_container_logs_foreach(cmd->success_handler, 
-					log, log_len, &cld_log_line_handler);
+			arraylist_free(containers);
+			cmd->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING,
+					"Local logs are read for one container.");
+			return ZCLK_RES_ERR_UNKNOWN;
 		}
+		zclk_option *data_root_option = get_option_by_name(cmd->options,
+			CLD_OPTION_LONG_DATA_ROOT);
+		zclk_res res = cld_logs_local(
+			zclk_option_get_val_string(data_root_option),
+			(char *)arraylist_get(containers, 0), &opts, cmd->error_handler);
+		arraylist_free(containers);
+		return res;
 	}
-	return ZCLK_RES_SUCCESS;
+
+	zclk_res res = cld_logs_stream(ctx, containers, filter, &opts,
+		cmd->error_handler);
+	arraylist_free(containers);
+	return res;
 }
 
 zclk_res ctr_top_cmd_handler(zclk_command* cmd, void *handler_args)
@@ -393,104 +605,80 @@ zclk_res ctr_top_cmd_handler(zclk_command* cmd, void *handler_args)
 
 zclk_res ctr_remove_cmd_handler(zclk_command* cmd, void *handler_args)
 {
-	int quiet = 0;
+	return ctr_lifecycle_cmd_handler(cmd, handler_args, &CTR_OP_REMOVE);
+}
+
+zclk_res ctr_stats_cmd_handler(zclk_command* cmd, void *handler_args)
+{
 	docker_context *ctx = get_docker_context(handler_args);
-	size_t len = arraylist_length(cmd->args);
-	if (len != 1)
+
+	zclk_option *replay_option = get_option_by_name(cmd->options,
+		CLD_OPTION_LONG_REPLAY);
+	char *replay = zclk_option_get_val_string(replay_option);
+	if (replay != NULL)
 	{
-		cmd->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING,
-					  "Container not provided.");
-		return ZCLK_RES_ERR_UNKNOWN;
+		zclk_option *summary_option = get_option_by_name(cmd->options,
+			CLD_OPTION_LONG_SUMMARY);
+		return cld_stats_replay(replay, zclk_option_get_val_flag(summary_option),
+			cmd->success_handler, cmd->error_handler);
 	}
-	else
+
+	cld_stats_ring *record = NULL;
+	zclk_option *record_option = get_option_by_name(cmd->options,
+		CLD_OPTION_LONG_RECORD);
+	char *record_path = zclk_option_get_val_string(record_option);
+	if (record_path != NULL)
 	{
-		zclk_argument *container_arg =
-				(zclk_argument *)arraylist_get(cmd->args, 0);
-		char *container = zclk_argument_get_val_string(container_arg);
-		d_err_t e = docker_remove_container(ctx, container, 0, 0, 0);
-		if (e == E_SUCCESS)
+		zclk_option *capacity_option = get_option_by_name(cmd->options,
+			CLD_OPTION_LONG_RECORD_CAPACITY);
+		int capacity = zclk_option_get_val_int(capacity_option);
+		if (cld_stats_ring_open(&record, record_path,
+				capacity > 0 ? (uint64_t)capacity : 0, true) != ZCLK_RES_SUCCESS)
 		{
-			char res_str[1024];
-			sprintf(res_str, "Removed container %s", container);
-			cmd->success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_STRING, res_str);
+			cmd->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING,
+					"Could not open the stats recording file.");
+			return ZCLK_RES_ERR_UNKNOWN;
 		}
 	}
-	return ZCLK_RES_SUCCESS;
-}
-
-typedef struct stats_args_t
-{
-	char *id;
-	char *name;
-	zclk_command_output_handler success_handler;
-} stats_args;
 
-void docker_container_stats_cb(docker_container_stats *stats, void *cbargs)
-{
-	stats_args *sarg = (stats_args *)cbargs;
-	zclk_table *ctr_tbl;
-	if (create_zclk_table(&ctr_tbl, 1, 8) == 0)
-	{
-		zclk_table_set_header(ctr_tbl, 0, "CONTAINER ID");
-		zclk_table_set_header(ctr_tbl, 1, "NAME");
-		zclk_table_set_header(ctr_tbl, 2, "CPU %");
-		zclk_table_set_header(ctr_tbl, 3, "MEM USAGE / LIMIT");
-		zclk_table_set_header(ctr_tbl, 4, "MEM %");
-		zclk_table_set_header(ctr_tbl, 5, "NET I/O");
-		zclk_table_set_header(ctr_tbl, 6, "BLOCK I/O");
-		zclk_table_set_header(ctr_tbl, 7, "PIDS");
-
-		zclk_table_set_row_val(ctr_tbl, 0, 0, sarg->id);
-		zclk_table_set_row_val(ctr_tbl, 0, 1, sarg->name);
-
-		char cpu_usg_str[128];
-		sprintf(cpu_usg_str, "%ld", docker_container_cpu_stats_cpu_usage_get(docker_container_stats_cpu_stats_get(stats)));
-		zclk_table_set_row_val(ctr_tbl, 0, 2, cpu_usg_str);
-
-		char mem_usg_str[128];
-		sprintf(mem_usg_str, "%ld", docker_container_mem_stats_usage_get(docker_container_stats_mem_stats_get(stats)));
-		zclk_table_set_row_val(ctr_tbl, 0, 3, mem_usg_str);
-
-		zclk_table_set_row_val(ctr_tbl, 0, 4, "");
-		zclk_table_set_row_val(ctr_tbl, 0, 5, "");
-		zclk_table_set_row_val(ctr_tbl, 0, 6, "");
-		zclk_table_set_row_val(ctr_tbl, 0, 7, "");
-	}
-	sarg->success_handler(ZCLK_RES_IS_RUNNING, ZCLK_RESULT_STRING,
-						  "\033[0;0H\033[2J");
-	sarg->success_handler(ZCLK_RES_IS_RUNNING, ZCLK_RESULT_TABLE, ctr_tbl);
-}
+	arraylist *containers = ctr_arg_list(cmd);
+	if (containers == NULL)
+	{
+		cld_stats_ring_close(record);
+		return ZCLK_RES_ERR_ALLOC_FAILED;
+	}
 
-zclk_res ctr_stats_cmd_handler(zclk_command* cmd, void *handler_args)
-{
-	int quiet = 0;
-	docker_context *ctx = get_docker_context(handler_args);
-	size_t len = arraylist_length(cmd->args);
-	if (len != 1)
+	zclk_res res;
+	zclk_option *no_stream_option = get_option_by_name(cmd->options,
+		CLD_OPTION_LONG_NO_STREAM);
+	if (zclk_option_get_val_flag(no_stream_option))
 	{
-		cmd->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING,
-					  "Container not provided.");
-		return ZCLK_RES_ERR_UNKNOWN;
+		zclk_option *json_option = get_option_by_name(cmd->options,
+			CLD_OPTION_LONG_JSON);
+		res = cld_stats_snapshot(ctx, containers,
+			zclk_option_get_val_flag(json_option), record,
+			cmd->success_handler, cmd->error_handler);
 	}
 	else
 	{
-		zclk_argument *container_arg =
-				(zclk_argument *)arraylist_get(cmd->args, 0);
-		char *container = zclk_argument_get_val_string(container_arg);
-		stats_args *sarg = (stats_args *)calloc(1, sizeof(stats_args));
-		sarg->id = container;
-		sarg->name = container;
-		sarg->success_handler = cmd->success_handler;
-		d_err_t e = docker_container_get_stats_cb(ctx, &docker_container_stats_cb,
-												  sarg, container);
-		if (e == E_SUCCESS)
-		{
-			char res_str[1024];
-			sprintf(res_str, "done %s", container);
-			cmd->success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_STRING, res_str);
-		}
+		res = cld_stats_stream(ctx, containers, record, cmd->success_handler,
+			cmd->error_handler);
 	}
-	return ZCLK_RES_SUCCESS;
+	arraylist_free(containers);
+	cld_stats_ring_close(record);
+	return res;
+}
+
+static void ctr_lifecycle_command_options(zclk_command *ctr_command,
+	const char *arg_desc)
+{
+	zclk_command_string_argument(ctr_command, "Container", NULL, arg_desc, -1);
+	zclk_command_string_option(ctr_command, CLD_OPTION_LONG_FILTER,
+		CLD_OPTION_SHORT_FILTER, NULL,
+		"Also apply to containers matching the filter (key=value)");
+	zclk_command_int_option(ctr_command, CLD_OPTION_LONG_PARALLEL,
+		CLD_OPTION_SHORT_PARALLEL, CLD_DEFAULT_PARALLEL,
+		"Number of containers to process concurrently");
 }
 
 zclk_command *ctr_commands()
@@ -505,7 +693,7 @@ zclk_command *ctr_commands()
 		{
 			zclk_command_flag_option(ctr_command, "all", "a", "Show all containers (by default shows only running ones).");
 			zclk_command_string_option(ctr_command, "filter", "f", NULL, "Filter output based on conditions provided");
-			zclk_command_string_option(ctr_command, "format", NULL, NULL, "Pretty-print containers using a Go template");
+			zclk_command_string_option(ctr_command, CLD_OPTION_LONG_FORMAT, NULL, NULL, "Pretty-print containers using a template (e.g. \"{{.ID}}\\t{{.Names}}\")");
 			zclk_command_int_option(ctr_command, "last", "n", 10, "Show n last created containers (includes all states)");
 			zclk_command_flag_option(ctr_command, "latest", "l", "Show the latest created container (includes all states)");
 			zclk_command_flag_option(ctr_command, "no-trunc", NULL, "Don't truncate output");
@@ -527,8 +715,8 @@ zclk_command *ctr_commands()
 									 "Docker Container Start", &ctr_start_cmd_handler);
 		if(ctr_command != NULL)
 		{
-			zclk_command_string_argument(ctr_command, "Container", NULL,
-										"Name of container to start.", 1);;
+			ctr_lifecycle_command_options(ctr_command,
+										"Names or IDs of containers to start.");
 			zclk_command_subcommand_add(container_command, ctr_command);
 		}
 
@@ -536,8 +724,8 @@ zclk_command *ctr_commands()
 									 "Docker Container Stop", &ctr_stop_cmd_handler);
 		if(ctr_command != NULL)
 		{
-			zclk_command_string_argument(ctr_command, "Container", NULL,
-										"Name of container to stop.", 1);;
+			ctr_lifecycle_command_options(ctr_command,
+										"Names or IDs of containers to stop.");
 			zclk_command_subcommand_add(container_command, ctr_command);
 		}
 
@@ -545,8 +733,8 @@ zclk_command *ctr_commands()
 									 "Docker Container Restart", &ctr_restart_cmd_handler);
 		if(ctr_command != NULL)
 		{
-			zclk_command_string_argument(ctr_command, "Container", NULL,
-										"Name of container to restart.", 1);;
+			ctr_lifecycle_command_options(ctr_command,
+										"Names or IDs of containers to restart.");
 			zclk_command_subcommand_add(container_command, ctr_command);
 		}
 
@@ -554,8 +742,8 @@ zclk_command *ctr_commands()
 									 "Docker Container Kill", &ctr_kill_cmd_handler);
 		if(ctr_command != NULL)
 		{
-			zclk_command_string_argument(ctr_command, "Container", NULL,
-										"Name of container to kill.", 1);;
+			ctr_lifecycle_command_options(ctr_command,
+										"Names or IDs of containers to kill.");
 			zclk_command_subcommand_add(container_command, ctr_command);
 		}
 
@@ -574,8 +762,8 @@ zclk_command *ctr_commands()
 									 "Docker Container Pause", &ctr_pause_cmd_handler);
 		if(ctr_command != NULL)
 		{
-			zclk_command_string_argument(ctr_command, "Container", NULL,
-										"Name of container to pause.", 1);;
+			ctr_lifecycle_command_options(ctr_command,
+										"Names or IDs of containers to pause.");
 			zclk_command_subcommand_add(container_command, ctr_command);
 		}
 
@@ -583,8 +771,8 @@ zclk_command *ctr_commands()
 									 "Docker Container UnPause", &ctr_unpause_cmd_handler);
 		if(ctr_command != NULL)
 		{
-			zclk_command_string_argument(ctr_command, "Container", NULL,
-										"Name of container to unpause.", 1);;
+			ctr_lifecycle_command_options(ctr_command,
+										"Names or IDs of containers to unpause.");
 			zclk_command_subcommand_add(container_command, ctr_command);
 		}
 
@@ -602,7 +790,32 @@ zclk_command *ctr_commands()
 		if(ctr_command != NULL)
 		{
 			zclk_command_string_argument(ctr_command, "Container", NULL,
-										"Name of container.", 1);;
+										"Names of containers, merged by time if several.", -1);
+			zclk_command_string_option(ctr_command, CLD_OPTION_LONG_FILTER, NULL, NULL,
+									"Also show containers matching the filter (e.g. label=app=web)");
+			zclk_command_flag_option(ctr_command, CLD_OPTION_LONG_FOLLOW,
+									CLD_OPTION_SHORT_FOLLOW, "Follow log output");
+			zclk_command_string_option(ctr_command, CLD_OPTION_LONG_TAIL,
+									CLD_OPTION_SHORT_TAIL, NULL,
+									"Number of lines to show from the end of the logs (default \"all\")");
+			zclk_command_string_option(ctr_command, CLD_OPTION_LONG_SINCE, NULL, NULL,
+									"Show logs since timestamp (e.g. 2013-01-02T13:23:37Z) or relative (e.g. 42m)");
+			zclk_command_string_option(ctr_command, CLD_OPTION_LONG_UNTIL, NULL, NULL,
+									"Show logs before timestamp (e.g. 2013-01-02T13:23:37Z) or relative (e.g. 42m)");
+			zclk_command_flag_option(ctr_command, CLD_OPTION_LONG_TIMESTAMPS,
+									CLD_OPTION_SHORT_TIMESTAMPS, "Show timestamps");
+			zclk_command_string_option(ctr_command, CLD_OPTION_LONG_GREP, NULL, NULL,
+									"Only show lines containing this text");
+			zclk_command_string_option(ctr_command, CLD_OPTION_LONG_GREP_V, NULL, NULL,
+									"Only show lines not containing this text");
+			zclk_command_string_option(ctr_command, CLD_OPTION_LONG_JSON_FIELD, NULL, NULL,
+									"Only show JSON lines with these fields (key=value,...)");
+			zclk_command_string_option(ctr_command, CLD_OPTION_LONG_FIELDS, NULL, NULL,
+									"Only show these fields of JSON lines (key,...)");
+			zclk_command_flag_option(ctr_command, CLD_OPTION_LONG_LOCAL, NULL,
+									"Read the log file of the json-file driver directly");
+			zclk_command_string_option(ctr_command, CLD_OPTION_LONG_DATA_ROOT, NULL,
+									CLD_LOGS_DATA_ROOT, "Docker data root, for --local");
 			zclk_command_subcommand_add(container_command, ctr_command);
 		}
 
@@ -619,8 +832,8 @@ zclk_command *ctr_commands()
 									 "Docker Remove Container", &ctr_remove_cmd_handler);
 		if(ctr_command != NULL)
 		{
-			zclk_command_string_argument(ctr_command, "Container", NULL,
-										"Name of container.", 1);;
+			ctr_lifecycle_command_options(ctr_command,
+										"Names or IDs of containers to remove.");
 			zclk_command_subcommand_add(container_command, ctr_command);
 		}
 
@@ -629,7 +842,20 @@ zclk_command *ctr_commands()
 		if(ctr_command != NULL)
 		{
 			zclk_command_string_argument(ctr_command, "Container", NULL,
-										"Name of container.", 1);;
+										"Names of containers (all running containers if none).", -1);
+			zclk_command_flag_option(ctr_command, CLD_OPTION_LONG_NO_STREAM, NULL,
+									"Print one sample of every container and exit");
+			zclk_command_flag_option(ctr_command, CLD_OPTION_LONG_JSON, NULL,
+									"Print the samples as json (with --no-stream)");
+			zclk_command_string_option(ctr_command, CLD_OPTION_LONG_RECORD, NULL, NULL,
+									"Also append the samples to this recording file");
+			zclk_command_int_option(ctr_command, CLD_OPTION_LONG_RECORD_CAPACITY, NULL,
+									CLD_STATS_RING_DEFAULT_CAPACITY,
+									"Number of samples kept when creating a recording file");
+			zclk_command_string_option(ctr_command, CLD_OPTION_LONG_REPLAY, NULL, NULL,
+									"Print the samples of a recording file");
+			zclk_command_flag_option(ctr_command, CLD_OPTION_LONG_SUMMARY, NULL,
+									"Summarize the recording per container (with --replay)");
 			zclk_command_subcommand_add(container_command, ctr_command);
 		}
 	}
@@ -29,6 +29,35 @@
 #define CLD_OPTION_LONG_LS_ALL "all"
 #define CLD_OPTION_SHORT_LS_ALL "a"
 
+#define CLD_OPTION_LONG_FILTER "filter"
+#define CLD_OPTION_SHORT_FILTER "f"
+
+#define CLD_OPTION_LONG_PARALLEL "parallel"
+#define CLD_OPTION_SHORT_PARALLEL "p"
+#define CLD_DEFAULT_PARALLEL 8
+
+#define CLD_OPTION_LONG_NO_STREAM "no-stream"
+#define CLD_OPTION_LONG_JSON "json"
+#define CLD_OPTION_LONG_RECORD "record"
+#define CLD_OPTION_LONG_RECORD_CAPACITY "record-capacity"
+#define CLD_OPTION_LONG_REPLAY "replay"
+#define CLD_OPTION_LONG_SUMMARY "summary"
+
+#define CLD_OPTION_LONG_FOLLOW "follow"
+#define CLD_OPTION_SHORT_FOLLOW "f"
+#define CLD_OPTION_LONG_TAIL "tail"
+#define CLD_OPTION_SHORT_TAIL "n"
+#define CLD_OPTION_LONG_SINCE "since"
+#define CLD_OPTION_LONG_UNTIL "until"
+#define CLD_OPTION_LONG_TIMESTAMPS "timestamps"
+#define CLD_OPTION_SHORT_TIMESTAMPS "t"
+#define CLD_OPTION_LONG_GREP "grep"
+#define CLD_OPTION_LONG_GREP_V "grep-v"
+#define CLD_OPTION_LONG_JSON_FIELD "json-field"
+#define CLD_OPTION_LONG_FIELDS "fields"
+#define CLD_OPTION_LONG_LOCAL "local"
+#define CLD_OPTION_LONG_DATA_ROOT "data-root"
+
 zclk_command *ctr_commands();
 
 #endif
\ No newline at end of file
@@ -0,0 +1,487 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <json-c/json.h>
+#include "docker_all.h"
+#include "cld_format.h"
+#include "mustach.h"
+#include "mustach-json-c.h"
+
+#define FORMAT_TEXT 0
+#define FORMAT_FIELD 1
+#define FORMAT_JSON 2
+
+typedef struct format_op_t
+{
+    int op;
+    /* text to copy, or the field path to look up (0 segments for {{.}}) */
+    char *text;
+    size_t text_len;
+    char **path;
+    size_t path_len;
+} format_op;
+
+struct cld_format_t
+{
+    /* set when the template is rendered with mustach */
+    struct mustach_json_c_template *template;
+    format_op *ops;
+    size_t ops_len;
+};
+
+typedef struct format_buf_t
+{
+    char *data;
+    size_t len;
+    size_t cap;
+    bool failed;
+} format_buf;
+
+static void buf_append(format_buf *buf, const char *data, size_t len)
+{
+    if (buf->failed)
+    {
+        return;
+    }
+    if (buf->len + len + 1 > buf->cap)
+    {
+        size_t cap = buf->cap == 0 ? 1024 : buf->cap;
+        while (buf->len + len + 1 > cap)
+        {
+            cap *= 2;
+        }
+        char *data_new = (char *)realloc(buf->data, cap);
+        if (data_new == NULL)
+        {
+            buf->failed = true;
+            return;
+        }
+        buf->data = data_new;
+        buf->cap = cap;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+}
+
+static int buf_write(void *closure, const char *buffer, size_t size)
+{
+    buf_append((format_buf *)closure, buffer, size);
+    return ((format_buf *)closure)->failed ? -1 : 0;
+}
+
+static format_op *add_op(cld_format *fmt, int op)
+{
+    format_op *ops = (format_op *)realloc(fmt->ops,
+                                          (fmt->ops_len + 1) * sizeof(format_op));
+    if (ops == NULL)
+    {
+        return NULL;
+    }
+    fmt->ops = ops;
+    format_op *added = &ops[fmt->ops_len++];
+    memset(added, 0, sizeof(format_op));
+    added->op = op;
+    return added;
+}
+
+/* Add the text of len chars at text, with \t and \n unescaped. */
+static bool add_text(cld_format *fmt, const char *text, size_t len)
+{
+    if (len == 0)
+    {
+        return true;
+    }
+    format_op *op = add_op(fmt, FORMAT_TEXT);
+    if (op == NULL || (op->text = (char *)malloc(len + 1)) == NULL)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        char c = text[i];
+        if (c == '\\' && i + 1 < len && (text[i + 1] == 't' || text[i + 1] == 'n'))
+        {
+            c = text[++i] == 't' ? '\t' : '\n';
+        }
+        op->text[op->text_len++] = c;
+    }
+    return true;
+}
+
+/*
+ * Add the field tag of len chars at tag (between the braces), returns
+ * false if it is not a field tag.
+ */
+static bool add_field(cld_format *fmt, const char *tag, size_t len,
+                      bool *alloc_failed)
+{
+    int kind = FORMAT_FIELD;
+    while (len > 0 && *tag == ' ')
+    {
+        tag++;
+        len--;
+    }
+    while (len > 0 && tag[len - 1] == ' ')
+    {
+        len--;
+    }
+    if (len > 5 && strncmp(tag, "json ", 5) == 0)
+    {
+        kind = FORMAT_JSON;
+        tag += 5;
+        len -= 5;
+        while (len > 0 && *tag == ' ')
+        {
+            tag++;
+            len--;
+        }
+    }
+    if (len == 0 || tag[0] != '.' || memchr(tag, ' ', len) != NULL)
+    {
+        return false;
+    }
+
+    format_op *op = add_op(fmt, kind);
+    /* the segments are kept in one copy of the tag, split at the dots */
+    if (op == NULL || (op->text = (char *)malloc(len)) == NULL)
+    {
+        *alloc_failed = true;
+        return false;
+    }
+    memcpy(op->text, tag + 1, len - 1);
+    op->text[len - 1] = '\0';
+    op->text_len = len - 1;
+    if (op->text_len == 0)
+    {
+        return true;
+    }
+    size_t segments = 1;
+    for (size_t i = 0; i < op->text_len; i++)
+    {
+        segments += op->text[i] == '.';
+    }
+    if ((op->path = (char **)malloc(segments * sizeof(char *))) == NULL)
+    {
+        *alloc_failed = true;
+        return false;
+    }
+    char *seg = op->text;
+    while (seg != NULL)
+    {
+        char *dot = strchr(seg, '.');
+        if (dot != NULL)
+        {
+            *dot = '\0';
+        }
+        if (*seg == '\0')
+        {
+            return false;
+        }
+        op->path[op->path_len++] = seg;
+        seg = dot == NULL ? NULL : dot + 1;
+    }
+    return true;
+}
+
+static void free_ops(cld_format *fmt)
+{
+    for (size_t i = 0; i < fmt->ops_len; i++)
+    {
+        free(fmt->ops[i].text);
+        free(fmt->ops[i].path);
+    }
+    free(fmt->ops);
+    fmt->ops = NULL;
+    fmt->ops_len = 0;
+}
+
+/*
+ * Copy of a template for mustach, with the leading dot of the names of
+ * docker style tags removed, so that {{.Name}} renders as {{Name}} and
+ * {{#.Ports}} as {{#Ports}}; {{.}} stays the current object. Tags after a
+ * {{=...=}} delimiter change are copied as they are. Sets *json_tag if the
+ * template has a {{json .Field}} tag, which mustach cannot render.
+ */
+static char *mustach_template(const char *template, bool *json_tag)
+{
+    char *out = (char *)malloc(strlen(template) + 1);
+    if (out == NULL)
+    {
+        return NULL;
+    }
+    size_t n = 0;
+    const char *p = template;
+    while (*p != '\0')
+    {
+        const char *open = strstr(p, "{{");
+        const char *close = open == NULL ? NULL : strstr(open + 2, "}}");
+        if (close == NULL)
+        {
+            break;
+        }
+        const char *name = open + 2;
+        while (name < close && strchr(" #^/&{", *name) != NULL)
+        {
+            name++;
+        }
+        if (name < close && *name == '=')
+        {
+            break;
+        }
+        if (close - name > 5 && strncmp(name, "json ", 5) == 0)
+        {
+            *json_tag = true;
+        }
+        memcpy(out + n, p, (size_t)(name - p));
+        n += (size_t)(name - p);
+        if (name + 1 < close && name[0] == '.' && name[1] != ' ')
+        {
+            name++;
+        }
+        memcpy(out + n, name, (size_t)(close + 2 - name));
+        n += (size_t)(close + 2 - name);
+        p = close + 2;
+    }
+    strcpy(out + n, p);
+    return out;
+}
+
+/* The directory of the partials, NULL if unknown. */
+static char *templates_dir()
+{
+    const char *env_dir = getenv(CLD_FORMAT_TEMPLATES_ENV);
+    if (env_dir != NULL && env_dir[0] != '\0')
+    {
+        return strdup(env_dir);
+    }
+#ifdef _WIN32
+    const char *home = getenv("USERPROFILE");
+#else
+    const char *home = getenv("HOME");
+#endif
+    if (home == NULL || home[0] == '\0')
+    {
+        return NULL;
+    }
+    size_t len = strlen(home) + strlen(CLD_FORMAT_TEMPLATES_DIR) + 2;
+    char *dir = (char *)malloc(len);
+    if (dir != NULL)
+    {
+        snprintf(dir, len, "%s/%s", home, CLD_FORMAT_TEMPLATES_DIR);
+    }
+    return dir;
+}
+
+zclk_res cld_format_compile(cld_format **fmt, const char *template)
+{
+    cld_format *compiled = (cld_format *)calloc(1, sizeof(cld_format));
+    if (compiled == NULL)
+    {
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+
+    bool alloc_failed = false;
+    bool fallback = false;
+    const char *p = template;
+    while (*p != '\0')
+    {
+        const char *open = strstr(p, "{{");
+        size_t text_len = open == NULL ? strlen(p) : (size_t)(open - p);
+        if (!add_text(compiled, p, text_len))
+        {
+            alloc_failed = true;
+            break;
+        }
+        if (open == NULL)
+        {
+            break;
+        }
+        const char *close = strstr(open + 2, "}}");
+        if (close == NULL
+            || !add_field(compiled, open + 2, close - open - 2, &alloc_failed))
+        {
+            fallback = !alloc_failed;
+            break;
+        }
+        p = close + 2;
+    }
+
+    if (fallback)
+    {
+        free_ops(compiled);
+        bool json_tag = false;
+        char *mustach = mustach_template(template, &json_tag);
+        if (mustach == NULL)
+        {
+            cld_format_free(compiled);
+            return ZCLK_RES_ERR_ALLOC_FAILED;
+        }
+        if (json_tag)
+        {
+            docker_log_error("Invalid format template: {{json}} cannot be "
+                             "used with mustache tags.\n");
+            free(mustach);
+            cld_format_free(compiled);
+            return ZCLK_RES_ERR_UNKNOWN;
+        }
+        int rc = mustach_json_c_compile(mustach, &compiled->template);
+        free(mustach);
+        if (rc < 0)
+        {
+            docker_log_error("Invalid format template (mustach error %d).\n", rc);
+            cld_format_free(compiled);
+            return rc == MUSTACH_ERROR_SYSTEM ? ZCLK_RES_ERR_ALLOC_FAILED
+                                              : ZCLK_RES_ERR_UNKNOWN;
+        }
+        char *dir = templates_dir();
+        if (dir != NULL)
+        {
+            alloc_failed = mustach_json_c_template_partial_dir(
+                               compiled->template, dir) < 0;
+            free(dir);
+        }
+    }
+    if (alloc_failed)
+    {
+        cld_format_free(compiled);
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+    *fmt = compiled;
+    return ZCLK_RES_SUCCESS;
+}
+
+void cld_format_free(cld_format *fmt)
+{
+    if (fmt != NULL)
+    {
+        free_ops(fmt);
+        mustach_json_c_template_free(fmt->template);
+        free(fmt);
+    }
+}
+
+static void render_value(format_buf *buf, json_object *val, int kind)
+{
+    if (kind == FORMAT_FIELD && json_object_is_type(val, json_type_string))
+    {
+        buf_append(buf, json_object_get_string(val),
+                   (size_t)json_object_get_string_len(val));
+    }
+    else if (kind == FORMAT_JSON || val != NULL)
+    {
+        const char *str = json_object_to_json_string_ext(val,
+                                                         JSON_C_TO_STRING_PLAIN);
+        buf_append(buf, str, strlen(str));
+    }
+}
+
+static zclk_res render_row(cld_format *fmt, json_object *row, format_buf *buf)
+{
+    if (fmt->template != NULL)
+    {
+        if (umustach_json_c_exec(fmt->template, row, &buf_write, buf) < 0)
+        {
+            return buf->failed ? ZCLK_RES_ERR_ALLOC_FAILED : ZCLK_RES_ERR_UNKNOWN;
+        }
+        return ZCLK_RES_SUCCESS;
+    }
+    for (size_t i = 0; i < fmt->ops_len; i++)
+    {
+        format_op *op = &fmt->ops[i];
+        if (op->op == FORMAT_TEXT)
+        {
+            buf_append(buf, op->text, op->text_len);
+            continue;
+        }
+        json_object *val = row;
+        for (size_t j = 0; j < op->path_len && val != NULL; j++)
+        {
+            if (!json_object_object_get_ex(val, op->path[j], &val))
+            {
+                val = NULL;
+            }
+        }
+        render_value(buf, val, op->op);
+    }
+    return buf->failed ? ZCLK_RES_ERR_ALLOC_FAILED : ZCLK_RES_SUCCESS;
+}
+
+zclk_res cld_format_render(cld_format *fmt, json_object *rows, char **out)
+{
+    format_buf buf = {0};
+    zclk_res res = ZCLK_RES_SUCCESS;
+    bool is_array = json_object_is_type(rows, json_type_array);
+    size_t len = is_array ? json_object_array_length(rows) : 1;
+    for (size_t i = 0; i < len && res == ZCLK_RES_SUCCESS; i++)
+    {
+        if (i > 0)
+        {
+            buf_append(&buf, "\n", 1);
+        }
+        res = render_row(fmt, is_array ? json_object_array_get_idx(rows, i)
+                                       : rows, &buf);
+    }
+    if (res == ZCLK_RES_SUCCESS && buf.failed)
+    {
+        res = ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+    if (res != ZCLK_RES_SUCCESS)
+    {
+        free(buf.data);
+        return res;
+    }
+    *out = buf.data != NULL ? buf.data : (char *)calloc(1, 1);
+    return *out == NULL ? ZCLK_RES_ERR_ALLOC_FAILED : ZCLK_RES_SUCCESS;
+}
+
+void cld_format_row_add(json_object *row, const char *key, const char *val)
+{
+    json_object_object_add(row, key,
+                           val == NULL ? NULL : json_object_new_string(val));
+}
+
+zclk_res cld_format_output(zclk_command *cmd, const char *template,
+                           json_object *rows)
+{
+    cld_format *fmt;
+    char *out = NULL;
+    zclk_res res = cld_format_compile(&fmt, template);
+    if (res == ZCLK_RES_SUCCESS)
+    {
+        res = cld_format_render(fmt, rows, &out);
+        cld_format_free(fmt);
+    }
+    if (res != ZCLK_RES_SUCCESS)
+    {
+        cmd->error_handler(res, ZCLK_RESULT_STRING,
+                           "Error: could not render the format template.");
+        return res;
+    }
+    cmd->success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_STRING, out);
+    free(out);
+    return ZCLK_RES_SUCCESS;
+}
@@ -0,0 +1,79 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SRC_CLD_FORMAT_H_
+#define SRC_CLD_FORMAT_H_
+
+#include <json-c/json_object.h>
+#include "cld_common.h"
+
+#define CLD_OPTION_LONG_FORMAT "format"
+
+/**
+ * Directory of the partials of templates, {{> name}} reads name.mustache
+ * from it (after the current directory). The default is .cld/templates in
+ * the home directory.
+ */
+#define CLD_FORMAT_TEMPLATES_ENV "CLD_TEMPLATES"
+#define CLD_FORMAT_TEMPLATES_DIR ".cld/templates"
+
+/**
+ * A --format template for list commands, compiled once and rendered for
+ * every row of the list.
+ *
+ * Templates in the docker style, with tags {{.Field}}, {{.Field.Sub}},
+ * {{.}} and {{json .Field}}, are compiled to a list of instructions: text
+ * to copy, or a field path (split at compile time) to look up in the row.
+ * "\t" and "\n" in the text stand for a tab and a newline, as for docker.
+ * Any other template (e.g. with mustache sections or partials) is compiled
+ * with mustach and rendered for every row, its partials read only once.
+ * Docker style tags can be mixed with mustache tags: the leading dot of
+ * their names is removed, so {{.Name}} is rendered as {{Name}}. {{json}}
+ * tags cannot be mixed with mustache tags, such a template is rejected.
+ */
+typedef struct cld_format_t cld_format;
+
+/** Compile a template. */
+zclk_res cld_format_compile(cld_format **fmt, const char *template);
+
+void cld_format_free(cld_format *fmt);
+
+/**
+ * Render the template for every row of an array of objects (or for a
+ * single object), one line per row, to a new string in out (without the
+ * newline of the last line).
+ */
+zclk_res cld_format_render(cld_format *fmt, json_object *rows, char **out);
+
+/** Add a string field to a row object, null if val is NULL. */
+void cld_format_row_add(json_object *row, const char *key, const char *val);
+
+/**
+ * Compile the template of the format option of cmd, render it for rows and
+ * output the result with the success handler of cmd. Errors are reported
+ * with the error handler.
+ */
+zclk_res cld_format_output(zclk_command *cmd, const char *template,
+                           json_object *rows);
+
+#endif /* SRC_CLD_FORMAT_H_ */
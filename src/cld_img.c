@@ -32,7 +32,7 @@
 #include "zclk_progress.h"
 #include <zclk.h>
 
-#include "mustach-json-c.h"
+#include "cld_format.h"
 
 typedef struct
 {
@@ -45,7 +45,15 @@ void log_pull_message(docker_image_create_status *status, void *client_cbargs)
 	docker_image_update_args *upd_args = (docker_image_update_args *)client_cbargs;
 	if (status)
 	{
-		if (status->id)
+		// the progress display is only created for pulls reporting layers.
+		if (status->id && upd_args->multi_progress == NULL)
+		{
+			if (create_zclk_multi_progress(&(upd_args->multi_progress)) != 0)
+			{
+				upd_args->multi_progress = NULL;
+			}
+		}
+		if (status->id && upd_args->multi_progress != NULL)
 		{
 			size_t len = arraylist_length(upd_args->multi_progress->progress_ls);
 			size_t new_len = len;
@@ -125,14 +133,15 @@ zclk_res img_pl_cmd_handler(zclk_command* cmd, void *handler_args)
 		return ZCLK_RES_ERR_ALLOC_FAILED;
 	}
 	upd_args->success_handler = cmd->success_handler;
-	create_zclk_multi_progress(&(upd_args->multi_progress));
+	upd_args->multi_progress = NULL;
 
+	zclk_res res = ZCLK_RES_SUCCESS;
 	size_t len = arraylist_length(cmd->args);
 	if (len != 1)
 	{
 		cmd->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING,
 					  "Image name not provided.");
-		return ZCLK_RES_ERR_UNKNOWN;
+		res = ZCLK_RES_ERR_UNKNOWN;
 	}
 	else
 	{
@@ -146,19 +155,26 @@ zclk_res img_pl_cmd_handler(zclk_command* cmd, void *handler_args)
 			char *res_str = (char *)calloc(strlen(image_name) + 100, sizeof(char));
 			if (res_str == NULL)
 			{
-				return ZCLK_RES_ERR_ALLOC_FAILED;
+				res = ZCLK_RES_ERR_ALLOC_FAILED;
+			}
+			else
+			{
+				sprintf(res_str, "Image pull successful -> %s", image_name);
+				cmd->success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_STRING, res_str);
+				free(res_str);
 			}
-			sprintf(res_str, "Image pull successful -> %s", image_name);
-			cmd->success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_STRING, res_str);
-			free(res_str);
-			return ZCLK_RES_SUCCESS;
 		}
 		else
 		{
-			return ZCLK_RES_ERR_UNKNOWN;
+			res = ZCLK_RES_ERR_UNKNOWN;
 		}
 	}
-	free_zclk_multi_progress(upd_args->multi_progress);
+	if (upd_args->multi_progress != NULL)
+	{
+		free_zclk_multi_progress(upd_args->multi_progress);
+	}
+	free(upd_args);
+	return res;
 }
 
 char *concat_tags(json_object *tags_ls)
@@ -198,109 +214,126 @@ char *get_image_tags_concat(docker_image *img)
 	return tags;
 }
 
+/**
+ * Set a value of the image list row, in the table, or in the row object
+ * when rendering with --format.
+ */
+static void img_ls_set_val(zclk_table *img_tbl, json_object *row, size_t i,
+	int col, const char *key, const char *val)
+{
+	if (row != NULL)
+	{
+		cld_format_row_add(row, key, val);
+	}
+	else
+	{
+		zclk_table_set_row_val(img_tbl, i, col, (char *)val);
+	}
+}
+
 zclk_res img_ls_cmd_handler(zclk_command* cmd, void *handler_args)
 {
 	int quiet = 0;
 	docker_context *ctx = get_docker_context(handler_args);
 	docker_image_list *images;
+	char *format = zclk_option_get_val_string(get_option_by_name(cmd->options,
+		CLD_OPTION_LONG_FORMAT));
 
 	d_err_t docker_error = docker_images_list(ctx, &images, 0, 1, NULL, 0,
 											  NULL, NULL, NULL);
 
 	if (docker_error == E_SUCCESS)
 	{
-		char res_str[1024];
-		sprintf(res_str, "Listing images");
-		cmd->success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_STRING, res_str);
-
-		int col_num = 0;
 		size_t len_images = docker_image_list_length(images);
-		zclk_table *img_tbl;
-		if (create_zclk_table(&img_tbl, len_images, 5) == 0)
+		zclk_table *img_tbl = NULL;
+		json_object *rows = NULL;
+		if (format != NULL)
 		{
+			rows = json_object_new_array();
+		}
+		else
+		{
+			char res_str[1024];
+			sprintf(res_str, "Listing images");
+			cmd->success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_STRING, res_str);
+
+			if (create_zclk_table(&img_tbl, len_images, 5) != 0)
+			{
+				return ZCLK_RES_SUCCESS;
+			}
 			int col = 0;
 			zclk_table_set_header(img_tbl, col++, "REPOSITORY");
 			zclk_table_set_header(img_tbl, col++, "TAG");
 			zclk_table_set_header(img_tbl, col++, "IMAGE ID");
 			zclk_table_set_header(img_tbl, col++, "CREATED");
 			zclk_table_set_header(img_tbl, col++, "SIZE");
+		}
 
-			char *outstr;
-			size_t outstrlen;
-
-			printf("\n%s\n", get_json_string(images));
-
-			mustach_json_c(
-				"{{#.}}"
-				"  {{Created}}"
-				"{{/.}}",
-				images, &outstr, &outstrlen);
-
-			if (outstr != NULL)
+		for (size_t i = 0; i < len_images; i++)
+		{
+			docker_image *img = docker_image_list_get_idx(images,
+														  i);
+			json_object *row = NULL;
+			if (rows != NULL)
 			{
-				printf("%s\n", outstr);
+				row = json_object_new_object();
+				json_object_array_add(rows, row);
 			}
 
-			for (size_t i = 0; i < len_images; i++)
-			{
-				docker_image *img = docker_image_list_get_idx(images,
-															  i);
+			char cstr[1024];
+			const time_t created_time = (time_t)docker_image_created_get(img);
+			struct tm *ctm = gmtime(&created_time);
+			int len = strftime(cstr, 1023, "%d/%m/%Y %H:%M:%S", ctm);
+			cstr[len] = '\0';
 
-				col_num = 0;
-				char cstr[1024];
-				const time_t created_time = (time_t)docker_image_created_get(img);
-				struct tm *ctm = gmtime(&created_time);
-				int len = strftime(cstr, 1023, "%d/%m/%Y %H:%M:%S", ctm);
-				cstr[len] = '\0';
+			char sstr[1024];
+			sprintf(sstr, "%s", calculate_size(docker_image_size_get(img)));
 
-				char sstr[1024];
-				sprintf(sstr, "%s", calculate_size(docker_image_size_get(img)));
-
-				col = 0;
-				if (docker_image_repo_tags_get(img) != NULL && docker_image_repo_tags_length(img) > 0)
-				{
-					char *repo_tag = docker_image_repo_tags_get_idx(img, 0);
-					char *tag = strrchr(repo_tag, ':');
-					if (tag == NULL)
-					{
-						zclk_table_set_row_val(img_tbl, i, col++, repo_tag);
-						zclk_table_set_row_val(img_tbl, i, col++, "<none>");
-					}
-					else
-					{
-						char *repo_val = (char *)calloc(tag - repo_tag + 1, sizeof(char));
-						if (repo_val == NULL)
-						{
-							return ZCLK_RES_ERR_ALLOC_FAILED;
-						}
-						strncpy(repo_val, repo_tag, tag - repo_tag);
-						repo_val[tag - repo_tag] = '\0';
-						zclk_table_set_row_val(img_tbl, i, col++, repo_val);
-						zclk_table_set_row_val(img_tbl, i, col++, tag + 1);
-						free(repo_val);
-					}
-				}
-				else
-				{
-					zclk_table_set_row_val(img_tbl, i, col++, "<none>");
-					zclk_table_set_row_val(img_tbl, i, col++, "<none>");
-				}
-				char *img_id = docker_image_id_get(img);
-				char *id_val = strrchr(img_id, ':');
-				if (id_val == NULL)
+			int col = 0;
+			if (docker_image_repo_tags_get(img) != NULL && docker_image_repo_tags_length(img) > 0)
+			{
+				char *repo_tag = docker_image_repo_tags_get_idx(img, 0);
+				char *tag = strrchr(repo_tag, ':');
+				if (tag == NULL)
 				{
-					zclk_table_set_row_val(img_tbl, i, col++, img_id);
+					img_ls_set_val(img_tbl, row, i, col++, "Repository", repo_tag);
+					img_ls_set_val(img_tbl, row, i, col++, "Tag", "<none>");
 				}
 				else
 				{
-					zclk_table_set_row_val(img_tbl, i, col++, id_val + 1);
+					char *repo_val = (char *)calloc(tag - repo_tag + 1, sizeof(char));
+					if (repo_val == NULL)
+					{
+						return ZCLK_RES_ERR_ALLOC_FAILED;
+					}
+					strncpy(repo_val, repo_tag, tag - repo_tag);
+					repo_val[tag - repo_tag] = '\0';
+					img_ls_set_val(img_tbl, row, i, col++, "Repository", repo_val);
+					img_ls_set_val(img_tbl, row, i, col++, "Tag", tag + 1);
+					free(repo_val);
 				}
-				zclk_table_set_row_val(img_tbl, i, col++, cstr);
-				zclk_table_set_row_val(img_tbl, i, col++, sstr);
 			}
-			cmd->success_handler(ZCLK_RES_SUCCESS, 
-				ZCLK_RESULT_TABLE, img_tbl);
+			else
+			{
+				img_ls_set_val(img_tbl, row, i, col++, "Repository", "<none>");
+				img_ls_set_val(img_tbl, row, i, col++, "Tag", "<none>");
+			}
+			char *img_id = docker_image_id_get(img);
+			char *id_val = strrchr(img_id, ':');
+			img_ls_set_val(img_tbl, row, i, col++, "ID",
+				id_val == NULL ? img_id : id_val + 1);
+			img_ls_set_val(img_tbl, row, i, col++, "CreatedAt", cstr);
+			img_ls_set_val(img_tbl, row, i, col++, "Size", sstr);
+		}
+
+		if (rows != NULL)
+		{
+			zclk_res err = cld_format_output(cmd, format, rows);
+			json_object_put(rows);
+			return err;
 		}
+		cmd->success_handler(ZCLK_RES_SUCCESS, 
+			ZCLK_RESULT_TABLE, img_tbl);
 	}
 	else
 	{
@@ -334,7 +367,8 @@ zclk_res img_build_cmd_handler(zclk_command* cmd, void *handler_args)
 		return ZCLK_RES_ERR_ALLOC_FAILED;
 	}
 	upd_args->success_handler = cmd->success_handler;
-	create_zclk_multi_progress(&(upd_args->multi_progress));
+	// build output is streamed as text, no progress display is needed.
+	upd_args->multi_progress = NULL;
 
 	size_t len = arraylist_length(cmd->args);
 	if (len != 1)
@@ -367,7 +401,6 @@ zclk_res img_build_cmd_handler(zclk_command* cmd, void *handler_args)
 			return ZCLK_RES_ERR_UNKNOWN;
 		}
 	}
-	free_zclk_multi_progress(upd_args->multi_progress);
 }
 
 zclk_command *img_commands()
@@ -389,6 +422,8 @@ zclk_command *img_commands()
 				"ls", "Docker Image List", &img_ls_cmd_handler);
 		if(imgls_command != NULL)
 		{
+			zclk_command_string_option(imgls_command, CLD_OPTION_LONG_FORMAT,
+				NULL, NULL, "Pretty-print images using a template (e.g. \"{{.Repository}}:{{.Tag}}\")");
 			zclk_command_subcommand_add(image_command, imgls_command);
 		}
 		zclk_command *imgbuild_command = new_zclk_command("build", 
@@ -0,0 +1,547 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "cld_jsonl.h"
+
+/* Split a comma separated list into fields, in place. */
+static bool parse_list(char *list, cld_jsonl_field *fields, size_t *len,
+                       bool values)
+{
+    char *item = list;
+    while (item != NULL)
+    {
+        char *comma = strchr(item, ',');
+        if (comma != NULL)
+        {
+            *comma = '\0';
+        }
+        if (*len == CLD_JSONL_MAX_FIELDS)
+        {
+            return false;
+        }
+        cld_jsonl_field *field = &fields[(*len)++];
+        field->key = item;
+        field->value = NULL;
+        field->value_len = 0;
+        if (values)
+        {
+            char *eq = strchr(item, '=');
+            if (eq == NULL)
+            {
+                return false;
+            }
+            *eq = '\0';
+            field->value = eq + 1;
+            field->value_len = strlen(field->value);
+        }
+        field->key_len = strlen(item);
+        if (field->key_len == 0)
+        {
+            return false;
+        }
+        item = comma == NULL ? NULL : comma + 1;
+    }
+    return true;
+}
+
+bool cld_jsonl_init(cld_jsonl *jsonl, const char *filters, const char *fields)
+{
+    memset(jsonl, 0, offsetof(cld_jsonl, out));
+    size_t filters_size = filters == NULL ? 0 : strlen(filters) + 1;
+    size_t fields_size = fields == NULL ? 0 : strlen(fields) + 1;
+    jsonl->spec = (char *)malloc(filters_size + fields_size + 1);
+    jsonl->tok = json_tokener_new();
+    if (jsonl->spec == NULL || jsonl->tok == NULL)
+    {
+        cld_jsonl_free(jsonl);
+        return false;
+    }
+    char *filters_spec = jsonl->spec;
+    char *fields_spec = jsonl->spec + filters_size;
+    if (filters != NULL)
+    {
+        memcpy(filters_spec, filters, filters_size);
+        if (!parse_list(filters_spec, jsonl->filters, &jsonl->filters_len, true))
+        {
+            cld_jsonl_free(jsonl);
+            return false;
+        }
+    }
+    if (fields != NULL)
+    {
+        memcpy(fields_spec, fields, fields_size);
+        if (!parse_list(fields_spec, jsonl->fields, &jsonl->fields_len, false))
+        {
+            cld_jsonl_free(jsonl);
+            return false;
+        }
+    }
+    return true;
+}
+
+void cld_jsonl_free(cld_jsonl *jsonl)
+{
+    free(jsonl->spec);
+    jsonl->spec = NULL;
+    if (jsonl->tok != NULL)
+    {
+        json_tokener_free(jsonl->tok);
+        jsonl->tok = NULL;
+    }
+}
+
+static const char *skip_ws(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+    {
+        p++;
+    }
+    return p;
+}
+
+/* Skip a string starting at its opening quote, to after the closing quote. */
+static const char *skip_string(const char *p, const char *end)
+{
+    p++;
+    for (;;)
+    {
+        const char *quote = (const char *)memchr(p, '"', (size_t)(end - p));
+        if (quote == NULL)
+        {
+            return NULL;
+        }
+        // the quote is escaped if preceded by an odd number of backslashes.
+        const char *b = quote;
+        while (b > p && b[-1] == '\\')
+        {
+            b--;
+        }
+        p = quote + 1;
+        if ((quote - b) % 2 == 0)
+        {
+            return p;
+        }
+    }
+}
+
+/* Skip any value, nested objects and arrays included, without parsing it. */
+static const char *skip_value(const char *p, const char *end)
+{
+    if (p == end)
+    {
+        return NULL;
+    }
+    if (*p == '"')
+    {
+        return skip_string(p, end);
+    }
+    if (*p == '{' || *p == '[')
+    {
+        size_t depth = 0;
+        while (p < end)
+        {
+            switch (*p)
+            {
+            case '"':
+                p = skip_string(p, end);
+                if (p == NULL)
+                {
+                    return NULL;
+                }
+                continue;
+            case '{':
+            case '[':
+                depth++;
+                break;
+            case '}':
+            case ']':
+                if (--depth == 0)
+                {
+                    return p + 1;
+                }
+                break;
+            }
+            p++;
+        }
+        return NULL;
+    }
+    const char *start = p;
+    while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' '
+           && *p != '\t' && *p != '\r' && *p != '\n')
+    {
+        p++;
+    }
+    return p > start ? p : NULL;
+}
+
+bool cld_jsonl_scan(const char *line, size_t len,
+                    const cld_jsonl_field *fields, size_t fields_len,
+                    const char **values, size_t *values_len)
+{
+    const char *end = line + len;
+    size_t missing = fields_len;
+    for (size_t i = 0; i < fields_len; i++)
+    {
+        values[i] = NULL;
+        values_len[i] = 0;
+    }
+
+    const char *p = skip_ws(line, end);
+    if (p == end || *p != '{')
+    {
+        return false;
+    }
+    p = skip_ws(p + 1, end);
+    if (p < end && *p == '}')
+    {
+        return true;
+    }
+    while (p < end)
+    {
+        if (*p != '"')
+        {
+            return false;
+        }
+        const char *key = p + 1;
+        p = skip_string(p, end);
+        if (p == NULL)
+        {
+            return false;
+        }
+        size_t key_len = (size_t)(p - 1 - key);
+        p = skip_ws(p, end);
+        if (p == end || *p != ':')
+        {
+            return false;
+        }
+        p = skip_ws(p + 1, end);
+        const char *value = p;
+        p = skip_value(p, end);
+        if (p == NULL)
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < fields_len; i++)
+        {
+            if (values[i] == NULL && fields[i].key_len == key_len
+                && memcmp(fields[i].key, key, key_len) == 0)
+            {
+                values[i] = value;
+                values_len[i] = (size_t)(p - value);
+                missing--;
+            }
+        }
+        if (missing == 0)
+        {
+            return true;
+        }
+
+        p = skip_ws(p, end);
+        if (p == end)
+        {
+            return false;
+        }
+        if (*p == '}')
+        {
+            return true;
+        }
+        if (*p != ',')
+        {
+            return false;
+        }
+        p = skip_ws(p + 1, end);
+    }
+    return false;
+}
+
+/*
+ * Text of a value: the contents of a string, decoded only if it has
+ * escapes, or the JSON text of other values. A decoded string is owned by
+ * *obj, which the caller must put.
+ */
+static bool value_text(cld_jsonl *jsonl, const char *value, size_t len,
+                       const char **text, size_t *text_len, json_object **obj)
+{
+    *obj = NULL;
+    if (len < 2 || value[0] != '"')
+    {
+        *text = value;
+        *text_len = len;
+        return true;
+    }
+    if (memchr(value + 1, '\\', len - 2) == NULL)
+    {
+        *text = value + 1;
+        *text_len = len - 2;
+        return true;
+    }
+    json_tokener_reset(jsonl->tok);
+    *obj = json_tokener_parse_ex(jsonl->tok, value, (int)len);
+    if (*obj == NULL || !json_object_is_type(*obj, json_type_string))
+    {
+        if (*obj != NULL)
+        {
+            json_object_put(*obj);
+            *obj = NULL;
+        }
+        return false;
+    }
+    *text = json_object_get_string(*obj);
+    *text_len = (size_t)json_object_get_string_len(*obj);
+    return true;
+}
+
+static bool filters_match(cld_jsonl *jsonl, const char *json, size_t len)
+{
+    const char *values[CLD_JSONL_MAX_FIELDS];
+    size_t values_len[CLD_JSONL_MAX_FIELDS];
+    if (!cld_jsonl_scan(json, len, jsonl->filters, jsonl->filters_len, values,
+                     values_len))
+    {
+        return false;
+    }
+    for (size_t i = 0; i < jsonl->filters_len; i++)
+    {
+        const cld_jsonl_field *filter = &jsonl->filters[i];
+        const char *text;
+        size_t text_len;
+        json_object *obj;
+        if (values[i] == NULL
+            || !value_text(jsonl, values[i], values_len[i], &text, &text_len,
+                           &obj))
+        {
+            return false;
+        }
+        bool match = text_len == filter->value_len
+                     && memcmp(text, filter->value, text_len) == 0;
+        if (obj != NULL)
+        {
+            json_object_put(obj);
+        }
+        if (!match)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Append to the output buffer, cutting what does not fit. */
+static void out_append(cld_jsonl *jsonl, size_t *out_len, const char *data,
+                       size_t len)
+{
+    if (len > CLD_JSONL_OUT_MAX - *out_len)
+    {
+        len = CLD_JSONL_OUT_MAX - *out_len;
+    }
+    memcpy(jsonl->out + *out_len, data, len);
+    *out_len += len;
+}
+
+bool cld_jsonl_apply(cld_jsonl *jsonl, const char *line, size_t len,
+                     size_t skip, const char **out, size_t *out_len)
+{
+    const char *json = line + skip;
+    size_t json_len = len - skip;
+    if (jsonl->filters_len > 0 && !filters_match(jsonl, json, json_len))
+    {
+        return false;
+    }
+
+    *out = line;
+    *out_len = len;
+    if (jsonl->fields_len == 0)
+    {
+        return true;
+    }
+    const char *values[CLD_JSONL_MAX_FIELDS];
+    size_t values_len[CLD_JSONL_MAX_FIELDS];
+    if (!cld_jsonl_scan(json, json_len, jsonl->fields, jsonl->fields_len, values,
+                     values_len))
+    {
+        return true;
+    }
+
+    size_t n = 0;
+    out_append(jsonl, &n, line, skip);
+    for (size_t i = 0; i < jsonl->fields_len; i++)
+    {
+        if (i > 0)
+        {
+            out_append(jsonl, &n, " ", 1);
+        }
+        const char *text;
+        size_t text_len;
+        json_object *obj;
+        if (values[i] == NULL
+            || !value_text(jsonl, values[i], values_len[i], &text, &text_len,
+                           &obj))
+        {
+            out_append(jsonl, &n, "null", 4);
+            continue;
+        }
+        out_append(jsonl, &n, text, text_len);
+        if (obj != NULL)
+        {
+            json_object_put(obj);
+        }
+    }
+    *out = jsonl->out;
+    *out_len = n;
+    return true;
+}
+
+/* Value of a hex digit, or -1. */
+static int hex_val(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/* Read the 4 hex digits of a \u escape, -1 if they are not valid. */
+static long read_hex4(const char *str, size_t left)
+{
+    if (left < 4)
+    {
+        return -1;
+    }
+    long val = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        int d = hex_val(str[i]);
+        if (d < 0)
+        {
+            return -1;
+        }
+        val = val * 16 + d;
+    }
+    return val;
+}
+
+static size_t put_utf8(char *out, unsigned long cp)
+{
+    if (cp < 0x80)
+    {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800)
+    {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000)
+    {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+size_t cld_jsonl_unescape(const char *str, size_t len, char *out)
+{
+    size_t n = 0;
+    size_t i = 0;
+    while (i < len)
+    {
+        const char *esc = (const char *)memchr(str + i, '\\', len - i);
+        size_t plain = esc == NULL ? len - i : (size_t)(esc - (str + i));
+        memmove(out + n, str + i, plain);
+        n += plain;
+        i += plain;
+        if (esc == NULL || i + 1 >= len)
+        {
+            break;
+        }
+
+        char c = str[i + 1];
+        i += 2;
+        switch (c)
+        {
+        case 'n':
+            out[n++] = '\n';
+            break;
+        case 't':
+            out[n++] = '\t';
+            break;
+        case 'r':
+            out[n++] = '\r';
+            break;
+        case 'b':
+            out[n++] = '\b';
+            break;
+        case 'f':
+            out[n++] = '\f';
+            break;
+        case 'u':
+        {
+            long cp = read_hex4(str + i, len - i);
+            if (cp < 0)
+            {
+                break;
+            }
+            i += 4;
+            // a surrogate pair is one code point.
+            if (cp >= 0xD800 && cp < 0xDC00 && i + 1 < len
+                && str[i] == '\\' && str[i + 1] == 'u')
+            {
+                long low = read_hex4(str + i + 2, len - i - 2);
+                if (low >= 0xDC00 && low < 0xE000)
+                {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    i += 6;
+                }
+            }
+            n += put_utf8(out + n, (unsigned long)cp);
+            break;
+        }
+        default:
+            // \", \\ and \/ stand for themselves.
+            out[n++] = c;
+            break;
+        }
+    }
+    return n;
+}
@@ -0,0 +1,105 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SRC_CLD_JSONL_H_
+#define SRC_CLD_JSONL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <json-c/json_tokener.h>
+
+/** Most fields that can be matched or selected. */
+#define CLD_JSONL_MAX_FIELDS 16
+
+/** Longest projected line, longer ones are cut. */
+#define CLD_JSONL_OUT_MAX 16384
+
+/** A top level field of a JSON object. */
+typedef struct cld_jsonl_field_t
+{
+    const char *key;
+    size_t key_len;
+    /* value to match, NULL for selected fields */
+    const char *value;
+    size_t value_len;
+} cld_jsonl_field;
+
+/**
+ * Filters and projects log lines holding one JSON object each, without
+ * parsing them into objects. The top level of a line is scanned only until
+ * the wanted keys are found, nested values are skipped over, and only
+ * string values with escapes are decoded (with a json_tokener).
+ */
+typedef struct cld_jsonl_t
+{
+    char *spec;
+    cld_jsonl_field filters[CLD_JSONL_MAX_FIELDS];
+    size_t filters_len;
+    cld_jsonl_field fields[CLD_JSONL_MAX_FIELDS];
+    size_t fields_len;
+    json_tokener *tok;
+    char out[CLD_JSONL_OUT_MAX];
+} cld_jsonl;
+
+/**
+ * Initialize from a comma separated list of key=value filters and a comma
+ * separated list of fields to output, either may be NULL.
+ * Returns false if the lists are not valid, or on allocation failure.
+ */
+bool cld_jsonl_init(cld_jsonl *jsonl, const char *filters, const char *fields);
+
+/** Free the resources of jsonl, not jsonl itself. */
+void cld_jsonl_free(cld_jsonl *jsonl);
+
+/**
+ * Apply the filters and the projection to a line of len bytes, of which
+ * the first skip (e.g. a timestamp) are kept as they are. Returns false if
+ * the line is filtered out. Otherwise out is set to the line itself, or to
+ * the projected line in the buffer of jsonl, valid until the next call.
+ *
+ * A line matches if every filter key has the given value: the text of a
+ * string, or the JSON text of other values (e.g. 404, true). Fields are
+ * output separated by spaces, strings without quotes, and missing fields as
+ * null. Lines which are not JSON objects never match a filter, and are
+ * output unchanged when there are only fields.
+ */
+bool cld_jsonl_apply(cld_jsonl *jsonl, const char *line, size_t len,
+                     size_t skip, const char **out, size_t *out_len);
+
+/**
+ * Scan the top level of the JSON object in line for the keys of fields,
+ * setting the slice of the JSON value of each (NULL if not found). Stops as
+ * soon as all are found. Returns false if the line is not a JSON object.
+ */
+bool cld_jsonl_scan(const char *line, size_t len,
+                    const cld_jsonl_field *fields, size_t fields_len,
+                    const char **values, size_t *values_len);
+
+/**
+ * Decode the escapes of the contents of a JSON string (without the quotes)
+ * to out, which must have room for len bytes. out may be str.
+ * Returns the decoded length.
+ */
+size_t cld_jsonl_unescape(const char *str, size_t len, char *out);
+
+#endif /* SRC_CLD_JSONL_H_ */
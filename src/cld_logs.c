@@ -0,0 +1,1184 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#ifdef _WIN32
+#include <io.h>
+#define STDOUT_FILENO 1
+#define STDERR_FILENO 2
+#else
+#include <unistd.h>
+#include <limits.h>
+#include <sys/uio.h>
+#endif
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+#include "docker_all.h"
+#include "cld_async.h"
+#include "cld_logs.h"
+#include "cld_search.h"
+#include "cld_jsonl.h"
+
+#define CLD_LOGS_HEADER_LEN 8
+
+enum
+{
+    DEMUX_UNKNOWN,
+    DEMUX_FRAMED,
+    DEMUX_RAW
+};
+
+void cld_logs_demux_init(cld_logs_demux *demux, cld_logs_line_fn line_fn,
+                         cld_logs_sync_fn sync_fn, void *args)
+{
+    demux->mode = DEMUX_UNKNOWN;
+    demux->header_len = 0;
+    demux->frame_left = 0;
+    demux->frame_stream = CLD_LOGS_STDOUT;
+    memset(demux->line_len, 0, sizeof(demux->line_len));
+    memset(demux->line_emitted, 0, sizeof(demux->line_emitted));
+    demux->line_fn = line_fn;
+    demux->sync_fn = sync_fn;
+    demux->args = args;
+}
+
+static void demux_emit(cld_logs_demux *demux, int stream, const char *line,
+                       size_t len)
+{
+    // a TTY sends \r\n line ends
+    if (demux->mode == DEMUX_RAW && len > 0 && line[len - 1] == '\r')
+    {
+        len--;
+    }
+    demux->line_fn(demux->args, stream, line, len);
+}
+
+static void demux_emit_buffer(cld_logs_demux *demux, int stream)
+{
+    demux_emit(demux, stream, demux->line[stream], demux->line_len[stream]);
+    demux->line_len[stream] = 0;
+    demux->line_emitted[stream] = true;
+}
+
+static void demux_buffer(cld_logs_demux *demux, int stream, const char *data,
+                         size_t len)
+{
+    // the previous line in the buffer may still be referenced.
+    if (demux->line_emitted[stream])
+    {
+        if (demux->sync_fn != NULL)
+        {
+            demux->sync_fn(demux->args);
+        }
+        demux->line_emitted[stream] = false;
+    }
+    memcpy(demux->line[stream] + demux->line_len[stream], data, len);
+    demux->line_len[stream] += len;
+}
+
+/*
+ * Split output of a stream into lines. Lines (and pieces of long lines)
+ * which are complete in data are output in place, the others continue in
+ * the line buffer.
+ */
+static void demux_lines(cld_logs_demux *demux, int stream, const char *data,
+                        size_t len)
+{
+    while (len > 0)
+    {
+        const char *nl = (const char *)memchr(data, '\n', len);
+        size_t n = nl == NULL ? len : (size_t)(nl - data);
+
+        if (demux->line_len[stream] == 0)
+        {
+            while (n > CLD_LOGS_LINE_MAX)
+            {
+                demux_emit(demux, stream, data, CLD_LOGS_LINE_MAX);
+                data += CLD_LOGS_LINE_MAX;
+                len -= CLD_LOGS_LINE_MAX;
+                n -= CLD_LOGS_LINE_MAX;
+            }
+            if (nl != NULL)
+            {
+                demux_emit(demux, stream, data, n);
+                data += n + 1;
+                len -= n + 1;
+                continue;
+            }
+        }
+
+        while (n > 0)
+        {
+            size_t space = CLD_LOGS_LINE_MAX - demux->line_len[stream];
+            size_t c = n < space ? n : space;
+            demux_buffer(demux, stream, data, c);
+            data += c;
+            len -= c;
+            n -= c;
+            if (demux->line_len[stream] == CLD_LOGS_LINE_MAX)
+            {
+                demux_emit_buffer(demux, stream);
+            }
+        }
+        if (nl != NULL)
+        {
+            demux_emit_buffer(demux, stream);
+            data++;
+            len--;
+        }
+    }
+}
+
+/*
+ * A frame header starts with the stream id (0, 1 or 2) followed by three
+ * zero bytes, which does not happen in readable TTY output.
+ */
+static int demux_detect(const char *data, size_t len)
+{
+    const unsigned char *b = (const unsigned char *)data;
+    if (b[0] > CLD_LOGS_STDERR)
+    {
+        return DEMUX_RAW;
+    }
+    for (size_t i = 1; i < 4 && i < len; i++)
+    {
+        if (b[i] != 0)
+        {
+            return DEMUX_RAW;
+        }
+    }
+    return DEMUX_FRAMED;
+}
+
+void cld_logs_demux_feed(cld_logs_demux *demux, const char *data, size_t len)
+{
+    if (len == 0)
+    {
+        return;
+    }
+    if (demux->mode == DEMUX_UNKNOWN)
+    {
+        demux->mode = demux_detect(data, len);
+    }
+    // lines output by the previous call have been consumed.
+    memset(demux->line_emitted, 0, sizeof(demux->line_emitted));
+    if (demux->mode == DEMUX_RAW)
+    {
+        demux_lines(demux, CLD_LOGS_STDOUT, data, len);
+        return;
+    }
+
+    while (len > 0)
+    {
+        if (demux->frame_left == 0)
+        {
+            size_t c = CLD_LOGS_HEADER_LEN - demux->header_len;
+            c = c < len ? c : len;
+            memcpy(demux->header + demux->header_len, data, c);
+            demux->header_len += c;
+            data += c;
+            len -= c;
+            if (demux->header_len < CLD_LOGS_HEADER_LEN)
+            {
+                break;
+            }
+            const unsigned char *h = demux->header;
+            demux->frame_stream = h[0] == CLD_LOGS_STDERR ? CLD_LOGS_STDERR
+                                                          : CLD_LOGS_STDOUT;
+            demux->frame_left = ((size_t)h[4] << 24) | ((size_t)h[5] << 16)
+                                | ((size_t)h[6] << 8) | (size_t)h[7];
+            demux->header_len = 0;
+            continue;
+        }
+
+        size_t c = demux->frame_left < len ? demux->frame_left : len;
+        demux_lines(demux, demux->frame_stream, data, c);
+        demux->frame_left -= c;
+        data += c;
+        len -= c;
+    }
+}
+
+void cld_logs_demux_flush(cld_logs_demux *demux)
+{
+    for (int stream = CLD_LOGS_STDOUT; stream <= CLD_LOGS_STDERR; stream++)
+    {
+        if (demux->line_len[stream] > 0)
+        {
+            demux_emit_buffer(demux, stream);
+        }
+    }
+}
+
+void cld_logs_sink_init(cld_logs_sink *sink, int fd)
+{
+    sink->fd = fd;
+    sink->failed = false;
+    sink->iovcnt = 0;
+    sink->buf_len = 0;
+}
+
+void cld_logs_sink_add(cld_logs_sink *sink, const char *data, size_t len)
+{
+    if (len == 0)
+    {
+        return;
+    }
+    if (sink->iovcnt == CLD_LOGS_SINK_IOV)
+    {
+        cld_logs_sink_flush(sink);
+    }
+    sink->iov[sink->iovcnt].base = data;
+    sink->iov[sink->iovcnt].len = len;
+    sink->iovcnt++;
+}
+
+void cld_logs_sink_copy(cld_logs_sink *sink, const char *data, size_t len)
+{
+    if (len > CLD_LOGS_SINK_BUF - sink->buf_len)
+    {
+        cld_logs_sink_flush(sink);
+        if (len > CLD_LOGS_SINK_BUF)
+        {
+            cld_logs_sink_add(sink, data, len);
+            cld_logs_sink_flush(sink);
+            return;
+        }
+    }
+
+    char *dest = sink->buf + sink->buf_len;
+    // extend the previous slice when it ends where the copy starts.
+    struct cld_logs_iov_t *last = sink->iovcnt > 0 ?
+        &sink->iov[sink->iovcnt - 1] : NULL;
+    bool extend = last != NULL && last->base + last->len == dest;
+    if (!extend && sink->iovcnt == CLD_LOGS_SINK_IOV)
+    {
+        // flushing resets the staging buffer, so it must happen before the
+        // copy lands in it.
+        cld_logs_sink_flush(sink);
+        dest = sink->buf;
+    }
+    memcpy(dest, data, len);
+    sink->buf_len += len;
+
+    if (extend)
+    {
+        last->len += len;
+    }
+    else
+    {
+        cld_logs_sink_add(sink, dest, len);
+    }
+}
+
+#ifdef _WIN32
+static void sink_write_all(cld_logs_sink *sink)
+{
+    for (int i = 0; i < sink->iovcnt && !sink->failed; i++)
+    {
+        const char *base = sink->iov[i].base;
+        size_t left = sink->iov[i].len;
+        while (left > 0)
+        {
+            int n = _write(sink->fd, base, (unsigned int)left);
+            if (n <= 0)
+            {
+                sink->failed = true;
+                break;
+            }
+            base += n;
+            left -= (size_t)n;
+        }
+    }
+}
+#else
+static void sink_write_all(cld_logs_sink *sink)
+{
+    struct iovec iov[CLD_LOGS_SINK_IOV];
+    int cnt = sink->iovcnt;
+    for (int i = 0; i < cnt; i++)
+    {
+        iov[i].iov_base = (void *)sink->iov[i].base;
+        iov[i].iov_len = sink->iov[i].len;
+    }
+
+    struct iovec *next = iov;
+    while (cnt > 0)
+    {
+        ssize_t n = writev(sink->fd, next, cnt > IOV_MAX ? IOV_MAX : cnt);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            // e.g. a closed pipe, the rest of the output is dropped.
+            sink->failed = true;
+            return;
+        }
+        // skip what was written, the last slice may be partly written.
+        while (cnt > 0 && (size_t)n >= next->iov_len)
+        {
+            n -= (ssize_t)next->iov_len;
+            next++;
+            cnt--;
+        }
+        if (cnt > 0)
+        {
+            next->iov_base = (char *)next->iov_base + n;
+            next->iov_len -= (size_t)n;
+        }
+    }
+}
+#endif
+
+void cld_logs_sink_flush(cld_logs_sink *sink)
+{
+    if (sink->iovcnt > 0 && !sink->failed)
+    {
+        sink_write_all(sink);
+    }
+    sink->iovcnt = 0;
+    sink->buf_len = 0;
+}
+
+#define NS_PER_SEC 1000000000LL
+
+void cld_logs_opts_init(cld_logs_opts *opts)
+{
+    memset(opts, 0, sizeof(cld_logs_opts));
+    opts->tail = -1;
+}
+
+/* Read n decimal digits at str. */
+static bool read_digits(const char *str, size_t n, int *val)
+{
+    *val = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (str[i] < '0' || str[i] > '9')
+        {
+            return false;
+        }
+        *val = *val * 10 + (str[i] - '0');
+    }
+    return true;
+}
+
+/* Days since 1970-01-01 of a date in the proleptic gregorian calendar. */
+static int64_t days_from_civil(int64_t y, int m, int d)
+{
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+size_t cld_logs_parse_rfc3339(const char *str, size_t len, int64_t *ns)
+{
+    int year, month, day, hour = 0, min = 0, sec = 0;
+    if (len < 10 || str[4] != '-' || str[7] != '-'
+        || !read_digits(str, 4, &year) || !read_digits(str + 5, 2, &month)
+        || !read_digits(str + 8, 2, &day)
+        || month < 1 || month > 12 || day < 1 || day > 31)
+    {
+        return 0;
+    }
+
+    size_t pos = 10;
+    int64_t frac = 0;
+    int64_t offset = 0;
+    if (pos < len && (str[pos] == 'T' || str[pos] == 't'))
+    {
+        if (len < pos + 9 || str[pos + 3] != ':' || str[pos + 6] != ':'
+            || !read_digits(str + pos + 1, 2, &hour)
+            || !read_digits(str + pos + 4, 2, &min)
+            || !read_digits(str + pos + 7, 2, &sec)
+            || hour > 23 || min > 59 || sec > 60)
+        {
+            return 0;
+        }
+        pos += 9;
+
+        // fraction of second, digits after the ninth are ignored.
+        if (pos < len && str[pos] == '.')
+        {
+            int64_t scale = NS_PER_SEC / 10;
+            pos++;
+            while (pos < len && str[pos] >= '0' && str[pos] <= '9')
+            {
+                frac += (str[pos] - '0') * scale;
+                scale /= 10;
+                pos++;
+            }
+        }
+
+        if (pos < len && (str[pos] == 'Z' || str[pos] == 'z'))
+        {
+            pos++;
+        }
+        else if (pos < len && (str[pos] == '+' || str[pos] == '-'))
+        {
+            int off_h, off_m;
+            if (len < pos + 6 || str[pos + 3] != ':'
+                || !read_digits(str + pos + 1, 2, &off_h)
+                || !read_digits(str + pos + 4, 2, &off_m))
+            {
+                return 0;
+            }
+            offset = ((int64_t)off_h * 3600 + off_m * 60)
+                     * (str[pos] == '+' ? 1 : -1);
+            pos += 6;
+        }
+    }
+
+    int64_t secs = days_from_civil(year, month, day) * 86400
+                   + hour * 3600 + min * 60 + sec - offset;
+    *ns = secs * NS_PER_SEC + frac;
+    return pos;
+}
+
+/* Parse a duration like 1h30m, 10m or 2.5s into ns. */
+static bool parse_duration(const char *str, int64_t *ns)
+{
+    static const struct
+    {
+        const char *unit;
+        int64_t ns;
+    } units[] = {{"ns", 1}, {"us", 1000}, {"ms", 1000000},
+                 {"s", NS_PER_SEC}, {"m", 60 * NS_PER_SEC},
+                 {"h", 3600 * NS_PER_SEC}};
+
+    *ns = 0;
+    if (*str == '\0')
+    {
+        return false;
+    }
+    while (*str != '\0')
+    {
+        char *end;
+        double val = strtod(str, &end);
+        if (end == str || val < 0)
+        {
+            return false;
+        }
+        str = end;
+
+        size_t unit_len = 0;
+        while (str[unit_len] >= 'a' && str[unit_len] <= 'z')
+        {
+            unit_len++;
+        }
+        bool found = false;
+        for (size_t i = 0; i < sizeof(units) / sizeof(units[0]); i++)
+        {
+            if (strlen(units[i].unit) == unit_len
+                && strncmp(str, units[i].unit, unit_len) == 0)
+            {
+                *ns += (int64_t)(val * (double)units[i].ns);
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+        {
+            return false;
+        }
+        str += unit_len;
+    }
+    return true;
+}
+
+bool cld_logs_parse_time(const char *str, int64_t *ns)
+{
+    size_t len = strlen(str);
+    if (len == 0)
+    {
+        return false;
+    }
+    if (cld_logs_parse_rfc3339(str, len, ns) == len)
+    {
+        return true;
+    }
+
+    // unix timestamp, seconds with an optional fraction.
+    size_t digits = strspn(str, "0123456789");
+    if (digits > 0 && (str[digits] == '\0'
+        || (str[digits] == '.'
+            && strspn(str + digits + 1, "0123456789") == len - digits - 1)))
+    {
+        int64_t secs = strtoll(str, NULL, 10);
+        int64_t frac = 0;
+        if (str[digits] == '.')
+        {
+            int64_t scale = NS_PER_SEC / 10;
+            for (const char *p = str + digits + 1; *p != '\0' && scale > 0; p++)
+            {
+                frac += (*p - '0') * scale;
+                scale /= 10;
+            }
+        }
+        *ns = secs * NS_PER_SEC + frac;
+        return true;
+    }
+
+    int64_t duration;
+    if (parse_duration(str, &duration))
+    {
+        *ns = (int64_t)time(NULL) * NS_PER_SEC - duration;
+        return true;
+    }
+    return false;
+}
+
+bool cld_logs_parse_tail(const char *str, int64_t *tail)
+{
+    if (strcmp(str, "all") == 0)
+    {
+        *tail = -1;
+        return true;
+    }
+    size_t digits = strspn(str, "0123456789");
+    if (digits == 0 || str[digits] != '\0')
+    {
+        return false;
+    }
+    *tail = strtoll(str, NULL, 10);
+    return true;
+}
+
+/* Append a time to an API query string, as seconds.nanoseconds. */
+static void append_time_param(char *path, size_t size, const char *name,
+                              int64_t ns)
+{
+    size_t len = strlen(path);
+    snprintf(path + len, size - len, "&%s=%lld.%09lld", name,
+             (long long)(ns / NS_PER_SEC), (long long)(ns % NS_PER_SEC));
+}
+
+/* A line waiting in the merge buffer of a stream. */
+typedef struct logs_line_t
+{
+    int64_t time_ns;
+    long long arrival_ms;
+    int stream_id;
+    char *text;
+    size_t len;
+} logs_line;
+
+typedef struct logs_session_t logs_session;
+
+/* The log stream of one container. */
+typedef struct logs_stream_t
+{
+    logs_session *session;
+    char *container;
+    char *name;
+    cld_logs_demux demux;
+    bool open;
+    char *error;
+    /* ring of lines waiting to be merged */
+    logs_line lines[CLD_LOGS_MERGE_LINES];
+    size_t head;
+    size_t count;
+} logs_stream;
+
+struct logs_session_t
+{
+    cld_async *async;
+    const cld_logs_opts *opts;
+    bool merge;
+    arraylist *streams;
+    size_t name_width;
+    /* streams with waiting lines, a min heap on their first line time */
+    logs_stream **heap;
+    size_t heap_len;
+    size_t heap_cap;
+    /* open streams without waiting lines, which hold back the merge */
+    size_t waiting;
+    cld_search grep;
+    cld_search grep_v;
+    /* --json-field and --fields, NULL if not given */
+    cld_jsonl *jsonl;
+    /* stdout and stderr */
+    cld_logs_sink sinks[2];
+    zclk_command_output_handler error_handler;
+};
+
+static int64_t stream_head_time(logs_stream *stream)
+{
+    return stream->lines[stream->head].time_ns;
+}
+
+static void heap_swap(logs_stream **heap, size_t a, size_t b)
+{
+    logs_stream *tmp = heap[a];
+    heap[a] = heap[b];
+    heap[b] = tmp;
+}
+
+static bool heap_push(logs_session *session, logs_stream *stream)
+{
+    if (session->heap_len == session->heap_cap)
+    {
+        size_t cap = session->heap_cap == 0 ? 16 : session->heap_cap * 2;
+        logs_stream **heap = (logs_stream **)realloc(session->heap,
+                                                     cap * sizeof(logs_stream *));
+        if (heap == NULL)
+        {
+            return false;
+        }
+        session->heap = heap;
+        session->heap_cap = cap;
+    }
+    logs_stream **heap = session->heap;
+    size_t i = session->heap_len++;
+    heap[i] = stream;
+    while (i > 0 && stream_head_time(heap[(i - 1) / 2]) > stream_head_time(heap[i]))
+    {
+        heap_swap(heap, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    return true;
+}
+
+static logs_stream *heap_pop(logs_session *session)
+{
+    logs_stream **heap = session->heap;
+    logs_stream *top = heap[0];
+    heap[0] = heap[--session->heap_len];
+    size_t i = 0;
+    for (;;)
+    {
+        size_t min = i;
+        size_t l = 2 * i + 1;
+        size_t r = l + 1;
+        if (l < session->heap_len && stream_head_time(heap[l]) < stream_head_time(heap[min]))
+        {
+            min = l;
+        }
+        if (r < session->heap_len && stream_head_time(heap[r]) < stream_head_time(heap[min]))
+        {
+            min = r;
+        }
+        if (min == i)
+        {
+            break;
+        }
+        heap_swap(heap, i, min);
+        i = min;
+    }
+    return top;
+}
+
+static void session_flush(void *args)
+{
+    logs_session *session = (logs_session *)args;
+    cld_logs_sink_flush(&session->sinks[0]);
+    cld_logs_sink_flush(&session->sinks[1]);
+}
+
+/*
+ * Output a line of a stream, by reference unless copy is true. Merged
+ * lines get the container name as prefix.
+ */
+static void session_output(logs_session *session, logs_stream *stream,
+                           int stream_id, const char *text, size_t len,
+                           bool copy)
+{
+    static const char newline = '\n';
+    cld_logs_sink *sink = &session->sinks[stream_id == CLD_LOGS_STDERR ? 1 : 0];
+
+    if (session->merge)
+    {
+        char prefix[256];
+        int n = snprintf(prefix, sizeof(prefix), "%-*s | ",
+                         (int)session->name_width, stream->name);
+        if (n > 0)
+        {
+            cld_logs_sink_copy(sink, prefix,
+                               (size_t)n < sizeof(prefix) ? (size_t)n
+                                                          : sizeof(prefix) - 1);
+        }
+    }
+
+    if (copy)
+    {
+        cld_logs_sink_copy(sink, text, len);
+    }
+    else
+    {
+        cld_logs_sink_add(sink, text, len);
+    }
+    cld_logs_sink_add(sink, &newline, 1);
+}
+
+/*
+ * Output merged lines in timestamp order. The first line of the heap can
+ * only be output when every open stream has a line waiting, or when it has
+ * waited longer than the merge window for the other streams. With force
+ * the first line is output regardless.
+ */
+static void session_merge(logs_session *session, bool force)
+{
+    long long now = cld_async_now_ms();
+    while (session->heap_len > 0)
+    {
+        logs_stream *stream = session->heap[0];
+        logs_line *line = &stream->lines[stream->head];
+        if (!force && session->waiting > 0
+            && now - line->arrival_ms < CLD_LOGS_MERGE_WINDOW_MS)
+        {
+            break;
+        }
+        heap_pop(session);
+        session_output(session, stream, line->stream_id, line->text, line->len,
+                       true);
+        free(line->text);
+        line->text = NULL;
+        stream->head = (stream->head + 1) % CLD_LOGS_MERGE_LINES;
+        stream->count--;
+        if (stream->count > 0)
+        {
+            heap_push(session, stream);
+        }
+        else if (stream->open)
+        {
+            session->waiting++;
+        }
+        force = false;
+    }
+}
+
+/* Check a line against the --grep and --grep-v searches. */
+static bool session_keep(logs_session *session, const char *text, size_t len)
+{
+    if (session->grep.needle != NULL
+        && !cld_search_match(&session->grep, text, len))
+    {
+        return false;
+    }
+    if (session->grep_v.needle != NULL
+        && cld_search_match(&session->grep_v, text, len))
+    {
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Apply the --json-field filters and the --fields projection to a line,
+ * leaving a timestamp prefix as it is. Returns false if the line is
+ * filtered out, otherwise text and len are set to the line to output.
+ */
+static bool session_jsonl(logs_session *session, const char **text, size_t *len)
+{
+    size_t skip = 0;
+    if (session->opts->timestamps)
+    {
+        int64_t ns;
+        skip = cld_logs_parse_rfc3339(*text, *len, &ns);
+        if (skip > 0 && skip < *len && (*text)[skip] == ' ')
+        {
+            skip++;
+        }
+    }
+    return cld_jsonl_apply(session->jsonl, *text, *len, skip, text, len);
+}
+
+/*
+ * Line of a demuxed stream, filtered before anything else is done with
+ * it, then output directly or queued for the merge.
+ */
+static void stream_line(void *args, int stream_id, const char *text, size_t len)
+{
+    logs_stream *stream = (logs_stream *)args;
+    logs_session *session = stream->session;
+    if (!session->merge)
+    {
+        const char *out = text;
+        if (session_keep(session, text, len)
+            && (session->jsonl == NULL || session_jsonl(session, &out, &len)))
+        {
+            // a projected line is in the buffer of the next line.
+            session_output(session, stream, stream_id, out, len, out != text);
+        }
+        return;
+    }
+
+    // the timestamp the daemon added for the merge is removed, unless it
+    // was asked for.
+    int64_t time_ns;
+    size_t ts_len = cld_logs_parse_rfc3339(text, len, &time_ns);
+    if (ts_len == 0)
+    {
+        time_ns = 0;
+    }
+    else if (!session->opts->timestamps && ts_len < len && text[ts_len] == ' ')
+    {
+        text += ts_len + 1;
+        len -= ts_len + 1;
+    }
+    if (!session_keep(session, text, len)
+        || (session->jsonl != NULL && !session_jsonl(session, &text, &len)))
+    {
+        return;
+    }
+
+    // a full buffer outputs lines early rather than growing.
+    while (stream->count == CLD_LOGS_MERGE_LINES)
+    {
+        session_merge(session, true);
+    }
+
+    logs_line *line = &stream->lines[(stream->head + stream->count)
+                                     % CLD_LOGS_MERGE_LINES];
+    line->text = (char *)malloc(len + 1);
+    if (line->text == NULL)
+    {
+        return;
+    }
+    memcpy(line->text, text, len);
+    line->text[len] = '\0';
+    line->len = len;
+    line->stream_id = stream_id;
+    line->arrival_ms = cld_async_now_ms();
+    line->time_ns = time_ns;
+
+    stream->count++;
+    if (stream->count == 1)
+    {
+        heap_push(session, stream);
+        session->waiting--;
+    }
+    session_merge(session, false);
+}
+
+static void stream_sync(void *args)
+{
+    session_flush(((logs_stream *)args)->session);
+}
+
+static int logs_stream_data(cld_async_request *req, const char *data,
+                            size_t len, void *cbargs)
+{
+    logs_stream *stream = (logs_stream *)cbargs;
+    cld_logs_demux_feed(&stream->demux, data, len);
+    // the lines output in place point into data.
+    session_flush(stream->session);
+    return 0;
+}
+
+static void logs_stream_done(cld_async_request *req, void *cbargs)
+{
+    logs_stream *stream = (logs_stream *)cbargs;
+    logs_session *session = stream->session;
+    cld_logs_demux_flush(&stream->demux);
+    session_flush(session);
+    if (!cld_async_request_ok(req))
+    {
+        stream->error = str_clone(cld_async_request_message(req));
+    }
+
+    stream->open = false;
+    if (session->merge)
+    {
+        if (stream->count == 0)
+        {
+            session->waiting--;
+        }
+        session_merge(session, false);
+    }
+}
+
+static void free_logs_stream(void *item)
+{
+    logs_stream *stream = (logs_stream *)item;
+    for (size_t i = 0; i < stream->count; i++)
+    {
+        free(stream->lines[(stream->head + i) % CLD_LOGS_MERGE_LINES].text);
+    }
+    free(stream->container);
+    free(stream->name);
+    free(stream->error);
+    free(stream);
+}
+
+/* Start streaming the log of a container. */
+static void session_add(logs_session *session, const char *container,
+                        const char *name)
+{
+    const cld_logs_opts *opts = session->opts;
+    char path[1024];
+    char *escaped = cld_async_escape(container);
+    // the line buffers make this too large for the stack.
+    logs_stream *stream = (logs_stream *)calloc(1, sizeof(logs_stream));
+    if (escaped == NULL || stream == NULL)
+    {
+        free(escaped);
+        free(stream);
+        return;
+    }
+
+    // merging needs the timestamps of the lines.
+    snprintf(path, sizeof(path),
+             "/containers/%s/logs?stdout=1&stderr=1&follow=%d&timestamps=%d",
+             escaped, opts->follow ? 1 : 0,
+             opts->timestamps || session->merge ? 1 : 0);
+    free(escaped);
+    if (opts->tail >= 0)
+    {
+        size_t len = strlen(path);
+        snprintf(path + len, sizeof(path) - len, "&tail=%lld",
+                 (long long)opts->tail);
+    }
+    if (opts->since_ns > 0)
+    {
+        append_time_param(path, sizeof(path), "since", opts->since_ns);
+    }
+    if (opts->until_ns > 0)
+    {
+        append_time_param(path, sizeof(path), "until", opts->until_ns);
+    }
+
+    stream->session = session;
+    stream->container = str_clone(container);
+    stream->name = str_clone(name[0] == '/' ? name + 1 : name);
+    stream->open = true;
+    cld_logs_demux_init(&stream->demux, &stream_line, &stream_sync, stream);
+    if (cld_async_submit(session->async, "GET", path, NULL, &logs_stream_data,
+                         &logs_stream_done, stream) == NULL)
+    {
+        free_logs_stream(stream);
+        return;
+    }
+    arraylist_add(session->streams, stream);
+    session->waiting++;
+    if (strlen(stream->name) > session->name_width)
+    {
+        session->name_width = strlen(stream->name);
+    }
+}
+
+static void logs_list_done(cld_async_request *req, void *cbargs)
+{
+    logs_session *session = (logs_session *)cbargs;
+    json_object *ctrs = cld_async_request_ok(req) ?
+        cld_async_request_json(req) : NULL;
+    if (ctrs == NULL || !json_object_is_type(ctrs, json_type_array))
+    {
+        char res_str[1024];
+        snprintf(res_str, sizeof(res_str), "Could not list containers: %s",
+                 cld_async_request_message(req));
+        session->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING, res_str);
+        json_object_put(ctrs);
+        return;
+    }
+
+    size_t num = json_object_array_length(ctrs);
+    for (size_t i = 0; i < num; i++)
+    {
+        json_object *ctr = json_object_array_get_idx(ctrs, i);
+        json_object *id, *names;
+        if (!json_object_object_get_ex(ctr, "Id", &id))
+        {
+            continue;
+        }
+        const char *name = json_object_get_string(id);
+        if (json_object_object_get_ex(ctr, "Names", &names)
+            && json_object_array_length(names) > 0)
+        {
+            name = json_object_get_string(json_object_array_get_idx(names, 0));
+        }
+        session_add(session, json_object_get_string(id), name);
+    }
+    json_object_put(ctrs);
+}
+
+/* Submit the container list for a "key=value" filter. */
+static zclk_res session_list(logs_session *session, const char *filter)
+{
+    const char *val = strchr(filter, '=');
+    if (val == NULL)
+    {
+        session->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING,
+                               "Filter must be of the form key=value.");
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+
+    json_object *filters = json_object_new_object();
+    json_object *vals = json_object_new_array();
+    char *key = str_clone(filter);
+    key[val - filter] = '\0';
+    json_object_array_add(vals, json_object_new_string(val + 1));
+    json_object_object_add(filters, key, vals);
+    free(key);
+    char *escaped = cld_async_escape(json_object_to_json_string(filters));
+    json_object_put(filters);
+    if (escaped == NULL)
+    {
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+
+    // stopped containers have logs too, unless following.
+    size_t path_len = strlen(escaped) + 64;
+    char *path = (char *)malloc(path_len);
+    if (path == NULL)
+    {
+        free(escaped);
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+    snprintf(path, path_len, "/containers/json?all=%d&filters=%s",
+             session->opts->follow ? 0 : 1, escaped);
+    free(escaped);
+    cld_async_request *req = cld_async_submit(session->async, "GET", path,
+                                              NULL, NULL, &logs_list_done,
+                                              session);
+    free(path);
+    return req == NULL ? ZCLK_RES_ERR_ALLOC_FAILED : ZCLK_RES_SUCCESS;
+}
+
+static void session_tick(cld_async *async, void *cbargs)
+{
+    session_merge((logs_session *)cbargs, false);
+    session_flush(cbargs);
+}
+
+static void session_free(logs_session *session)
+{
+    if (session->jsonl != NULL)
+    {
+        cld_jsonl_free(session->jsonl);
+        free(session->jsonl);
+    }
+    free(session);
+}
+
+zclk_res cld_logs_stream(docker_context *ctx, arraylist *containers,
+                         const char *filter, const cld_logs_opts *opts,
+                         zclk_command_output_handler error_handler)
+{
+    // the sinks make this too large for the stack.
+    logs_session *session = (logs_session *)calloc(1, sizeof(logs_session));
+    if (session == NULL)
+    {
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+    session->opts = opts;
+    session->error_handler = error_handler;
+    if (opts->grep != NULL)
+    {
+        cld_search_init(&session->grep, opts->grep);
+    }
+    if (opts->grep_v != NULL)
+    {
+        cld_search_init(&session->grep_v, opts->grep_v);
+    }
+    if (opts->json_fields != NULL || opts->fields != NULL)
+    {
+        session->jsonl = (cld_jsonl *)malloc(sizeof(cld_jsonl));
+        if (session->jsonl == NULL
+            || !cld_jsonl_init(session->jsonl, opts->json_fields, opts->fields))
+        {
+            free(session->jsonl);
+            free(session);
+            error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING,
+                          "Json fields must be key=value and fields a list of keys.");
+            return ZCLK_RES_ERR_UNKNOWN;
+        }
+    }
+    cld_logs_sink_init(&session->sinks[0], STDOUT_FILENO);
+    cld_logs_sink_init(&session->sinks[1], STDERR_FILENO);
+    size_t len = containers == NULL ? 0 : arraylist_length(containers);
+    session->merge = len > 1 || filter != NULL;
+
+    // anything printed before must come out before the logs.
+    fflush(stdout);
+    fflush(stderr);
+
+    zclk_res res = make_cld_async(&session->async, ctx, 0);
+    if (res != ZCLK_RES_SUCCESS)
+    {
+        session_free(session);
+        return res;
+    }
+    if (arraylist_new(&session->streams, &free_logs_stream) != 0)
+    {
+        free_cld_async(session->async);
+        session_free(session);
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+
+    for (size_t i = 0; i < len; i++)
+    {
+        char *container = (char *)arraylist_get(containers, i);
+        session_add(session, container, container);
+    }
+    if (filter != NULL)
+    {
+        res = session_list(session, filter);
+    }
+
+    if (res == ZCLK_RES_SUCCESS)
+    {
+        if (session->merge)
+        {
+            cld_async_set_tick(session->async, CLD_LOGS_MERGE_TICK_MS,
+                               &session_tick, session);
+        }
+        res = cld_async_run(session->async);
+        while (session->heap_len > 0)
+        {
+            session_merge(session, true);
+        }
+        session_flush(session);
+    }
+
+    len = arraylist_length(session->streams);
+    for (size_t i = 0; i < len; i++)
+    {
+        logs_stream *stream = (logs_stream *)arraylist_get(session->streams, i);
+        if (stream->error != NULL)
+        {
+            char res_str[1024];
+            snprintf(res_str, sizeof(res_str), "Failed to get logs of %s: %s",
+                     stream->name, stream->error);
+            error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING, res_str);
+            res = ZCLK_RES_ERR_UNKNOWN;
+        }
+    }
+
+    free_cld_async(session->async);
+    arraylist_free(session->streams);
+    free(session->heap);
+    session_free(session);
+    return res;
+}
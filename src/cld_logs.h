@@ -0,0 +1,204 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SRC_CLD_LOGS_H_
+#define SRC_CLD_LOGS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <coll_arraylist.h>
+#include "cld_common.h"
+
+/**
+ * Longest line kept whole, longer lines are output in pieces of this size.
+ */
+#define CLD_LOGS_LINE_MAX 16384
+
+/** Stream ids of log lines, as in the docker log frames. */
+#define CLD_LOGS_STDOUT 1
+#define CLD_LOGS_STDERR 2
+
+/**
+ * Receives a log line, without the newline and not NUL terminated. line
+ * points either into the data given to cld_logs_demux_feed, or into the
+ * line buffer of the demuxer, and stays valid until the feed call returns
+ * or the sync function is called.
+ */
+typedef void (*cld_logs_line_fn)(void *args, int stream_id, const char *line,
+                                 size_t len);
+
+/**
+ * Called before the demuxer reuses a line buffer holding a line already
+ * given to the line function, to consume any reference to it.
+ */
+typedef void (*cld_logs_sync_fn)(void *args);
+
+/**
+ * Splits a docker log stream into lines as it is received. Containers
+ * without a TTY send the output in frames with an 8 byte header giving the
+ * stream and the length of the frame, containers with a TTY send the raw
+ * output. The format is detected from the first bytes received.
+ *
+ * Lines complete in the received data are given in place, without a copy.
+ * Only lines split between two receives are assembled in the line buffer
+ * of their stream, so memory use is fixed.
+ */
+typedef struct cld_logs_demux_t
+{
+    int mode;
+    unsigned char header[8];
+    size_t header_len;
+    size_t frame_left;
+    int frame_stream;
+    char line[3][CLD_LOGS_LINE_MAX];
+    size_t line_len[3];
+    bool line_emitted[3];
+    cld_logs_line_fn line_fn;
+    cld_logs_sync_fn sync_fn;
+    void *args;
+} cld_logs_demux;
+
+/**
+ * Initialize a demuxer calling line_fn for every line, and sync_fn (may be
+ * NULL) before reusing a line buffer.
+ */
+void cld_logs_demux_init(cld_logs_demux *demux, cld_logs_line_fn line_fn,
+                         cld_logs_sync_fn sync_fn, void *args);
+
+/** Feed received data, calling the line function for complete lines. */
+void cld_logs_demux_feed(cld_logs_demux *demux, const char *data, size_t len);
+
+/** Output the incomplete last lines, at the end of the stream. */
+void cld_logs_demux_flush(cld_logs_demux *demux);
+
+#define CLD_LOGS_SINK_IOV 1024
+#define CLD_LOGS_SINK_BUF 65536
+
+/**
+ * Writes log output to a file descriptor with batched writev calls.
+ * Slices added with cld_logs_sink_add are referenced, not copied, and must
+ * stay valid until the next flush; slices added with cld_logs_sink_copy are
+ * copied to a staging buffer.
+ */
+typedef struct cld_logs_sink_t
+{
+    int fd;
+    bool failed;
+    int iovcnt;
+    struct cld_logs_iov_t
+    {
+        const char *base;
+        size_t len;
+    } iov[CLD_LOGS_SINK_IOV];
+    size_t buf_len;
+    char buf[CLD_LOGS_SINK_BUF];
+} cld_logs_sink;
+
+/** Initialize a sink writing to fd. */
+void cld_logs_sink_init(cld_logs_sink *sink, int fd);
+
+/** Add a slice to the next write, by reference. */
+void cld_logs_sink_add(cld_logs_sink *sink, const char *data, size_t len);
+
+/** Add a copy of a slice to the next write. */
+void cld_logs_sink_copy(cld_logs_sink *sink, const char *data, size_t len);
+
+/** Write all pending slices. */
+void cld_logs_sink_flush(cld_logs_sink *sink);
+
+/** What to read from the log of a container. */
+typedef struct cld_logs_opts_t
+{
+    bool follow;
+    /** Prefix every line with its RFC3339 timestamp. */
+    bool timestamps;
+    /** Number of lines from the end of the log, -1 for all. */
+    int64_t tail;
+    /** Only lines since/until these times (ns since epoch), 0 if unset. */
+    int64_t since_ns;
+    int64_t until_ns;
+    /** Only lines containing grep and not containing grep_v, if set. */
+    const char *grep;
+    const char *grep_v;
+    /**
+     * Only JSON lines matching these key=value pairs, and only these fields
+     * of JSON lines (comma separated lists), if set. See cld_jsonl.h.
+     */
+    const char *json_fields;
+    const char *fields;
+} cld_logs_opts;
+
+/** Initialize options to read the whole log. */
+void cld_logs_opts_init(cld_logs_opts *opts);
+
+/**
+ * Parse the timestamp at the start of str of at most len chars, in the
+ * RFC3339 format used by docker (e.g. 2020-01-02T15:04:05.123456789Z), into
+ * ns since the epoch. A date alone is also accepted. Returns the number of
+ * characters read, or 0 if str does not start with a timestamp.
+ */
+size_t cld_logs_parse_rfc3339(const char *str, size_t len, int64_t *ns);
+
+/**
+ * Parse a --since/--until time: a unix timestamp (with optional
+ * fraction), an RFC3339 timestamp, or a duration (e.g. 10m, 1h30m, 45s)
+ * before the current time. Returns false if the time is not valid.
+ */
+bool cld_logs_parse_time(const char *str, int64_t *ns);
+
+/**
+ * Parse a --tail value: a number of lines, or "all" (-1).
+ * Returns false if the value is not valid.
+ */
+bool cld_logs_parse_tail(const char *str, int64_t *tail);
+
+/** Lines waiting per container for the merge of several logs. */
+#define CLD_LOGS_MERGE_LINES 256
+
+/**
+ * How long a line waits for lines of the other containers before it is
+ * output anyway, when merging followed logs.
+ */
+#define CLD_LOGS_MERGE_WINDOW_MS 250
+#define CLD_LOGS_MERGE_TICK_MS 50
+
+/**
+ * Stream the logs of the given containers (a list of strings) and of the
+ * containers matching filter ("key=value", may be NULL), writing every
+ * line to stdout (or stderr, for the stderr of the containers) as it is
+ * received. The tail, since and until windows are applied by the daemon,
+ * so only the requested lines are transferred. With follow it runs until
+ * the containers stop.
+ *
+ * The logs of several containers are read concurrently and merged into
+ * one stream ordered by the daemon timestamps of the lines, each line
+ * prefixed with the container name. At most CLD_LOGS_MERGE_LINES lines are
+ * kept per container; when a buffer is full the oldest lines are output
+ * early.
+ */
+zclk_res cld_logs_stream(docker_context *ctx, arraylist *containers,
+                         const char *filter, const cld_logs_opts *opts,
+                         zclk_command_output_handler error_handler);
+
+#endif /* SRC_CLD_LOGS_H_ */
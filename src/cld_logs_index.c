@@ -0,0 +1,286 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cld_logs_index.h"
+
+#ifdef _WIN32
+
+size_t cld_logs_index_seek(const char *log_path, const char *data, size_t len,
+                           uint64_t dev, uint64_t ino, int64_t since_ns,
+                           cld_logs_index_time_fn time_fn)
+{
+    return 0;
+}
+
+#else
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CLD_LOGS_INDEX_MAGIC "CLDLGIDX"
+#define CLD_LOGS_INDEX_VERSION 2
+#define CLD_LOGS_INDEX_HEADER_SIZE 128
+/* at most this many bytes of the first line are fingerprinted */
+#define CLD_LOGS_INDEX_HEAD_MAX 4096
+
+/*
+ * The file header, followed by count records. The log file it indexes is
+ * identified by dev and ino, and by the length and FNV-1a hash of its
+ * first line, which has a timestamp and so changes when the file is
+ * truncated in place and written again. Its first indexed bytes have been
+ * scanned. All values are in host byte order.
+ */
+typedef struct index_header_t
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t stride;
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t head_len;
+    uint64_t head_hash;
+    uint64_t indexed;
+    uint64_t count;
+} index_header;
+
+/* Length and hash of the first line of the log, the bytes up to its newline. */
+static void fingerprint(const char *data, size_t len, uint64_t *head_len,
+                        uint64_t *head_hash)
+{
+    size_t max = len < CLD_LOGS_INDEX_HEAD_MAX ? len : CLD_LOGS_INDEX_HEAD_MAX;
+    const char *nl = (const char *)memchr(data, '\n', max);
+    size_t n = nl == NULL ? max : (size_t)(nl - data);
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < n; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    *head_len = n;
+    *head_hash = hash;
+}
+
+static off_t record_offset(uint64_t i)
+{
+    return (off_t)(CLD_LOGS_INDEX_HEADER_SIZE + i * sizeof(cld_logs_index_record));
+}
+
+static bool write_header(int fd, const index_header *header)
+{
+    char buf[CLD_LOGS_INDEX_HEADER_SIZE];
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, header, sizeof(index_header));
+    return pwrite(fd, buf, sizeof(buf), 0) == (ssize_t)sizeof(buf);
+}
+
+/*
+ * Read the header, or start a new index if the file is not an index of the
+ * log as it is now: the log was rotated, truncated below what was indexed,
+ * or truncated and written again so that its first line changed.
+ */
+static bool read_header(int fd, index_header *header, const char *data,
+                        size_t len, uint64_t dev, uint64_t ino)
+{
+    uint64_t head_len, head_hash;
+    fingerprint(data, len, &head_len, &head_hash);
+    struct stat st;
+    if (fstat(fd, &st) == 0
+        && pread(fd, header, sizeof(index_header), 0)
+               == (ssize_t)sizeof(index_header)
+        && memcmp(header->magic, CLD_LOGS_INDEX_MAGIC, sizeof(header->magic)) == 0
+        && header->version == CLD_LOGS_INDEX_VERSION
+        && header->record_size == sizeof(cld_logs_index_record)
+        && header->stride == CLD_LOGS_INDEX_STRIDE
+        && header->dev == dev && header->ino == ino
+        && header->head_len == head_len && header->head_hash == head_hash
+        && header->indexed <= len
+        && (uint64_t)st.st_size >= (uint64_t)record_offset(header->count))
+    {
+        return true;
+    }
+
+    memset(header, 0, sizeof(index_header));
+    memcpy(header->magic, CLD_LOGS_INDEX_MAGIC, sizeof(header->magic));
+    header->version = CLD_LOGS_INDEX_VERSION;
+    header->record_size = (uint32_t)sizeof(cld_logs_index_record);
+    header->stride = CLD_LOGS_INDEX_STRIDE;
+    header->dev = dev;
+    header->ino = ino;
+    header->head_len = head_len;
+    header->head_hash = head_hash;
+    return ftruncate(fd, 0) == 0 && write_header(fd, header);
+}
+
+/*
+ * Index the lines after the indexed bytes: the first line starting in each
+ * stride of the log. Only those lines are looked at, the others are
+ * skipped over.
+ */
+static bool update(int fd, index_header *header, const char *data, size_t len,
+                   cld_logs_index_time_fn time_fn)
+{
+    if (header->indexed == len)
+    {
+        return true;
+    }
+    uint64_t next = 0;
+    if (header->count > 0)
+    {
+        cld_logs_index_record last;
+        if (pread(fd, &last, sizeof(last), record_offset(header->count - 1))
+            != (ssize_t)sizeof(last))
+        {
+            return false;
+        }
+        next = (last.offset / header->stride + 1) * header->stride;
+    }
+
+    cld_logs_index_record *records = NULL;
+    size_t count = 0;
+    size_t cap = 0;
+    size_t pos = (size_t)header->indexed;
+    while (pos < len)
+    {
+        // the first line starting at or after next.
+        if (next > pos)
+        {
+            const char *nl = next - 1 < len
+                ? (const char *)memchr(data + next - 1, '\n', len - (next - 1))
+                : NULL;
+            if (nl == NULL || (size_t)(nl - data) + 1 >= len)
+            {
+                break;
+            }
+            pos = (size_t)(nl - data) + 1;
+        }
+        const char *end = (const char *)memchr(data + pos, '\n', len - pos);
+        int64_t time_ns = time_fn(data + pos, (size_t)(end - (data + pos)));
+        if (time_ns != 0)
+        {
+            if (count == cap)
+            {
+                cap = cap == 0 ? 64 : cap * 2;
+                cld_logs_index_record *r = (cld_logs_index_record *)realloc(
+                    records, cap * sizeof(cld_logs_index_record));
+                if (r == NULL)
+                {
+                    free(records);
+                    return false;
+                }
+                records = r;
+            }
+            records[count].time_ns = time_ns;
+            records[count].offset = pos;
+            count++;
+        }
+        next = (pos / header->stride + 1) * header->stride;
+        pos = (size_t)(end - data) + 1;
+    }
+
+    size_t size = count * sizeof(cld_logs_index_record);
+    bool ok = size == 0
+              || pwrite(fd, records, size, record_offset(header->count))
+                     == (ssize_t)size;
+    free(records);
+    if (ok)
+    {
+        header->count += count;
+        header->indexed = len;
+        ok = write_header(fd, header);
+    }
+    return ok;
+}
+
+/* Offset of the last record before since_ns, by binary search. */
+static size_t search(const cld_logs_index_record *records, uint64_t count,
+                     int64_t since_ns)
+{
+    uint64_t lo = 0;
+    uint64_t hi = count;
+    while (lo < hi)
+    {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (records[mid].time_ns < since_ns)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo == 0 ? 0 : (size_t)records[lo - 1].offset;
+}
+
+size_t cld_logs_index_seek(const char *log_path, const char *data, size_t len,
+                           uint64_t dev, uint64_t ino, int64_t since_ns,
+                           cld_logs_index_time_fn time_fn)
+{
+    size_t path_len = strlen(log_path) + sizeof(CLD_LOGS_INDEX_SUFFIX);
+    char *path = (char *)malloc(path_len);
+    if (path == NULL)
+    {
+        return 0;
+    }
+    snprintf(path, path_len, "%s%s", log_path, CLD_LOGS_INDEX_SUFFIX);
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    free(path);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    // other runs on the same log would truncate and append to it too.
+    if (flock(fd, LOCK_EX) != 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    index_header header;
+    size_t offset = 0;
+    if (read_header(fd, &header, data, len, dev, ino)
+        && update(fd, &header, data, len, time_fn) && header.count > 0)
+    {
+        size_t map_len = (size_t)record_offset(header.count);
+        void *map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            offset = search((const cld_logs_index_record *)(
+                                (const char *)map + CLD_LOGS_INDEX_HEADER_SIZE),
+                            header.count, since_ns);
+            munmap(map, map_len);
+        }
+    }
+    close(fd);
+    return offset;
+}
+
+#endif
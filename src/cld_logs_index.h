@@ -0,0 +1,67 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SRC_CLD_LOGS_INDEX_H_
+#define SRC_CLD_LOGS_INDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Suffix of the index file, next to the log file. */
+#define CLD_LOGS_INDEX_SUFFIX ".cldidx"
+
+/** A line is indexed about every this many bytes of the log. */
+#define CLD_LOGS_INDEX_STRIDE (256 * 1024)
+
+/**
+ * A record of the index: the offset of the start of a line in the log and
+ * the time of the line. Records are in offset order.
+ */
+typedef struct cld_logs_index_record_t
+{
+    int64_t time_ns;
+    uint64_t offset;
+} cld_logs_index_record;
+
+/** Time of a log line in ns, 0 if it has none. */
+typedef int64_t (*cld_logs_index_time_fn)(const char *line, size_t len);
+
+/**
+ * Find where to start reading the lines at or after since_ns in a log
+ * file, using the sparse index kept next to it (<log_path>.cldidx).
+ *
+ * data holds the len bytes of complete lines of the log, mapped. The index
+ * is brought up to date first, scanning only the lines after the last
+ * indexed offset; it is built again if the log was rotated or truncated,
+ * that is when its device, inode, size or first line no longer match. The
+ * index is locked while it is used, as other runs may update it. The
+ * records are then memory-mapped and binary searched.
+ *
+ * Returns the offset of a line at or before the first line at or after
+ * since_ns, or 0 if the index cannot be used (e.g. it cannot be written).
+ */
+size_t cld_logs_index_seek(const char *log_path, const char *data, size_t len,
+                           uint64_t dev, uint64_t ino, int64_t since_ns,
+                           cld_logs_index_time_fn time_fn);
+
+#endif /* SRC_CLD_LOGS_INDEX_H_ */
@@ -0,0 +1,715 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include "docker_all.h"
+#include "cld_logs_local.h"
+
+#ifdef _WIN32
+
+zclk_res cld_logs_local(const char *data_root, const char *container,
+                        const cld_logs_opts *opts,
+                        zclk_command_output_handler error_handler)
+{
+    error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING,
+                  "Reading local logs is not supported on windows.");
+    return ZCLK_RES_ERR_UNKNOWN;
+}
+
+#else
+
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cld_search.h"
+#include "cld_jsonl.h"
+#include "cld_logs_index.h"
+
+/* A log file mapped in memory. */
+typedef struct local_file_t
+{
+    char *path;
+    int fd;
+    const char *data;
+    size_t size;
+    dev_t dev;
+    ino_t ino;
+} local_file;
+
+/* The envelope of a json-file log line, as raw JSON slices. */
+typedef struct local_entry_t
+{
+    /* contents of the log string, with escapes */
+    const char *log;
+    size_t log_len;
+    int stream_id;
+    const char *time;
+    size_t time_len;
+} local_entry;
+
+typedef struct local_session_t
+{
+    const cld_logs_opts *opts;
+    cld_search grep;
+    cld_search grep_v;
+    cld_jsonl *jsonl;
+    /* decoded log text of lines with escapes */
+    char *buf;
+    size_t buf_cap;
+    /* stdout and stderr, only one has pending output at a time */
+    int last_sink;
+    cld_logs_sink sinks[2];
+} local_session;
+
+static char *path_concat(const char *a, const char *b, const char *c,
+                         const char *d)
+{
+    size_t len = strlen(a) + strlen(b) + strlen(c) + strlen(d) + 1;
+    char *path = (char *)malloc(len);
+    if (path != NULL)
+    {
+        snprintf(path, len, "%s%s%s%s", a, b, c, d);
+    }
+    return path;
+}
+
+/* Check the config of a container for the given name. */
+static bool local_has_name(const char *containers_dir, const char *id,
+                           const char *name)
+{
+    char *path = path_concat(containers_dir, id, "/", "config.v2.json");
+    FILE *fp = path == NULL ? NULL : fopen(path, "rb");
+    free(path);
+    if (fp == NULL)
+    {
+        return false;
+    }
+    char buf[65536];
+    size_t len = fread(buf, 1, sizeof(buf), fp);
+    fclose(fp);
+
+    char *needle = path_concat("\"Name\":\"/", name, "\"", "");
+    if (needle == NULL)
+    {
+        return false;
+    }
+    cld_search search;
+    cld_search_init(&search, needle);
+    bool found = cld_search_match(&search, buf, len);
+    free(needle);
+    return found;
+}
+
+/*
+ * Find the id of a container from an id, an id prefix or a name, by the
+ * directories under containers_dir. Returns NULL and sets err if it is not
+ * found or not unique.
+ */
+static char *local_resolve(const char *containers_dir, const char *container,
+                           const char **err)
+{
+    DIR *dir = opendir(containers_dir);
+    if (dir == NULL)
+    {
+        *err = strerror(errno);
+        return NULL;
+    }
+    size_t len = strlen(container);
+    char *prefix_match = NULL;
+    char *name_match = NULL;
+    bool ambiguous = false;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        const char *id = entry->d_name;
+        if (id[0] == '.')
+        {
+            continue;
+        }
+        if (strncmp(id, container, len) == 0)
+        {
+            ambiguous = ambiguous || prefix_match != NULL;
+            free(prefix_match);
+            prefix_match = str_clone(id);
+        }
+        else if (name_match == NULL
+                 && local_has_name(containers_dir, id, container))
+        {
+            name_match = str_clone(id);
+        }
+    }
+    closedir(dir);
+
+    // names take precedence over id prefixes, as for the daemon.
+    if (name_match != NULL)
+    {
+        free(prefix_match);
+        return name_match;
+    }
+    if (ambiguous)
+    {
+        free(prefix_match);
+        *err = "more than one container has this id prefix";
+        return NULL;
+    }
+    if (prefix_match == NULL)
+    {
+        *err = "no such container";
+    }
+    return prefix_match;
+}
+
+static void local_unmap(local_file *file)
+{
+    if (file->data != NULL)
+    {
+        munmap((void *)file->data, file->size);
+        file->data = NULL;
+    }
+    file->size = 0;
+}
+
+static void local_close(local_file *file)
+{
+    local_unmap(file);
+    if (file->fd >= 0)
+    {
+        close(file->fd);
+        file->fd = -1;
+    }
+}
+
+static bool local_open(local_file *file)
+{
+    file->fd = open(file->path, O_RDONLY);
+    if (file->fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(file->fd, &st) != 0)
+    {
+        local_close(file);
+        return false;
+    }
+    file->dev = st.st_dev;
+    file->ino = st.st_ino;
+    return true;
+}
+
+/* Map the whole file as it is now, again if it grew. */
+static bool local_map(local_file *file)
+{
+    struct stat st;
+    if (fstat(file->fd, &st) != 0)
+    {
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    if (file->data != NULL && size == file->size)
+    {
+        return true;
+    }
+    local_unmap(file);
+    if (size == 0)
+    {
+        return true;
+    }
+    void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, file->fd, 0);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+    // lines are read in order, once.
+    madvise(data, size, MADV_SEQUENTIAL);
+    file->data = (const char *)data;
+    file->size = size;
+    return true;
+}
+
+/* End of the JSON string starting at p, after its opening quote. */
+static const char *string_end(const char *p, const char *end)
+{
+    for (;;)
+    {
+        const char *quote = (const char *)memchr(p, '"', (size_t)(end - p));
+        if (quote == NULL)
+        {
+            return NULL;
+        }
+        const char *b = quote;
+        while (b > p && b[-1] == '\\')
+        {
+            b--;
+        }
+        if ((quote - b) % 2 == 0)
+        {
+            return quote;
+        }
+        p = quote + 1;
+    }
+}
+
+/* Match a literal at p, advancing p past it. */
+static bool expect(const char **p, const char *end, const char *lit,
+                   size_t len)
+{
+    if ((size_t)(end - *p) < len || memcmp(*p, lit, len) != 0)
+    {
+        return false;
+    }
+    *p += len;
+    return true;
+}
+
+#define LIT(s) s, sizeof(s) - 1
+
+/*
+ * Decode the envelope of a line. The daemon writes the keys in the order
+ * log, stream, time, which is matched directly; anything else goes through
+ * the generic scanner.
+ */
+static bool local_decode(const char *line, size_t len, local_entry *entry)
+{
+    const char *end = line + len;
+    const char *p = line;
+    if (expect(&p, end, LIT("{\"log\":\"")))
+    {
+        const char *log_end = string_end(p, end);
+        if (log_end != NULL)
+        {
+            entry->log = p;
+            entry->log_len = (size_t)(log_end - p);
+            p = log_end + 1;
+            if (expect(&p, end, LIT(",\"stream\":\"stdout\"")))
+            {
+                entry->stream_id = CLD_LOGS_STDOUT;
+            }
+            else if (expect(&p, end, LIT(",\"stream\":\"stderr\"")))
+            {
+                entry->stream_id = CLD_LOGS_STDERR;
+            }
+            else
+            {
+                p = NULL;
+            }
+            if (p != NULL && expect(&p, end, LIT(",\"time\":\"")))
+            {
+                const char *time_end = (const char *)memchr(p, '"',
+                                                            (size_t)(end - p));
+                if (time_end != NULL && time_end + 1 < end && time_end[1] == '}')
+                {
+                    entry->time = p;
+                    entry->time_len = (size_t)(time_end - p);
+                    return true;
+                }
+            }
+        }
+    }
+
+    static const cld_jsonl_field fields[] = {
+        {"log", 3, NULL, 0},
+        {"stream", 6, NULL, 0},
+        {"time", 4, NULL, 0}
+    };
+    const char *values[3];
+    size_t values_len[3];
+    if (!cld_jsonl_scan(line, len, fields, 3, values, values_len)
+        || values[0] == NULL || values_len[0] < 2 || values[0][0] != '"')
+    {
+        return false;
+    }
+    entry->log = values[0] + 1;
+    entry->log_len = values_len[0] - 2;
+    entry->stream_id = values[1] != NULL && values_len[1] == 8
+                       && memcmp(values[1], "\"stderr\"", 8) == 0
+                       ? CLD_LOGS_STDERR : CLD_LOGS_STDOUT;
+    entry->time = NULL;
+    entry->time_len = 0;
+    if (values[2] != NULL && values_len[2] >= 2)
+    {
+        entry->time = values[2] + 1;
+        entry->time_len = values_len[2] - 2;
+    }
+    return true;
+}
+
+/* Time of an entry in ns, 0 if it has none. */
+static int64_t entry_time(const local_entry *entry)
+{
+    int64_t ns;
+    if (entry->time == NULL
+        || cld_logs_parse_rfc3339(entry->time, entry->time_len, &ns) == 0)
+    {
+        return 0;
+    }
+    return ns;
+}
+
+/*
+ * Output a line of the file. Returns false once a line after the until time
+ * is reached.
+ */
+static bool local_line(local_session *session, const char *line, size_t len)
+{
+    static const char newline = '\n';
+    static const char space = ' ';
+    const cld_logs_opts *opts = session->opts;
+    local_entry entry;
+    if (!local_decode(line, len, &entry))
+    {
+        return true;
+    }
+    if (opts->since_ns > 0 || opts->until_ns > 0)
+    {
+        int64_t ns = entry_time(&entry);
+        if (opts->until_ns > 0 && ns > opts->until_ns)
+        {
+            return false;
+        }
+        if (ns < opts->since_ns)
+        {
+            return true;
+        }
+    }
+
+    // the log text ends with the newline of the line, unless it is partial.
+    const char *text = entry.log;
+    size_t text_len = entry.log_len;
+    bool has_newline = false;
+    if (text_len >= 2 && text[text_len - 1] == 'n' && text[text_len - 2] == '\\')
+    {
+        size_t b = text_len - 2;
+        while (b > 0 && text[b - 1] == '\\')
+        {
+            b--;
+        }
+        if ((text_len - 1 - b) % 2 == 1)
+        {
+            has_newline = true;
+            text_len -= 2;
+        }
+    }
+    bool copy = false;
+    if (memchr(text, '\\', text_len) != NULL)
+    {
+        if (text_len > session->buf_cap)
+        {
+            char *buf = (char *)realloc(session->buf, text_len);
+            if (buf == NULL)
+            {
+                return true;
+            }
+            session->buf = buf;
+            session->buf_cap = text_len;
+        }
+        text_len = cld_jsonl_unescape(text, text_len, session->buf);
+        text = session->buf;
+        copy = true;
+    }
+
+    if ((session->grep.needle != NULL
+         && !cld_search_match(&session->grep, text, text_len))
+        || (session->grep_v.needle != NULL
+            && cld_search_match(&session->grep_v, text, text_len)))
+    {
+        return true;
+    }
+    if (session->jsonl != NULL)
+    {
+        const char *out;
+        if (!cld_jsonl_apply(session->jsonl, text, text_len, 0, &out,
+                             &text_len))
+        {
+            return true;
+        }
+        copy = copy || out != text;
+        text = out;
+    }
+
+    // keep the order of stdout and stderr lines.
+    int index = entry.stream_id == CLD_LOGS_STDERR ? 1 : 0;
+    if (index != session->last_sink)
+    {
+        cld_logs_sink_flush(&session->sinks[session->last_sink]);
+        session->last_sink = index;
+    }
+    cld_logs_sink *sink = &session->sinks[index];
+    if (opts->timestamps && entry.time != NULL)
+    {
+        cld_logs_sink_add(sink, entry.time, entry.time_len);
+        cld_logs_sink_add(sink, &space, 1);
+    }
+    if (copy)
+    {
+        cld_logs_sink_copy(sink, text, text_len);
+    }
+    else
+    {
+        cld_logs_sink_add(sink, text, text_len);
+    }
+    if (has_newline)
+    {
+        cld_logs_sink_add(sink, &newline, 1);
+    }
+    return true;
+}
+
+/*
+ * Offset of the first of the last tail lines of the complete lines in the
+ * len bytes at data, found scanning backwards from the end.
+ */
+static size_t local_tail_start(const char *data, size_t len, int64_t tail)
+{
+    size_t pos = len;
+    for (int64_t i = 0; i < tail && pos > 0; i++)
+    {
+        // pos - 1 is the newline ending the line, find the one before.
+        const char *nl = cld_search_rchr(data, '\n', pos - 1);
+        pos = nl == NULL ? 0 : (size_t)(nl - data) + 1;
+    }
+    return pos;
+}
+
+/* Time of a line of the file, for the index. */
+static int64_t local_line_time(const char *line, size_t len)
+{
+    local_entry entry;
+    return local_decode(line, len, &entry) ? entry_time(&entry) : 0;
+}
+
+/*
+ * Offset of the first complete line at or after the since time, scanning
+ * from the line the index points to.
+ */
+static size_t local_since_start(const local_file *file, size_t len,
+                                int64_t since_ns)
+{
+    const char *data = file->data;
+    size_t pos = cld_logs_index_seek(file->path, data, len,
+                                     (uint64_t)file->dev, (uint64_t)file->ino,
+                                     since_ns, &local_line_time);
+    while (pos < len)
+    {
+        const char *nl = (const char *)memchr(data + pos, '\n', len - pos);
+        local_entry entry;
+        if (local_decode(data + pos, (size_t)(nl - (data + pos)), &entry)
+            && entry_time(&entry) >= since_ns)
+        {
+            break;
+        }
+        pos = (size_t)(nl - data) + 1;
+    }
+    return pos;
+}
+
+/* Length of the complete lines of the file, up to its last newline. */
+static size_t local_complete(const local_file *file, size_t from)
+{
+    if (file->size <= from)
+    {
+        return from;
+    }
+    const char *nl = cld_search_rchr(file->data + from, '\n', file->size - from);
+    return nl == NULL ? from : (size_t)(nl - file->data) + 1;
+}
+
+/*
+ * Output the complete lines from *pos on, moving *pos past them. Returns
+ * false once the until time is reached.
+ */
+static bool local_lines(local_session *session, const local_file *file,
+                        size_t *pos)
+{
+    size_t end = local_complete(file, *pos);
+    bool more = true;
+    while (*pos < end && more)
+    {
+        const char *line = file->data + *pos;
+        const char *nl = (const char *)memchr(line, '\n', end - *pos);
+        more = local_line(session, line, (size_t)(nl - line));
+        *pos = (size_t)(nl - file->data) + 1;
+    }
+    // the lines reference the mapping.
+    cld_logs_sink_flush(&session->sinks[0]);
+    cld_logs_sink_flush(&session->sinks[1]);
+    return more;
+}
+
+/*
+ * Wait for the file to grow or be rotated. The lines appended to a rotated
+ * file since it was last mapped are output before the new file is opened
+ * and read from its start. If the new file is not created yet, it is
+ * opened again on the next wait. Returns false once the until time is
+ * reached or the file cannot be read.
+ */
+static bool local_wait(local_session *session, local_file *file, size_t *pos)
+{
+    struct timespec ts;
+    ts.tv_sec = CLD_LOGS_LOCAL_POLL_MS / 1000;
+    ts.tv_nsec = (CLD_LOGS_LOCAL_POLL_MS % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+
+    struct stat st;
+    bool exists = stat(file->path, &st) == 0;
+    if (file->fd >= 0 && exists
+        && (st.st_ino != file->ino || st.st_dev != file->dev))
+    {
+        if (!local_map(file) || !local_lines(session, file, pos))
+        {
+            return false;
+        }
+        local_close(file);
+    }
+    if (file->fd < 0)
+    {
+        if (!exists || !local_open(file))
+        {
+            return true;
+        }
+        *pos = 0;
+    }
+    if (!local_map(file))
+    {
+        return false;
+    }
+    // truncated in place.
+    if (file->size < *pos)
+    {
+        *pos = 0;
+    }
+    return true;
+}
+
+zclk_res cld_logs_local(const char *data_root, const char *container,
+                        const cld_logs_opts *opts,
+                        zclk_command_output_handler error_handler)
+{
+    char res_str[1024];
+    const char *err = NULL;
+    char *containers_dir = path_concat(data_root, "/containers/", "", "");
+    char *id = containers_dir == NULL ? NULL
+               : local_resolve(containers_dir, container, &err);
+    if (id == NULL)
+    {
+        snprintf(res_str, sizeof(res_str), "Failed to get logs of %s: %s",
+                 container, err == NULL ? "out of memory" : err);
+        error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING, res_str);
+        free(containers_dir);
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+
+    local_file file;
+    memset(&file, 0, sizeof(local_file));
+    file.fd = -1;
+    file.path = path_concat(containers_dir, id, "/", id);
+    free(containers_dir);
+    free(id);
+    char *path = file.path == NULL ? NULL
+                 : path_concat(file.path, "-json.log", "", "");
+    free(file.path);
+    file.path = path;
+    if (file.path == NULL || !local_open(&file) || !local_map(&file))
+    {
+        snprintf(res_str, sizeof(res_str), "Failed to read logs of %s: %s",
+                 container, strerror(errno));
+        error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING, res_str);
+        local_close(&file);
+        free(file.path);
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+
+    // the sinks make this too large for the stack.
+    local_session *session = (local_session *)calloc(1, sizeof(local_session));
+    if (session == NULL)
+    {
+        local_close(&file);
+        free(file.path);
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+    session->opts = opts;
+    if (opts->grep != NULL)
+    {
+        cld_search_init(&session->grep, opts->grep);
+    }
+    if (opts->grep_v != NULL)
+    {
+        cld_search_init(&session->grep_v, opts->grep_v);
+    }
+    zclk_res res = ZCLK_RES_SUCCESS;
+    if (opts->json_fields != NULL || opts->fields != NULL)
+    {
+        session->jsonl = (cld_jsonl *)malloc(sizeof(cld_jsonl));
+        if (session->jsonl == NULL
+            || !cld_jsonl_init(session->jsonl, opts->json_fields, opts->fields))
+        {
+            free(session->jsonl);
+            session->jsonl = NULL;
+            error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING,
+                          "Json fields must be key=value and fields a list of keys.");
+            res = ZCLK_RES_ERR_UNKNOWN;
+        }
+    }
+    fflush(stdout);
+    fflush(stderr);
+    cld_logs_sink_init(&session->sinks[0], STDOUT_FILENO);
+    cld_logs_sink_init(&session->sinks[1], STDERR_FILENO);
+
+    if (res == ZCLK_RES_SUCCESS)
+    {
+        size_t pos = 0;
+        size_t end = local_complete(&file, 0);
+        if (opts->since_ns > 0)
+        {
+            pos = local_since_start(&file, end, opts->since_ns);
+        }
+        if (opts->tail >= 0)
+        {
+            size_t tail_pos = local_tail_start(file.data, end, opts->tail);
+            pos = tail_pos > pos ? tail_pos : pos;
+        }
+        while (local_lines(session, &file, &pos) && opts->follow
+               && local_wait(session, &file, &pos))
+        {
+        }
+    }
+
+    if (session->jsonl != NULL)
+    {
+        cld_jsonl_free(session->jsonl);
+        free(session->jsonl);
+    }
+    free(session->buf);
+    free(session);
+    local_close(&file);
+    free(file.path);
+    return res;
+}
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SRC_CLD_LOGS_LOCAL_H_
+#define SRC_CLD_LOGS_LOCAL_H_
+
+#include "cld_common.h"
+#include "cld_logs.h"
+
+/** Default docker data root, holding containers/<id>/<id>-json.log. */
+#define CLD_LOGS_DATA_ROOT "/var/lib/docker"
+
+/** How often a followed log file is checked for new lines. */
+#define CLD_LOGS_LOCAL_POLL_MS 250
+
+/**
+ * Read the log of a container directly from the file of the json-file
+ * logging driver under data_root, for when cld runs on the docker host.
+ * container is an id, an id prefix or a name (looked up in the
+ * config.v2.json of the containers).
+ *
+ * The file is memory-mapped and split into lines with vectorized newline
+ * search. The {"log":..,"stream":..,"time":..} envelope of every line is
+ * decoded without building JSON objects, and log text without escapes is
+ * written straight from the mapping. --tail finds its start scanning
+ * backwards from the end of the file, so only the requested lines are
+ * read. --since starts from the sparse timestamp index kept next to the
+ * log file (see cld_logs_index.h). All the other options of cld_logs_opts apply as for
+ * cld_logs_stream, with follow polling the file for new lines and
+ * rotation.
+ */
+zclk_res cld_logs_local(const char *data_root, const char *container,
+                        const cld_logs_opts *opts,
+                        zclk_command_output_handler error_handler);
+
+#endif /* SRC_CLD_LOGS_LOCAL_H_ */
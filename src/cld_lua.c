@@ -25,8 +25,25 @@
 #include <docker_log.h>
 #include "lua_docker.h"
 #include <json-c/json_object.h>
+#include <stdlib.h>
+#include <string.h>
 
-static lua_State *L;
+#ifdef CLD_LUA_EMBEDDED
+#include "cld_lua_embedded.h"
+#endif
+
+#if LUA_VERSION_NUM < 502
+#define lua_rawlen lua_objlen
+#define CLD_LUA_SEARCHERS "loaders"
+#else
+#define CLD_LUA_SEARCHERS "searchers"
+#endif
+
+static lua_State *L = NULL;
+
+// docker context to bind to the interpreter, see lua_set_docker_context.
+static docker_context *lua_ctx = NULL;
+static int lua_loglevel;
 
 // https://stackoverflow.com/questions/56230859/how-to-properly-print-error-messages-from-lual-dostring
 bool doString(const char *s)
@@ -43,12 +60,104 @@ bool doString(const char *s)
     return true;
 }
 
+#ifdef CLD_LUA_EMBEDDED
+/**
+ * package.searchers entry which loads the bundled cld modules from the
+ * bytecode linked into the executable.
+ */
+static int embedded_searcher(lua_State *L)
+{
+    const char *name = luaL_checkstring(L, 1);
+    for (const cld_lua_embedded_module *m = cld_lua_embedded_modules; m->name != NULL; m++)
+    {
+        if (strcmp(m->name, name) == 0)
+        {
+            if (luaL_loadbuffer(L, (const char *)m->chunk, m->len, m->name) != LUA_OK)
+            {
+                return luaL_error(L, "error loading embedded module '%s':\n\t%s",
+                                  name, lua_tostring(L, -1));
+            }
+            lua_pushstring(L, ":embedded:");
+            return 2;
+        }
+    }
+    lua_pushfstring(L, "\n\tno embedded module '%s'", name);
+    return 1;
+}
+
+/**
+ * Register the embedded searcher right after the preload searcher, so the
+ * bundled modules never touch the filesystem. Other modules are still
+ * looked up on package.path/package.cpath.
+ *
+ * When CLD_LUA_PATH_ENV names a directory, it is searched first and the
+ * embedded modules are used only as a fallback (to develop or override
+ * the bundled modules without rebuilding cld).
+ */
+static void register_embedded_searcher()
+{
+    char *override_dir = getenv(CLD_LUA_PATH_ENV);
+    int pos = 2;
+
+    lua_getglobal(L, "package");
+    if (override_dir != NULL && override_dir[0] != '\0')
+    {
+        lua_getfield(L, -1, "path");
+        lua_pushfstring(L, "%s/?.lua;%s", override_dir, lua_tostring(L, -1));
+        lua_setfield(L, -3, "path");
+        lua_pop(L, 1);
+    }
+
+    lua_getfield(L, -1, CLD_LUA_SEARCHERS);
+    int len = (int)lua_rawlen(L, -1);
+    if (override_dir != NULL && override_dir[0] != '\0')
+    {
+        pos = len + 1;
+    }
+    for (int i = len; i >= pos; i--)
+    {
+        lua_rawgeti(L, -1, i);
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_pushcfunction(L, &embedded_searcher);
+    lua_rawseti(L, -2, pos);
+    lua_pop(L, 2);
+}
+#endif
+
+static void bind_docker_context()
+{
+    docker_log_debug("Setting docker context");
+    DockerClient_from_context(L, lua_ctx);
+    lua_setglobal(L, "d");
+
+    char *cmdStr = (char *)calloc(1024, sizeof(char));
+    if (cmdStr != NULL)
+    {
+        sprintf(cmdStr, "d:set_loglevel(%d)", lua_loglevel);
+        luaL_dostring(L, cmdStr);
+        free(cmdStr);
+    }
+
+    // create CLD instance
+    doString("cld = CLD:new(d)");
+}
+
 zclk_res start_lua_interpreter()
 {
+    if (L != NULL)
+    {
+        return ZCLK_RES_SUCCESS;
+    }
+
     docker_log_debug("Starting LUA interpreter...\n");
     L = luaL_newstate();
     luaL_openlibs(L);
 
+#ifdef CLD_LUA_EMBEDDED
+    register_embedded_searcher();
+#endif
+
     // Load the cld_cmd library
     doString("CLD = require('cld')");
 
@@ -58,33 +167,39 @@ zclk_res start_lua_interpreter()
     // execute a dummy command to ensure all is well.
     // execute_lua_command("ctr", "dummy", NULL, NULL, NULL, NULL, NULL);
 
+    if (lua_ctx != NULL)
+    {
+        bind_docker_context();
+    }
+
     return ZCLK_RES_SUCCESS;
 }
 
 zclk_res lua_set_docker_context(docker_context *ctx, int loglevel)
 {
-    docker_log_debug("Setting docker context");
-    DockerClient_from_context(L, ctx);
-    lua_setglobal(L, "d");
+    lua_ctx = ctx;
+    lua_loglevel = loglevel;
 
-    char *cmdStr = (char *)calloc(1024, sizeof(char));
-    if (cmdStr != NULL)
+    // bound now only if the interpreter is already running, otherwise
+    // when it is started.
+    if (L != NULL)
     {
-        sprintf(cmdStr, "d:set_loglevel(%d)", loglevel);
-        luaL_dostring(L, cmdStr);
-        free(cmdStr);
+        bind_docker_context();
     }
 
-    // create CLD instance
-    doString("cld = CLD:new(d)");
-
     return ZCLK_RES_SUCCESS;
 }
 
 zclk_res stop_lua_interpreter()
 {
+    if (L == NULL)
+    {
+        return ZCLK_RES_SUCCESS;
+    }
+
     docker_log_debug("Stopping LUA interpreter...\n");
     lua_close(L);
+    L = NULL;
 
     return ZCLK_RES_SUCCESS;
 }
@@ -97,6 +212,9 @@ zclk_res execute_lua_command(json_object **res, const char *module_name, const c
                                 arraylist *options, arraylist *args, zclk_command_output_handler success_handler,
                                 zclk_command_output_handler error_handler)
 {
+    // the interpreter is only started by the first lua command.
+    start_lua_interpreter();
+
     // function name is cld:run(module, command, options, args)
     lua_getglobal(L, "cld");
     lua_getfield(L, -1, "run");
@@ -34,8 +34,24 @@ extern "C"
 #include <lauxlib.h>
 #include <zclk.h>
 
+/**
+ * Environment variable naming a directory of lua modules which take
+ * precedence over the modules embedded in the cld executable.
+ */
+#define CLD_LUA_PATH_ENV "CLD_LUA_PATH"
+
+/**
+ * Start the lua interpreter and load the cld modules, if not already
+ * running. This is done on demand by execute_lua_command, calling it
+ * explicitly only pre-loads the interpreter.
+ */
 zclk_res start_lua_interpreter();
 
+/**
+ * Set the docker context used by lua commands. The context is bound to the
+ * interpreter (as the global 'd' and the 'cld' instance) immediately if the
+ * interpreter is running, or when it is started.
+ */
 zclk_res lua_set_docker_context(docker_context *ctx, int loglevel);
 
 zclk_res stop_lua_interpreter();
@@ -0,0 +1,43 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SRC_CLD_LUA_EMBEDDED_H_
+#define SRC_CLD_LUA_EMBEDDED_H_
+
+#include <stddef.h>
+
+/**
+ * A lua module precompiled to bytecode at build time (see
+ * tools/cld_luaembed.c).
+ */
+typedef struct cld_lua_embedded_module_t
+{
+    const char *name;
+    const unsigned char *chunk;
+    size_t len;
+} cld_lua_embedded_module;
+
+/** All embedded modules, terminated by an entry with a NULL name. */
+extern const cld_lua_embedded_module cld_lua_embedded_modules[];
+
+#endif /* SRC_CLD_LUA_EMBEDDED_H_ */
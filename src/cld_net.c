@@ -24,6 +24,7 @@
 #include "zclk_table.h"
 #include "docker_all.h"
 #include "cld_vol.h"
+#include "cld_format.h"
 
 zclk_res net_ls_cmd_handler(zclk_command* cmd, void *handler_args)
 {
@@ -31,9 +32,30 @@ zclk_res net_ls_cmd_handler(zclk_command* cmd, void *handler_args)
 	docker_context *ctx = get_docker_context(handler_args);
 	docker_network_list *networks;
 
+	char *format = zclk_option_get_val_string(get_option_by_name(cmd->options,
+		CLD_OPTION_LONG_FORMAT));
+
 	d_err_t docker_error = docker_networks_list(ctx, &networks, NULL,
 												NULL, NULL, NULL, NULL, NULL);
-	if (docker_error == E_SUCCESS)
+	if (docker_error == E_SUCCESS && format != NULL)
+	{
+		json_object *rows = json_object_new_array();
+		size_t len_networks = docker_network_list_length(networks);
+		for (size_t i = 0; i < len_networks; i++)
+		{
+			docker_network *net = (docker_network *)docker_network_list_get_idx(networks, i);
+			json_object *row = json_object_new_object();
+			cld_format_row_add(row, "ID", docker_network_id_get(net));
+			cld_format_row_add(row, "Name", docker_network_name_get(net));
+			cld_format_row_add(row, "Driver", docker_network_driver_get(net));
+			cld_format_row_add(row, "Scope", docker_network_scope_get(net));
+			json_object_array_add(rows, row);
+		}
+		zclk_res err = cld_format_output(cmd, format, rows);
+		json_object_put(rows);
+		return err;
+	}
+	else if (docker_error == E_SUCCESS)
 	{
 		char res_str[1024];
 		sprintf(res_str, "Listing networks");
@@ -88,6 +110,8 @@ zclk_command *net_commands()
 					"Docker Networks List", &net_ls_cmd_handler);
 		if(netls_command != NULL)
 		{
+			zclk_command_string_option(netls_command, CLD_OPTION_LONG_FORMAT,
+				NULL, NULL, "Pretty-print networks using a template (e.g. \"{{.ID}}\\t{{.Name}}\")");
 			zclk_command_subcommand_add(net_command, netls_command);
 		}
 	}
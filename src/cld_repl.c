@@ -0,0 +1,415 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <docker_log.h>
+#include "cld_repl.h"
+#include "histedit.h"
+
+#ifdef _WIN32
+#include <io.h>
+#define isatty _isatty
+#define fileno _fileno
+#else
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+#define CLD_LINE_BUF_LEN 4096
+
+/**
+ * Read one line from the stream (without the trailing newline), growing the
+ * buffer as needed. Returns the line length, or -1 at end of input.
+ */
+static long read_line(FILE *in, char **buf, size_t *buf_len)
+{
+    size_t len = 0;
+    if (*buf == NULL)
+    {
+        *buf_len = CLD_LINE_BUF_LEN;
+        *buf = (char *)calloc(*buf_len, sizeof(char));
+        if (*buf == NULL)
+        {
+            return -1;
+        }
+    }
+
+    while (fgets(*buf + len, (int)(*buf_len - len), in) != NULL)
+    {
+        len += strlen(*buf + len);
+        if (len > 0 && (*buf)[len - 1] == '\n')
+        {
+            (*buf)[--len] = '\0';
+            if (len > 0 && (*buf)[len - 1] == '\r')
+            {
+                (*buf)[--len] = '\0';
+            }
+            return (long)len;
+        }
+        if (len + 1 == *buf_len)
+        {
+            char *bigger = (char *)realloc(*buf, *buf_len * 2);
+            if (bigger == NULL)
+            {
+                return -1;
+            }
+            *buf = bigger;
+            *buf_len *= 2;
+        }
+    }
+    return len > 0 ? (long)len : -1;
+}
+
+/**
+ * Tokenize one command line into a new argv, argv[0] being the main command
+ * name. The words point into the tokenizer, which must not be reset before
+ * argv is used. Empty lines and comments give argc == 0.
+ *
+ * Returns 0 on success, 1 if the line is incomplete (an open quote), and -1
+ * on errors.
+ */
+static int tokenize_line(Tokenizer *tok, const char *line, const char *main_command_name,
+                         int *argc, char ***argv)
+{
+    int tok_argc;
+    const char **tok_argv;
+
+    *argc = 0;
+    *argv = NULL;
+    int err = tok_str(tok, line, &tok_argc, &tok_argv);
+    if (err > 0)
+    {
+        return 1;
+    }
+    if (err < 0)
+    {
+        docker_log_error("Unable to parse command line.\n");
+        return -1;
+    }
+
+    if (tok_argc > 0 && tok_argv[0][0] != '#')
+    {
+        *argv = (char **)calloc(tok_argc + 2, sizeof(char *));
+        if (*argv == NULL)
+        {
+            return -1;
+        }
+        (*argv)[0] = (char *)main_command_name;
+        for (int i = 0; i < tok_argc; i++)
+        {
+            (*argv)[i + 1] = (char *)tok_argv[i];
+        }
+        *argc = tok_argc + 1;
+    }
+    return 0;
+}
+
+/**
+ * Tokenize one command line and run it.
+ * Returns 1 if the line is incomplete (an open quote), 0 otherwise.
+ */
+static int run_line(Tokenizer *tok, const char *line, const char *main_command_name,
+                    cld_command_exec_fn exec_fn, void *exec_args, zclk_res *res)
+{
+    int argc;
+    char **argv;
+
+    *res = ZCLK_RES_SUCCESS;
+    int err = tokenize_line(tok, line, main_command_name, &argc, &argv);
+    if (err == 1)
+    {
+        return 1;
+    }
+    if (err < 0)
+    {
+        *res = ZCLK_RES_ERR_UNKNOWN;
+    }
+    else if (argc > 0)
+    {
+        *res = exec_fn(argc, argv, exec_args);
+    }
+    free(argv);
+    tok_reset(tok);
+    return 0;
+}
+
+zclk_res cld_repl(const char *main_command_name, cld_command_exec_fn exec_fn,
+                  void *exec_args)
+{
+    Tokenizer *tok = tok_init(NULL);
+    if (tok == NULL)
+    {
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+
+    bool interactive = isatty(fileno(stdin));
+    char *line = NULL;
+    size_t line_len = 0;
+    bool incomplete = false;
+    zclk_res res;
+
+    while (true)
+    {
+        if (interactive)
+        {
+            fputs(incomplete ? CLD_REPL_CONT_PROMPT : CLD_REPL_PROMPT, stdout);
+            fflush(stdout);
+        }
+        if (read_line(stdin, &line, &line_len) < 0)
+        {
+            break;
+        }
+
+        if (!incomplete && (strcmp(line, "exit") == 0 || strcmp(line, "quit") == 0))
+        {
+            break;
+        }
+
+        // the tokenizer keeps the words of an incomplete line, the
+        // continuation is parsed on top of them.
+        incomplete = run_line(tok, line, main_command_name, exec_fn, exec_args, &res) == 1;
+        fflush(stdout);
+    }
+
+    if (interactive)
+    {
+        fputs("\n", stdout);
+    }
+    free(line);
+    tok_end(tok);
+    return ZCLK_RES_SUCCESS;
+}
+
+#ifndef _WIN32
+
+typedef struct batch_job_t
+{
+    pid_t pid;
+    size_t line_num;
+    FILE *out;
+} batch_job;
+
+/**
+ * Wait for one running job, copy its captured output to stdout, and free
+ * its slot. Returns the number of failed jobs (0 or 1).
+ */
+static int batch_reap(batch_job *jobs, int parallel, int *running)
+{
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0)
+    {
+        *running = 0;
+        return 0;
+    }
+
+    for (int i = 0; i < parallel; i++)
+    {
+        if (jobs[i].pid == pid)
+        {
+            char buf[CLD_LINE_BUF_LEN];
+            size_t len;
+            fflush(stdout);
+            rewind(jobs[i].out);
+            while ((len = fread(buf, 1, sizeof(buf), jobs[i].out)) > 0)
+            {
+                fwrite(buf, 1, len, stdout);
+            }
+            fflush(stdout);
+            fclose(jobs[i].out);
+            jobs[i].pid = 0;
+            jobs[i].out = NULL;
+            *running -= 1;
+
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            {
+                docker_log_error("Batch line %zu failed.\n", jobs[i].line_num);
+                return 1;
+            }
+            return 0;
+        }
+    }
+    return 0;
+}
+
+static int batch_start(batch_job *jobs, int parallel, int *running, size_t line_num,
+                       int argc, char *argv[], cld_command_exec_fn exec_fn, void *exec_args)
+{
+    int slot = 0;
+    while (jobs[slot].pid != 0)
+    {
+        slot++;
+    }
+
+    FILE *out = tmpfile();
+    if (out == NULL)
+    {
+        return -1;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        dup2(fileno(out), STDOUT_FILENO);
+        dup2(fileno(out), STDERR_FILENO);
+        zclk_res res = exec_fn(argc, argv, exec_args);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(res == ZCLK_RES_SUCCESS ? 0 : 1);
+    }
+    if (pid < 0)
+    {
+        fclose(out);
+        return -1;
+    }
+
+    jobs[slot].pid = pid;
+    jobs[slot].line_num = line_num;
+    jobs[slot].out = out;
+    *running += 1;
+    return 0;
+}
+
+#endif // _WIN32
+
+zclk_res cld_batch(const char *path, int parallel, const char *main_command_name,
+                   cld_command_exec_fn exec_fn, void *exec_args)
+{
+    FILE *in = stdin;
+    if (strcmp(path, "-") != 0)
+    {
+        in = fopen(path, "r");
+        if (in == NULL)
+        {
+            docker_log_error("Unable to open batch file %s\n", path);
+            return ZCLK_RES_ERR_UNKNOWN;
+        }
+    }
+
+    Tokenizer *tok = tok_init(NULL);
+    if (tok == NULL)
+    {
+        if (in != stdin)
+        {
+            fclose(in);
+        }
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+
+#ifdef _WIN32
+    // no fork(), lines always run one after another.
+    parallel = 1;
+#else
+    batch_job *jobs = NULL;
+    int running = 0;
+    if (parallel > 1)
+    {
+        jobs = (batch_job *)calloc(parallel, sizeof(batch_job));
+        if (jobs == NULL)
+        {
+            parallel = 1;
+        }
+    }
+#endif
+
+    char *line = NULL;
+    size_t line_len = 0;
+    size_t line_num = 0;
+    int failed = 0;
+
+    while (read_line(in, &line, &line_len) >= 0)
+    {
+        line_num++;
+        int argc;
+        char **argv;
+        int err = tokenize_line(tok, line, main_command_name, &argc, &argv);
+        if (err == 1)
+        {
+            // open quote, the command continues on the next line.
+            continue;
+        }
+        if (err < 0)
+        {
+            docker_log_error("Batch line %zu could not be parsed.\n", line_num);
+            failed++;
+        }
+        else if (argc == 2 && strcmp(argv[1], CLD_BATCH_SYNC) == 0)
+        {
+#ifndef _WIN32
+            while (parallel > 1 && running > 0)
+            {
+                failed += batch_reap(jobs, parallel, &running);
+            }
+#endif
+        }
+        else if (argc > 0)
+        {
+#ifndef _WIN32
+            if (parallel > 1)
+            {
+                if (running == parallel)
+                {
+                    failed += batch_reap(jobs, parallel, &running);
+                }
+                if (batch_start(jobs, parallel, &running, line_num, argc, argv,
+                                exec_fn, exec_args) != 0)
+                {
+                    docker_log_error("Batch line %zu could not be started.\n", line_num);
+                    failed++;
+                }
+            }
+            else
+#endif
+            if (exec_fn(argc, argv, exec_args) != ZCLK_RES_SUCCESS)
+            {
+                docker_log_error("Batch line %zu failed.\n", line_num);
+                failed++;
+            }
+            fflush(stdout);
+        }
+        free(argv);
+        tok_reset(tok);
+    }
+
+#ifndef _WIN32
+    while (parallel > 1 && running > 0)
+    {
+        failed += batch_reap(jobs, parallel, &running);
+    }
+    free(jobs);
+#endif
+
+    free(line);
+    tok_end(tok);
+    if (in != stdin)
+    {
+        fclose(in);
+    }
+    return failed == 0 ? ZCLK_RES_SUCCESS : ZCLK_RES_ERR_UNKNOWN;
+}
@@ -0,0 +1,60 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SRC_CLD_REPL_H_
+#define SRC_CLD_REPL_H_
+
+#include "cld_common.h"
+
+#define CLD_REPL_PROMPT "cld> "
+#define CLD_REPL_CONT_PROMPT "> "
+
+/**
+ * Run the interactive cld shell. Every line read from stdin is split with
+ * the bundled tokenizer (sh(1) like quoting) and run with exec_fn, which
+ * receives main_command_name as argv[0].
+ *
+ * The loop ends at end of input, or when "exit" or "quit" is entered.
+ */
+zclk_res cld_repl(const char *main_command_name, cld_command_exec_fn exec_fn,
+                  void *exec_args);
+
+/** Batch script line which waits for all running parallel commands. */
+#define CLD_BATCH_SYNC "sync"
+
+/**
+ * Run a batch script: one cld command line per line, from the file at path
+ * or stdin if path is "-". Lines are tokenized like in the REPL, empty lines
+ * and lines starting with '#' are skipped.
+ *
+ * When parallel > 1, up to parallel lines run concurrently (each in a
+ * forked child sharing the prepared docker context and lua state). The
+ * output of each line is printed as one block when the line completes.
+ * A line containing only CLD_BATCH_SYNC waits for all running lines.
+ *
+ * Returns ZCLK_RES_SUCCESS if every line succeeded.
+ */
+zclk_res cld_batch(const char *path, int parallel, const char *main_command_name,
+                   cld_command_exec_fn exec_fn, void *exec_args);
+
+#endif /* SRC_CLD_REPL_H_ */
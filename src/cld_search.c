@@ -0,0 +1,217 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include "cld_search.h"
+
+/*
+ * The SSE2 path is the baseline, so it is only built where the compiler
+ * targets SSE2: always on x86_64, and on i386 only when built with -msse2.
+ * AVX2 is chosen at run time.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__SSE2__))
+#define CLD_SEARCH_X86
+#include <immintrin.h>
+#endif
+
+void cld_search_init(cld_search *search, const char *needle)
+{
+    search->needle = needle;
+    search->len = strlen(needle);
+}
+
+/* memchr for the first byte, then compare the rest. */
+static bool search_scalar(const cld_search *search, const char *hay, size_t len)
+{
+    const char *end = hay + len - search->len + 1;
+    const char *p = hay;
+    while (p < end)
+    {
+        p = (const char *)memchr(p, search->needle[0], (size_t)(end - p));
+        if (p == NULL)
+        {
+            return false;
+        }
+        if (memcmp(p + 1, search->needle + 1, search->len - 1) == 0)
+        {
+            return true;
+        }
+        p++;
+    }
+    return false;
+}
+
+#ifdef CLD_SEARCH_X86
+
+/*
+ * Candidate positions have both the first and the last byte of the needle
+ * at the right distance, only those are compared in full.
+ */
+static bool search_sse2(const cld_search *search, const char *hay, size_t len)
+{
+    size_t n = search->len;
+    const __m128i first = _mm_set1_epi8(search->needle[0]);
+    const __m128i last = _mm_set1_epi8(search->needle[n - 1]);
+    size_t i = 0;
+    for (; i + n - 1 + 16 <= len; i += 16)
+    {
+        __m128i block_first = _mm_loadu_si128((const __m128i *)(hay + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i *)(hay + i + n - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                          _mm_cmpeq_epi8(last, block_last)));
+        while (mask != 0)
+        {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (memcmp(hay + i + bit + 1, search->needle + 1, n - 2) == 0)
+            {
+                return true;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return i + n <= len && search_scalar(search, hay + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static bool search_avx2(const cld_search *search, const char *hay, size_t len)
+{
+    size_t n = search->len;
+    const __m256i first = _mm256_set1_epi8(search->needle[0]);
+    const __m256i last = _mm256_set1_epi8(search->needle[n - 1]);
+    size_t i = 0;
+    for (; i + n - 1 + 32 <= len; i += 32)
+    {
+        __m256i block_first = _mm256_loadu_si256((const __m256i *)(hay + i));
+        __m256i block_last = _mm256_loadu_si256((const __m256i *)(hay + i + n - 1));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first),
+                             _mm256_cmpeq_epi8(last, block_last)));
+        while (mask != 0)
+        {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (memcmp(hay + i + bit + 1, search->needle + 1, n - 2) == 0)
+            {
+                return true;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return i + n <= len && search_sse2(search, hay + i, len - i);
+}
+
+static int have_avx2 = -1;
+
+#endif
+
+bool cld_search_match(const cld_search *search, const char *hay, size_t len)
+{
+    if (search->len == 0)
+    {
+        return true;
+    }
+    if (len < search->len)
+    {
+        return false;
+    }
+    if (search->len == 1)
+    {
+        return memchr(hay, search->needle[0], len) != NULL;
+    }
+#ifdef CLD_SEARCH_X86
+    if (have_avx2 < 0)
+    {
+        __builtin_cpu_init();
+        have_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return have_avx2 ? search_avx2(search, hay, len)
+                     : search_sse2(search, hay, len);
+#else
+    return search_scalar(search, hay, len);
+#endif
+}
+
+static const char *rchr_scalar(const char *hay, char c, size_t len)
+{
+    while (len > 0)
+    {
+        len--;
+        if (hay[len] == c)
+        {
+            return hay + len;
+        }
+    }
+    return NULL;
+}
+
+#ifdef CLD_SEARCH_X86
+
+static const char *rchr_sse2(const char *hay, char c, size_t len)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    while (len >= 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)(hay + len - 16));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(needle, block));
+        if (mask != 0)
+        {
+            return hay + len - 16 + (31 - __builtin_clz(mask));
+        }
+        len -= 16;
+    }
+    return rchr_scalar(hay, c, len);
+}
+
+__attribute__((target("avx2")))
+static const char *rchr_avx2(const char *hay, char c, size_t len)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    while (len >= 32)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(hay + len - 32));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(needle, block));
+        if (mask != 0)
+        {
+            return hay + len - 32 + (31 - __builtin_clz(mask));
+        }
+        len -= 32;
+    }
+    return rchr_sse2(hay, c, len);
+}
+
+#endif
+
+const char *cld_search_rchr(const char *hay, char c, size_t len)
+{
+#ifdef CLD_SEARCH_X86
+    if (have_avx2 < 0)
+    {
+        __builtin_cpu_init();
+        have_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return have_avx2 ? rchr_avx2(hay, c, len) : rchr_sse2(hay, c, len);
+#else
+    return rchr_scalar(hay, c, len);
+#endif
+}
@@ -0,0 +1,54 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SRC_CLD_SEARCH_H_
+#define SRC_CLD_SEARCH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Fixed substring search, for filtering streamed output without copying
+ * it. Uses SSE2 or AVX2 (when the CPU supports it) on x86, comparing the
+ * first and last bytes of the needle at 16 or 32 positions at once, and
+ * memchr elsewhere.
+ */
+typedef struct cld_search_t
+{
+    const char *needle;
+    size_t len;
+} cld_search;
+
+/** Prepare a search for needle, which must outlive the search. */
+void cld_search_init(cld_search *search, const char *needle);
+
+/** Check if needle occurs in the len bytes at hay. */
+bool cld_search_match(const cld_search *search, const char *hay, size_t len);
+
+/**
+ * Find the last occurrence of c in the len bytes at hay, or NULL.
+ * Like memrchr, which is not portable, with the same SSE2/AVX2 paths.
+ */
+const char *cld_search_rchr(const char *hay, char c, size_t len);
+
+#endif /* SRC_CLD_SEARCH_H_ */
@@ -0,0 +1,825 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <json-c/json_tokener.h>
+#include "docker_all.h"
+#include "cld_async.h"
+#include "cld_stats.h"
+#include "cld_stats_ring.h"
+
+#define CLD_STATS_COLUMNS 8
+#define CLD_STATS_REDRAW_MS 1000
+#define CLD_STATS_SHORT_ID_LEN 12
+#define CLD_STATS_CLEAR "\033[H\033[J"
+#define CLD_STATS_MAX_SAMPLING 64
+
+/* Get the value at a dot separated path of object keys, or NULL. */
+static json_object *json_get(json_object *obj, const char *path)
+{
+    char key[128];
+    while (obj != NULL && *path != '\0')
+    {
+        const char *dot = strchr(path, '.');
+        size_t len = dot == NULL ? strlen(path) : (size_t)(dot - path);
+        if (len >= sizeof(key))
+        {
+            return NULL;
+        }
+        memcpy(key, path, len);
+        key[len] = '\0';
+        if (!json_object_object_get_ex(obj, key, &obj))
+        {
+            return NULL;
+        }
+        path += dot == NULL ? len : len + 1;
+    }
+    return obj;
+}
+
+static uint64_t json_get_u64(json_object *obj, const char *path)
+{
+    json_object *val = json_get(obj, path);
+    if (val == NULL)
+    {
+        return 0;
+    }
+    int64_t num = json_object_get_int64(val);
+    return num < 0 ? 0 : (uint64_t)num;
+}
+
+bool cld_stats_parse(json_object *stats, cld_stats_sample *sample)
+{
+    memset(sample, 0, sizeof(cld_stats_sample));
+    if (stats == NULL || json_get(stats, "cpu_stats") == NULL)
+    {
+        return false;
+    }
+
+    sample->cpu_total = json_get_u64(stats, "cpu_stats.cpu_usage.total_usage");
+    sample->precpu_total = json_get_u64(stats, "precpu_stats.cpu_usage.total_usage");
+    sample->system_cpu = json_get_u64(stats, "cpu_stats.system_cpu_usage");
+    sample->presystem_cpu = json_get_u64(stats, "precpu_stats.system_cpu_usage");
+    sample->online_cpus = (uint32_t)json_get_u64(stats, "cpu_stats.online_cpus");
+    if (sample->online_cpus == 0)
+    {
+        // older daemons only report the per cpu usage.
+        json_object *percpu = json_get(stats, "cpu_stats.cpu_usage.percpu_usage");
+        if (percpu != NULL && json_object_is_type(percpu, json_type_array))
+        {
+            sample->online_cpus = (uint32_t)json_object_array_length(percpu);
+        }
+    }
+
+    // like docker, the page cache is not counted as used memory
+    // (cgroup v1 reports it as total_inactive_file, v2 as inactive_file).
+    sample->mem_usage = json_get_u64(stats, "memory_stats.usage");
+    sample->mem_limit = json_get_u64(stats, "memory_stats.limit");
+    uint64_t cache = json_get_u64(stats, "memory_stats.stats.total_inactive_file");
+    if (cache == 0)
+    {
+        cache = json_get_u64(stats, "memory_stats.stats.inactive_file");
+    }
+    if (cache < sample->mem_usage)
+    {
+        sample->mem_usage -= cache;
+    }
+
+    json_object *networks = json_get(stats, "networks");
+    if (networks != NULL && json_object_is_type(networks, json_type_object))
+    {
+        json_object_object_foreach(networks, ifname, iface)
+        {
+            sample->net_rx += json_get_u64(iface, "rx_bytes");
+            sample->net_tx += json_get_u64(iface, "tx_bytes");
+        }
+    }
+
+    json_object *blkio = json_get(stats, "blkio_stats.io_service_bytes_recursive");
+    if (blkio != NULL && json_object_is_type(blkio, json_type_array))
+    {
+        size_t len = json_object_array_length(blkio);
+        for (size_t i = 0; i < len; i++)
+        {
+            json_object *entry = json_object_array_get_idx(blkio, i);
+            json_object *op = json_get(entry, "op");
+            if (op == NULL)
+            {
+                continue;
+            }
+            const char *op_str = json_object_get_string(op);
+            if (strcmp(op_str, "Read") == 0 || strcmp(op_str, "read") == 0)
+            {
+                sample->blk_read += json_get_u64(entry, "value");
+            }
+            else if (strcmp(op_str, "Write") == 0 || strcmp(op_str, "write") == 0)
+            {
+                sample->blk_write += json_get_u64(entry, "value");
+            }
+        }
+    }
+
+    sample->pids = json_get_u64(stats, "pids_stats.current");
+    return true;
+}
+
+void cld_stats_compute(const cld_stats_sample *prev, const cld_stats_sample *cur,
+                       cld_stats_row *row)
+{
+    uint64_t precpu = prev != NULL ? prev->cpu_total : cur->precpu_total;
+    uint64_t presystem = prev != NULL ? prev->system_cpu : cur->presystem_cpu;
+
+    row->cpu_percent = 0.0;
+    if (cur->cpu_total > precpu && cur->system_cpu > presystem)
+    {
+        double cpu_delta = (double)(cur->cpu_total - precpu);
+        double system_delta = (double)(cur->system_cpu - presystem);
+        uint32_t cpus = cur->online_cpus == 0 ? 1 : cur->online_cpus;
+        row->cpu_percent = cpu_delta / system_delta * cpus * 100.0;
+    }
+
+    row->mem_usage = cur->mem_usage;
+    row->mem_limit = cur->mem_limit;
+    row->mem_percent = 0.0;
+    if (cur->mem_limit > 0)
+    {
+        row->mem_percent = (double)cur->mem_usage / (double)cur->mem_limit * 100.0;
+    }
+    row->net_rx = cur->net_rx;
+    row->net_tx = cur->net_tx;
+    row->blk_read = cur->blk_read;
+    row->blk_write = cur->blk_write;
+    row->pids = cur->pids;
+}
+
+void cld_stats_format_size(uint64_t bytes, bool binary, char *buf, size_t len)
+{
+    static const char *binary_units[] = {"B", "KiB", "MiB", "GiB", "TiB", "PiB"};
+    static const char *decimal_units[] = {"B", "kB", "MB", "GB", "TB", "PB"};
+    const char **units = binary ? binary_units : decimal_units;
+    double base = binary ? 1024.0 : 1000.0;
+    double val = (double)bytes;
+    int unit = 0;
+    while (val >= base && unit < 5)
+    {
+        val /= base;
+        unit++;
+    }
+    if (unit == 0)
+    {
+        snprintf(buf, len, "%lluB", (unsigned long long)bytes);
+    }
+    else
+    {
+        snprintf(buf, len, "%.4g%s", val, units[unit]);
+    }
+}
+
+int cld_stats_table_new(zclk_table **tbl, size_t rows)
+{
+    int err = create_zclk_table(tbl, rows, CLD_STATS_COLUMNS);
+    if (err == 0)
+    {
+        zclk_table_set_header(*tbl, 0, "CONTAINER ID");
+        zclk_table_set_header(*tbl, 1, "NAME");
+        zclk_table_set_header(*tbl, 2, "CPU %");
+        zclk_table_set_header(*tbl, 3, "MEM USAGE / LIMIT");
+        zclk_table_set_header(*tbl, 4, "MEM %");
+        zclk_table_set_header(*tbl, 5, "NET I/O");
+        zclk_table_set_header(*tbl, 6, "BLOCK I/O");
+        zclk_table_set_header(*tbl, 7, "PIDS");
+    }
+    return err;
+}
+
+void cld_stats_table_set_row(zclk_table *tbl, size_t row, const char *id,
+                             const char *name, const cld_stats_row *stats)
+{
+    char id_str[CLD_STATS_SHORT_ID_LEN + 1];
+    snprintf(id_str, sizeof(id_str), "%s", id);
+    zclk_table_set_row_val(tbl, row, 0, id_str);
+    zclk_table_set_row_val(tbl, row, 1, name);
+
+    // no sample received yet
+    if (stats == NULL)
+    {
+        for (size_t col = 2; col < CLD_STATS_COLUMNS; col++)
+        {
+            zclk_table_set_row_val(tbl, row, col, "--");
+        }
+        return;
+    }
+
+    char val[128], a[32], b[32];
+    snprintf(val, sizeof(val), "%.2f%%", stats->cpu_percent);
+    zclk_table_set_row_val(tbl, row, 2, val);
+
+    cld_stats_format_size(stats->mem_usage, true, a, sizeof(a));
+    cld_stats_format_size(stats->mem_limit, true, b, sizeof(b));
+    snprintf(val, sizeof(val), "%s / %s", a, b);
+    zclk_table_set_row_val(tbl, row, 3, val);
+
+    snprintf(val, sizeof(val), "%.2f%%", stats->mem_percent);
+    zclk_table_set_row_val(tbl, row, 4, val);
+
+    cld_stats_format_size(stats->net_rx, false, a, sizeof(a));
+    cld_stats_format_size(stats->net_tx, false, b, sizeof(b));
+    snprintf(val, sizeof(val), "%s / %s", a, b);
+    zclk_table_set_row_val(tbl, row, 5, val);
+
+    cld_stats_format_size(stats->blk_read, false, a, sizeof(a));
+    cld_stats_format_size(stats->blk_write, false, b, sizeof(b));
+    snprintf(val, sizeof(val), "%s / %s", a, b);
+    zclk_table_set_row_val(tbl, row, 6, val);
+
+    snprintf(val, sizeof(val), "%llu", (unsigned long long)stats->pids);
+    zclk_table_set_row_val(tbl, row, 7, val);
+}
+
+/* Splits a streamed response body into lines. */
+typedef struct stats_lines_t
+{
+    char *buf;
+    size_t len;
+    size_t cap;
+} stats_lines;
+
+typedef void (*stats_line_fn)(char *line, void *cbargs);
+
+/*
+ * Feed received data, calling line_fn for every complete line.
+ * Returns non-zero if the line buffer could not grow.
+ */
+static int stats_lines_feed(stats_lines *lines, const char *data, size_t len,
+                            stats_line_fn line_fn, void *cbargs)
+{
+    while (len > 0)
+    {
+        const char *nl = (const char *)memchr(data, '\n', len);
+        size_t n = nl == NULL ? len : (size_t)(nl - data);
+        if (lines->len + n + 1 > lines->cap)
+        {
+            size_t cap = lines->cap == 0 ? 4096 : lines->cap;
+            while (lines->len + n + 1 > cap)
+            {
+                cap *= 2;
+            }
+            char *buf = (char *)realloc(lines->buf, cap);
+            if (buf == NULL)
+            {
+                return -1;
+            }
+            lines->buf = buf;
+            lines->cap = cap;
+        }
+        memcpy(lines->buf + lines->len, data, n);
+        lines->len += n;
+        lines->buf[lines->len] = '\0';
+        if (nl == NULL)
+        {
+            break;
+        }
+        if (lines->len > 0)
+        {
+            line_fn(lines->buf, cbargs);
+        }
+        lines->len = 0;
+        data += n + 1;
+        len -= n + 1;
+    }
+    return 0;
+}
+
+typedef struct stats_session_t stats_session;
+
+/* A container shown in the stats table. */
+typedef struct stats_entry_t
+{
+    stats_session *session;
+    char *id;
+    char *name;
+    stats_lines lines;
+    cld_stats_sample prev;
+    bool has_prev;
+    cld_stats_row row;
+    bool has_row;
+    bool recorded;
+    bool streaming;
+    char *error;
+} stats_entry;
+
+struct stats_session_t
+{
+    bool stream;
+    cld_stats_ring *record;
+    /* the container table of the recording was found full */
+    bool record_full;
+    cld_async *async;
+    arraylist *entries;
+    stats_lines events;
+    zclk_table *tbl;
+    size_t tbl_rows;
+    zclk_command_output_handler success_handler;
+    zclk_command_output_handler error_handler;
+};
+
+static void free_stats_entry(void *item)
+{
+    stats_entry *entry = (stats_entry *)item;
+    free(entry->id);
+    free(entry->name);
+    free(entry->lines.buf);
+    free(entry->error);
+    free(entry);
+}
+
+static void stats_entry_line(char *line, void *cbargs)
+{
+    stats_entry *entry = (stats_entry *)cbargs;
+    json_object *obj = json_tokener_parse(line);
+    cld_stats_sample sample;
+    if (cld_stats_parse(obj, &sample))
+    {
+        cld_stats_compute(entry->has_prev ? &entry->prev : NULL, &sample,
+                          &entry->row);
+        entry->prev = sample;
+        entry->has_prev = true;
+        entry->has_row = true;
+        entry->recorded = false;
+    }
+    json_object_put(obj);
+}
+
+static int stats_stream_data(cld_async_request *req, const char *data,
+                             size_t len, void *cbargs)
+{
+    stats_entry *entry = (stats_entry *)cbargs;
+    return stats_lines_feed(&entry->lines, data, len, &stats_entry_line, entry);
+}
+
+static void stats_stream_done(cld_async_request *req, void *cbargs)
+{
+    stats_entry *entry = (stats_entry *)cbargs;
+    entry->streaming = false;
+    if (!cld_async_request_ok(req))
+    {
+        free(entry->error);
+        entry->error = str_clone(cld_async_request_message(req));
+    }
+}
+
+/* Completion of a single sample request, without streaming. */
+static void stats_sample_done(cld_async_request *req, void *cbargs)
+{
+    stats_entry *entry = (stats_entry *)cbargs;
+    entry->streaming = false;
+    json_object *obj = cld_async_request_ok(req) ?
+        cld_async_request_json(req) : NULL;
+    cld_stats_sample sample;
+    if (cld_stats_parse(obj, &sample))
+    {
+        // the daemon fills precpu_stats with a sample taken before.
+        cld_stats_compute(NULL, &sample, &entry->row);
+        entry->has_row = true;
+    }
+    else
+    {
+        free(entry->error);
+        entry->error = str_clone(obj == NULL ? cld_async_request_message(req)
+                                             : "Invalid stats response");
+    }
+    json_object_put(obj);
+}
+
+/* Start (or restart) reading the stats of an entry. */
+static void stats_entry_start(stats_entry *entry)
+{
+    char path[512];
+    char *escaped = cld_async_escape(entry->id);
+    if (escaped == NULL)
+    {
+        return;
+    }
+    bool stream = entry->session->stream;
+    snprintf(path, sizeof(path), "/containers/%s/stats?stream=%d", escaped,
+             stream ? 1 : 0);
+    free(escaped);
+
+    entry->lines.len = 0;
+    entry->has_prev = false;
+    entry->has_row = false;
+    entry->streaming = cld_async_submit(entry->session->async, "GET", path,
+                                        NULL,
+                                        stream ? &stats_stream_data : NULL,
+                                        stream ? &stats_stream_done
+                                               : &stats_sample_done,
+                                        entry) != NULL;
+}
+
+/* Add a container, or restart its stream if it has stopped. */
+static void stats_session_add(stats_session *session, const char *id,
+                              const char *name)
+{
+    size_t len = arraylist_length(session->entries);
+    for (size_t i = 0; i < len; i++)
+    {
+        stats_entry *entry = (stats_entry *)arraylist_get(session->entries, i);
+        if (strcmp(entry->id, id) == 0)
+        {
+            if (!entry->streaming)
+            {
+                stats_entry_start(entry);
+            }
+            return;
+        }
+    }
+
+    stats_entry *entry = (stats_entry *)calloc(1, sizeof(stats_entry));
+    if (entry == NULL)
+    {
+        return;
+    }
+    entry->session = session;
+    entry->id = str_clone(id);
+    entry->name = str_clone(name[0] == '/' ? name + 1 : name);
+    arraylist_add(session->entries, entry);
+    stats_entry_start(entry);
+}
+
+static void stats_list_done(cld_async_request *req, void *cbargs)
+{
+    stats_session *session = (stats_session *)cbargs;
+    json_object *ctrs = cld_async_request_ok(req) ?
+        cld_async_request_json(req) : NULL;
+    if (ctrs == NULL || !json_object_is_type(ctrs, json_type_array))
+    {
+        char res_str[1024];
+        snprintf(res_str, sizeof(res_str), "Could not list containers: %s",
+                 cld_async_request_message(req));
+        session->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING, res_str);
+        json_object_put(ctrs);
+        cld_async_stop(session->async);
+        return;
+    }
+
+    size_t num = json_object_array_length(ctrs);
+    for (size_t i = 0; i < num; i++)
+    {
+        json_object *ctr = json_object_array_get_idx(ctrs, i);
+        json_object *id = json_get(ctr, "Id");
+        json_object *names = json_get(ctr, "Names");
+        if (id == NULL)
+        {
+            continue;
+        }
+        const char *name = "";
+        if (names != NULL && json_object_array_length(names) > 0)
+        {
+            name = json_object_get_string(json_object_array_get_idx(names, 0));
+        }
+        stats_session_add(session, json_object_get_string(id), name);
+    }
+    json_object_put(ctrs);
+}
+
+static void stats_event_line(char *line, void *cbargs)
+{
+    stats_session *session = (stats_session *)cbargs;
+    json_object *event = json_tokener_parse(line);
+    json_object *id = json_get(event, "id");
+    json_object *name = json_get(event, "Actor.Attributes.name");
+    if (id != NULL)
+    {
+        stats_session_add(session, json_object_get_string(id),
+                          name == NULL ? "" : json_object_get_string(name));
+    }
+    json_object_put(event);
+}
+
+static int stats_events_data(cld_async_request *req, const char *data,
+                             size_t len, void *cbargs)
+{
+    stats_session *session = (stats_session *)cbargs;
+    return stats_lines_feed(&session->events, data, len, &stats_event_line,
+                            session);
+}
+
+/* Append the samples not yet recorded to the recording file, if any. */
+static void stats_record(stats_session *session)
+{
+    if (session->record == NULL)
+    {
+        return;
+    }
+    int64_t now_ms = (int64_t)time(NULL) * 1000;
+    size_t len = arraylist_length(session->entries);
+    for (size_t i = 0; i < len; i++)
+    {
+        stats_entry *entry = (stats_entry *)arraylist_get(session->entries, i);
+        if (entry->has_row && !entry->recorded)
+        {
+            cld_stats_record rec;
+            uint32_t container;
+            if (cld_stats_ring_container(session->record, entry->id,
+                                         entry->name, &container) != ZCLK_RES_SUCCESS)
+            {
+                // tried again on the next sample, as slots are reused.
+                if (!session->record_full)
+                {
+                    docker_log_error("The recording has no room for more "
+                                     "containers, %s is not recorded.",
+                                     entry->name);
+                    session->record_full = true;
+                }
+                entry->recorded = true;
+                continue;
+            }
+            cld_stats_record_set(&rec, now_ms, container, &entry->row);
+            if (cld_stats_ring_append(session->record, &rec) != ZCLK_RES_SUCCESS)
+            {
+                docker_log_error("Could not record the stats of %s.",
+                                 entry->name);
+            }
+            entry->recorded = true;
+        }
+    }
+    cld_stats_ring_flush(session->record);
+}
+
+/* Redraw the table with the latest values of all streaming containers. */
+static void stats_redraw(cld_async *async, void *cbargs)
+{
+    stats_session *session = (stats_session *)cbargs;
+    size_t len = arraylist_length(session->entries);
+    size_t rows = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        stats_entry *entry = (stats_entry *)arraylist_get(session->entries, i);
+        rows += entry->streaming ? 1 : 0;
+    }
+
+    // the table is only created again when the number of rows changes.
+    if (session->tbl == NULL || session->tbl_rows != rows)
+    {
+        if (session->tbl != NULL)
+        {
+            free_zclk_table(session->tbl);
+            session->tbl = NULL;
+        }
+        if (cld_stats_table_new(&session->tbl, rows) != 0)
+        {
+            session->tbl = NULL;
+            return;
+        }
+        session->tbl_rows = rows;
+    }
+
+    size_t row = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        stats_entry *entry = (stats_entry *)arraylist_get(session->entries, i);
+        if (entry->streaming)
+        {
+            cld_stats_table_set_row(session->tbl, row++, entry->id, entry->name,
+                                    entry->has_row ? &entry->row : NULL);
+        }
+    }
+
+    stats_record(session);
+    session->success_handler(ZCLK_RES_IS_RUNNING, ZCLK_RESULT_STRING,
+                             CLD_STATS_CLEAR);
+    session->success_handler(ZCLK_RES_IS_RUNNING, ZCLK_RESULT_TABLE,
+                             session->tbl);
+}
+
+/*
+ * Create the session and submit the requests for the containers, or list
+ * the running containers first if none are given.
+ */
+static zclk_res stats_session_start(stats_session *session, docker_context *ctx,
+                                    arraylist *containers, bool stream,
+                                    cld_stats_ring *record,
+                                    zclk_command_output_handler success_handler,
+                                    zclk_command_output_handler error_handler)
+{
+    memset(session, 0, sizeof(stats_session));
+    session->stream = stream;
+    session->record = record;
+    session->success_handler = success_handler;
+    session->error_handler = error_handler;
+
+    zclk_res res = make_cld_async(&session->async, ctx,
+                                  stream ? 0 : CLD_STATS_MAX_SAMPLING);
+    if (res != ZCLK_RES_SUCCESS)
+    {
+        return res;
+    }
+    if (arraylist_new(&session->entries, &free_stats_entry) != 0)
+    {
+        free_cld_async(session->async);
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+
+    size_t len = containers == NULL ? 0 : arraylist_length(containers);
+    if (len > 0)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            char *container = (char *)arraylist_get(containers, i);
+            stats_session_add(session, container, container);
+        }
+        return ZCLK_RES_SUCCESS;
+    }
+
+    if (stream)
+    {
+        // subscribe to start events before listing, so that no container
+        // starting in between is missed.
+        char *filters = cld_async_escape(
+            "{\"type\":[\"container\"],\"event\":[\"start\"]}");
+        char path[256];
+        snprintf(path, sizeof(path), "/events?filters=%s",
+                 filters == NULL ? "" : filters);
+        free(filters);
+        cld_async_submit(session->async, "GET", path, NULL, &stats_events_data,
+                         NULL, session);
+    }
+    cld_async_submit(session->async, "GET", "/containers/json", NULL, NULL,
+                     &stats_list_done, session);
+    return ZCLK_RES_SUCCESS;
+}
+
+/* Report the containers for which no stats could be read at all. */
+static zclk_res stats_session_errors(stats_session *session)
+{
+    zclk_res res = ZCLK_RES_SUCCESS;
+    size_t len = arraylist_length(session->entries);
+    for (size_t i = 0; i < len; i++)
+    {
+        stats_entry *entry = (stats_entry *)arraylist_get(session->entries, i);
+        if (entry->error != NULL && !entry->has_row)
+        {
+            char res_str[1024];
+            snprintf(res_str, sizeof(res_str), "Failed to get stats of %s: %s",
+                     entry->name, entry->error);
+            session->error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING,
+                                   res_str);
+            res = ZCLK_RES_ERR_UNKNOWN;
+        }
+    }
+    return res;
+}
+
+static void stats_session_free(stats_session *session)
+{
+    free_cld_async(session->async);
+    if (session->tbl != NULL)
+    {
+        free_zclk_table(session->tbl);
+    }
+    free(session->events.buf);
+    arraylist_free(session->entries);
+}
+
+zclk_res cld_stats_stream(docker_context *ctx, arraylist *containers,
+                          cld_stats_ring *record,
+                          zclk_command_output_handler success_handler,
+                          zclk_command_output_handler error_handler)
+{
+    stats_session session;
+    zclk_res res = stats_session_start(&session, ctx, containers, true,
+                                       record, success_handler, error_handler);
+    if (res != ZCLK_RES_SUCCESS)
+    {
+        return res;
+    }
+
+    cld_async_set_tick(session.async, CLD_STATS_REDRAW_MS, &stats_redraw,
+                       &session);
+    res = cld_async_run(session.async);
+    if (res == ZCLK_RES_SUCCESS)
+    {
+        res = stats_session_errors(&session);
+    }
+    stats_session_free(&session);
+    return res;
+}
+
+static json_object *stats_row_to_json(const char *id, const char *name,
+                                      const cld_stats_row *row)
+{
+    json_object *obj = json_object_new_object();
+    json_object_object_add(obj, "id", json_object_new_string(id));
+    json_object_object_add(obj, "name", json_object_new_string(name));
+    json_object_object_add(obj, "cpu_percent",
+                           json_object_new_double(row->cpu_percent));
+    json_object_object_add(obj, "mem_usage",
+                           json_object_new_int64((int64_t)row->mem_usage));
+    json_object_object_add(obj, "mem_limit",
+                           json_object_new_int64((int64_t)row->mem_limit));
+    json_object_object_add(obj, "mem_percent",
+                           json_object_new_double(row->mem_percent));
+    json_object_object_add(obj, "net_rx",
+                           json_object_new_int64((int64_t)row->net_rx));
+    json_object_object_add(obj, "net_tx",
+                           json_object_new_int64((int64_t)row->net_tx));
+    json_object_object_add(obj, "blk_read",
+                           json_object_new_int64((int64_t)row->blk_read));
+    json_object_object_add(obj, "blk_write",
+                           json_object_new_int64((int64_t)row->blk_write));
+    json_object_object_add(obj, "pids",
+                           json_object_new_int64((int64_t)row->pids));
+    return obj;
+}
+
+zclk_res cld_stats_snapshot(docker_context *ctx, arraylist *containers,
+                            bool json, cld_stats_ring *record,
+                            zclk_command_output_handler success_handler,
+                            zclk_command_output_handler error_handler)
+{
+    stats_session session;
+    zclk_res res = stats_session_start(&session, ctx, containers, false,
+                                       record, success_handler, error_handler);
+    if (res != ZCLK_RES_SUCCESS)
+    {
+        return res;
+    }
+    res = cld_async_run(session.async);
+    if (res != ZCLK_RES_SUCCESS)
+    {
+        stats_session_free(&session);
+        return res;
+    }
+
+    stats_record(&session);
+
+    size_t len = arraylist_length(session.entries);
+    size_t rows = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        stats_entry *entry = (stats_entry *)arraylist_get(session.entries, i);
+        rows += entry->has_row ? 1 : 0;
+    }
+
+    if (json)
+    {
+        json_object *arr = json_object_new_array();
+        for (size_t i = 0; i < len; i++)
+        {
+            stats_entry *entry = (stats_entry *)arraylist_get(session.entries, i);
+            if (entry->has_row)
+            {
+                json_object_array_add(arr, stats_row_to_json(entry->id,
+                                      entry->name, &entry->row));
+            }
+        }
+        success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_STRING,
+            (void *)json_object_to_json_string_ext(arr, JSON_C_TO_STRING_PRETTY));
+        json_object_put(arr);
+    }
+    else if (cld_stats_table_new(&session.tbl, rows) == 0)
+    {
+        size_t row = 0;
+        for (size_t i = 0; i < len; i++)
+        {
+            stats_entry *entry = (stats_entry *)arraylist_get(session.entries, i);
+            if (entry->has_row)
+            {
+                cld_stats_table_set_row(session.tbl, row++, entry->id,
+                                        entry->name, &entry->row);
+            }
+        }
+        success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_TABLE, session.tbl);
+    }
+    else
+    {
+        session.tbl = NULL;
+    }
+
+    res = stats_session_errors(&session);
+    stats_session_free(&session);
+    return res;
+}
@@ -0,0 +1,122 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SRC_CLD_STATS_H_
+#define SRC_CLD_STATS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <json-c/json_object.h>
+#include <coll_arraylist.h>
+#include "cld_common.h"
+#include "zclk_table.h"
+
+typedef struct cld_stats_ring_t cld_stats_ring;
+
+/**
+ * The counters of one stats sample of a container, as read from the
+ * docker stats API.
+ */
+typedef struct cld_stats_sample_t
+{
+    uint64_t cpu_total;
+    uint64_t precpu_total;
+    uint64_t system_cpu;
+    uint64_t presystem_cpu;
+    uint32_t online_cpus;
+    uint64_t mem_usage;
+    uint64_t mem_limit;
+    uint64_t net_rx;
+    uint64_t net_tx;
+    uint64_t blk_read;
+    uint64_t blk_write;
+    uint64_t pids;
+} cld_stats_sample;
+
+/** The values shown for a container, computed from its samples. */
+typedef struct cld_stats_row_t
+{
+    double cpu_percent;
+    double mem_percent;
+    uint64_t mem_usage;
+    uint64_t mem_limit;
+    uint64_t net_rx;
+    uint64_t net_tx;
+    uint64_t blk_read;
+    uint64_t blk_write;
+    uint64_t pids;
+} cld_stats_row;
+
+/**
+ * Read the counters of a stats json object into sample.
+ * Returns false if the object is not a stats sample.
+ */
+bool cld_stats_parse(json_object *stats, cld_stats_sample *sample);
+
+/**
+ * Compute the displayed values of a sample. The CPU percentage is computed
+ * against prev if given, else against the precpu counters of the sample.
+ */
+void cld_stats_compute(const cld_stats_sample *prev, const cld_stats_sample *cur,
+                       cld_stats_row *row);
+
+/**
+ * Format a byte count like docker does, with binary units (MiB) or decimal
+ * units (MB).
+ */
+void cld_stats_format_size(uint64_t bytes, bool binary, char *buf, size_t len);
+
+/** Create a stats table with the docker stats columns. */
+int cld_stats_table_new(zclk_table **tbl, size_t rows);
+
+/** Fill a row of a stats table. */
+void cld_stats_table_set_row(zclk_table *tbl, size_t row, const char *id,
+                             const char *name, const cld_stats_row *stats);
+
+/**
+ * Stream the stats of the given containers (a list of strings), or of all
+ * running containers if the list is empty, and redraw one table with all
+ * of them every second. All the streams run concurrently on one event
+ * loop. In the all containers mode new containers are picked up as they
+ * start, and the command runs until interrupted; otherwise it ends when
+ * all containers have stopped.
+ *
+ * If record is not NULL every sample is also appended to it.
+ */
+zclk_res cld_stats_stream(docker_context *ctx, arraylist *containers,
+                          cld_stats_ring *record,
+                          zclk_command_output_handler success_handler,
+                          zclk_command_output_handler error_handler);
+
+/**
+ * Read one stats sample of the given containers, or of all running
+ * containers if the list is empty, concurrently. The samples are output as
+ * one table, or as a json array if json is true, and appended to record if
+ * it is not NULL.
+ */
+zclk_res cld_stats_snapshot(docker_context *ctx, arraylist *containers,
+                            bool json, cld_stats_ring *record,
+                            zclk_command_output_handler success_handler,
+                            zclk_command_output_handler error_handler);
+
+#endif /* SRC_CLD_STATS_H_ */
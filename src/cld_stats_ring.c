@@ -0,0 +1,615 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include "docker_all.h"
+#include "cld_stats_ring.h"
+
+#ifdef _WIN32
+#define ring_fseek _fseeki64
+#else
+#include <sys/types.h>
+#define ring_fseek fseeko
+#endif
+
+#define CLD_STATS_RING_MAGIC "CLDSTRNG"
+#define CLD_STATS_RING_VERSION 2
+#define CLD_STATS_RING_HEADER_SIZE 64
+
+/*
+ * The file header, at the start of the file, followed by the container
+ * table of CLD_STATS_RING_MAX_CONTAINERS slots and then capacity slots of
+ * fixed size records. head is the slot the next record is written to and
+ * containers the number of used container slots.
+ * All values are in host byte order.
+ */
+typedef struct ring_header_t
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;
+    uint64_t head;
+    uint64_t count;
+    uint32_t containers;
+} ring_header;
+
+struct cld_stats_ring_t
+{
+    FILE *fp;
+    bool writable;
+    ring_header header;
+    cld_stats_container *containers;
+    /* number of records in the ring of each container */
+    uint64_t *refs;
+};
+
+static int64_t container_offset(uint32_t index)
+{
+    return (int64_t)CLD_STATS_RING_HEADER_SIZE
+           + (int64_t)index * (int64_t)sizeof(cld_stats_container);
+}
+
+static int64_t ring_offset(uint64_t slot)
+{
+    return container_offset(CLD_STATS_RING_MAX_CONTAINERS)
+           + (int64_t)slot * (int64_t)sizeof(cld_stats_record);
+}
+
+static zclk_res ring_write_header(cld_stats_ring *ring)
+{
+    char buf[CLD_STATS_RING_HEADER_SIZE];
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, &ring->header, sizeof(ring_header));
+    if (ring_fseek(ring->fp, 0, SEEK_SET) != 0
+        || fwrite(buf, sizeof(buf), 1, ring->fp) != 1)
+    {
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+    return ZCLK_RES_SUCCESS;
+}
+
+static void ring_free(cld_stats_ring *ring)
+{
+    if (ring->fp != NULL)
+    {
+        fclose(ring->fp);
+    }
+    free(ring->containers);
+    free(ring->refs);
+    free(ring);
+}
+
+zclk_res cld_stats_ring_open(cld_stats_ring **ring, const char *path,
+                             uint64_t capacity, bool create)
+{
+    cld_stats_ring *r = (cld_stats_ring *)calloc(1, sizeof(cld_stats_ring));
+    if (r == NULL)
+    {
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+    r->containers = (cld_stats_container *)calloc(
+        CLD_STATS_RING_MAX_CONTAINERS, sizeof(cld_stats_container));
+    r->refs = (uint64_t *)calloc(CLD_STATS_RING_MAX_CONTAINERS, sizeof(uint64_t));
+    if (r->containers == NULL || r->refs == NULL)
+    {
+        ring_free(r);
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+
+    r->writable = create;
+    r->fp = fopen(path, create ? "r+b" : "rb");
+    if (r->fp == NULL && create)
+    {
+        if (capacity == 0)
+        {
+            capacity = CLD_STATS_RING_DEFAULT_CAPACITY;
+        }
+        r->fp = fopen(path, "w+b");
+        if (r->fp != NULL)
+        {
+            memcpy(r->header.magic, CLD_STATS_RING_MAGIC, sizeof(r->header.magic));
+            r->header.version = CLD_STATS_RING_VERSION;
+            r->header.record_size = (uint32_t)sizeof(cld_stats_record);
+            r->header.capacity = capacity;
+            if (ring_write_header(r) != ZCLK_RES_SUCCESS)
+            {
+                cld_stats_ring_close(r);
+                return ZCLK_RES_ERR_UNKNOWN;
+            }
+            *ring = r;
+            return ZCLK_RES_SUCCESS;
+        }
+    }
+    if (r->fp == NULL)
+    {
+        docker_log_error("Could not open stats recording %s.", path);
+        ring_free(r);
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+
+    if (fread(&r->header, sizeof(ring_header), 1, r->fp) != 1
+        || memcmp(r->header.magic, CLD_STATS_RING_MAGIC, sizeof(r->header.magic)) != 0
+        || r->header.version != CLD_STATS_RING_VERSION
+        || r->header.record_size != sizeof(cld_stats_record)
+        || r->header.capacity == 0
+        || r->header.head >= r->header.capacity
+        || r->header.count > r->header.capacity
+        || r->header.containers > CLD_STATS_RING_MAX_CONTAINERS)
+    {
+        docker_log_error("%s is not a stats recording.", path);
+        ring_free(r);
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+    if (r->header.containers > 0
+        && (ring_fseek(r->fp, container_offset(0), SEEK_SET) != 0
+            || fread(r->containers, sizeof(cld_stats_container),
+                     r->header.containers, r->fp) != r->header.containers))
+    {
+        docker_log_error("Could not read the containers of %s.", path);
+        ring_free(r);
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+    for (uint32_t i = 0; i < r->header.containers; i++)
+    {
+        r->containers[i].id[CLD_STATS_RING_ID_LEN - 1] = '\0';
+        r->containers[i].name[CLD_STATS_RING_NAME_LEN - 1] = '\0';
+    }
+    // count the records of each container, to reuse the slots of those
+    // without records once the ring has wrapped over them.
+    for (uint64_t i = 0; r->writable && i < r->header.count; i++)
+    {
+        cld_stats_record rec;
+        if (cld_stats_ring_read(r, i, &rec) != ZCLK_RES_SUCCESS)
+        {
+            docker_log_error("Could not read the records of %s.", path);
+            ring_free(r);
+            return ZCLK_RES_ERR_UNKNOWN;
+        }
+        r->refs[rec.container]++;
+    }
+    *ring = r;
+    return ZCLK_RES_SUCCESS;
+}
+
+void cld_stats_ring_close(cld_stats_ring *ring)
+{
+    if (ring == NULL)
+    {
+        return;
+    }
+    if (ring->writable)
+    {
+        cld_stats_ring_flush(ring);
+    }
+    ring_free(ring);
+}
+
+zclk_res cld_stats_ring_container(cld_stats_ring *ring, const char *id,
+                                  const char *name, uint32_t *index)
+{
+    cld_stats_container c;
+    memset(&c, 0, sizeof(c));
+    snprintf(c.id, sizeof(c.id), "%s", id);
+    snprintf(c.name, sizeof(c.name), "%s", name);
+
+    ring_header *h = &ring->header;
+    uint32_t unused = h->containers;
+    for (uint32_t i = 0; i < h->containers; i++)
+    {
+        if (strcmp(ring->containers[i].id, c.id) == 0)
+        {
+            *index = i;
+            return ZCLK_RES_SUCCESS;
+        }
+        if (unused == h->containers && ring->refs[i] == 0)
+        {
+            unused = i;
+        }
+    }
+    // reuse the slot of a container whose records were all overwritten.
+    if (unused == CLD_STATS_RING_MAX_CONTAINERS)
+    {
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+    if (ring_fseek(ring->fp, container_offset(unused), SEEK_SET) != 0
+        || fwrite(&c, sizeof(c), 1, ring->fp) != 1)
+    {
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+    ring->containers[unused] = c;
+    if (unused == h->containers)
+    {
+        h->containers++;
+    }
+    *index = unused;
+    return ZCLK_RES_SUCCESS;
+}
+
+const cld_stats_container *cld_stats_ring_container_get(cld_stats_ring *ring,
+                                                        uint32_t index)
+{
+    if (index >= ring->header.containers)
+    {
+        return NULL;
+    }
+    return &ring->containers[index];
+}
+
+void cld_stats_record_set(cld_stats_record *rec, int64_t time_ms,
+                          uint32_t container, const cld_stats_row *row)
+{
+    memset(rec, 0, sizeof(cld_stats_record));
+    rec->time_ms = time_ms;
+    rec->container = container;
+    rec->pids = row->pids > UINT32_MAX ? UINT32_MAX : (uint32_t)row->pids;
+    rec->cpu_percent = row->cpu_percent;
+    rec->mem_usage = row->mem_usage;
+    rec->mem_limit = row->mem_limit;
+    rec->net_rx = row->net_rx;
+    rec->net_tx = row->net_tx;
+    rec->blk_read = row->blk_read;
+    rec->blk_write = row->blk_write;
+}
+
+zclk_res cld_stats_ring_append(cld_stats_ring *ring, const cld_stats_record *rec)
+{
+    ring_header *h = &ring->header;
+    if (rec->container >= h->containers)
+    {
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+    // the record overwritten when the ring is full no longer counts.
+    uint32_t old;
+    if (h->count == h->capacity
+        && ring_fseek(ring->fp, ring_offset(h->head)
+                                + (int64_t)offsetof(cld_stats_record, container),
+                      SEEK_SET) == 0
+        && fread(&old, sizeof(old), 1, ring->fp) == 1
+        && old < h->containers && ring->refs[old] > 0)
+    {
+        ring->refs[old]--;
+    }
+    if (ring_fseek(ring->fp, ring_offset(h->head), SEEK_SET) != 0
+        || fwrite(rec, sizeof(cld_stats_record), 1, ring->fp) != 1)
+    {
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+    ring->refs[rec->container]++;
+    h->head = (h->head + 1) % h->capacity;
+    if (h->count < h->capacity)
+    {
+        h->count++;
+    }
+    return ZCLK_RES_SUCCESS;
+}
+
+zclk_res cld_stats_ring_flush(cld_stats_ring *ring)
+{
+    zclk_res res = ring_write_header(ring);
+    if (fflush(ring->fp) != 0)
+    {
+        res = ZCLK_RES_ERR_UNKNOWN;
+    }
+    return res;
+}
+
+uint64_t cld_stats_ring_count(cld_stats_ring *ring)
+{
+    return ring->header.count;
+}
+
+zclk_res cld_stats_ring_read(cld_stats_ring *ring, uint64_t index,
+                             cld_stats_record *rec)
+{
+    ring_header *h = &ring->header;
+    if (index >= h->count)
+    {
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+    uint64_t slot = (h->head + h->capacity - h->count + index) % h->capacity;
+    if (ring_fseek(ring->fp, ring_offset(slot), SEEK_SET) != 0
+        || fread(rec, sizeof(cld_stats_record), 1, ring->fp) != 1
+        || rec->container >= h->containers)
+    {
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+    return ZCLK_RES_SUCCESS;
+}
+
+static zclk_res replay_records(cld_stats_ring *ring,
+                               zclk_command_output_handler success_handler)
+{
+    uint64_t count = cld_stats_ring_count(ring);
+    zclk_table *tbl;
+    if (create_zclk_table(&tbl, (size_t)count, 8) != 0)
+    {
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+    zclk_table_set_header(tbl, 0, "TIME");
+    zclk_table_set_header(tbl, 1, "CONTAINER ID");
+    zclk_table_set_header(tbl, 2, "NAME");
+    zclk_table_set_header(tbl, 3, "CPU %");
+    zclk_table_set_header(tbl, 4, "MEM USAGE / LIMIT");
+    zclk_table_set_header(tbl, 5, "NET I/O");
+    zclk_table_set_header(tbl, 6, "BLOCK I/O");
+    zclk_table_set_header(tbl, 7, "PIDS");
+
+    for (uint64_t i = 0; i < count; i++)
+    {
+        cld_stats_record rec;
+        if (cld_stats_ring_read(ring, i, &rec) != ZCLK_RES_SUCCESS)
+        {
+            free_zclk_table(tbl);
+            return ZCLK_RES_ERR_UNKNOWN;
+        }
+
+        char val[128], a[32], b[32];
+        time_t t = (time_t)(rec.time_ms / 1000);
+        struct tm *tm = localtime(&t);
+        if (tm == NULL || strftime(val, sizeof(val), "%Y-%m-%d %H:%M:%S", tm) == 0)
+        {
+            snprintf(val, sizeof(val), "%lld", (long long)t);
+        }
+        zclk_table_set_row_val(tbl, i, 0, val);
+        const cld_stats_container *c = cld_stats_ring_container_get(ring,
+                                                                    rec.container);
+        zclk_table_set_row_val(tbl, i, 1, c->id);
+        zclk_table_set_row_val(tbl, i, 2, c->name);
+
+        snprintf(val, sizeof(val), "%.2f%%", rec.cpu_percent);
+        zclk_table_set_row_val(tbl, i, 3, val);
+
+        cld_stats_format_size(rec.mem_usage, true, a, sizeof(a));
+        cld_stats_format_size(rec.mem_limit, true, b, sizeof(b));
+        snprintf(val, sizeof(val), "%s / %s", a, b);
+        zclk_table_set_row_val(tbl, i, 4, val);
+
+        cld_stats_format_size(rec.net_rx, false, a, sizeof(a));
+        cld_stats_format_size(rec.net_tx, false, b, sizeof(b));
+        snprintf(val, sizeof(val), "%s / %s", a, b);
+        zclk_table_set_row_val(tbl, i, 5, val);
+
+        cld_stats_format_size(rec.blk_read, false, a, sizeof(a));
+        cld_stats_format_size(rec.blk_write, false, b, sizeof(b));
+        snprintf(val, sizeof(val), "%s / %s", a, b);
+        zclk_table_set_row_val(tbl, i, 6, val);
+
+        snprintf(val, sizeof(val), "%lu", (unsigned long)rec.pids);
+        zclk_table_set_row_val(tbl, i, 7, val);
+    }
+    success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_TABLE, tbl);
+    free_zclk_table(tbl);
+    return ZCLK_RES_SUCCESS;
+}
+
+/* The values recorded for one container, for the summary. */
+typedef struct replay_series_t
+{
+    uint32_t container;
+    size_t len;
+    size_t cap;
+    double *cpu;
+    double *mem;
+    double *pids;
+} replay_series;
+
+static void free_replay_series(void *item)
+{
+    replay_series *series = (replay_series *)item;
+    free(series->cpu);
+    free(series->mem);
+    free(series->pids);
+    free(series);
+}
+
+static replay_series *replay_series_get(arraylist *all, const cld_stats_record *rec)
+{
+    size_t len = arraylist_length(all);
+    for (size_t i = 0; i < len; i++)
+    {
+        replay_series *series = (replay_series *)arraylist_get(all, i);
+        if (series->container == rec->container)
+        {
+            return series;
+        }
+    }
+    replay_series *series = (replay_series *)calloc(1, sizeof(replay_series));
+    if (series != NULL)
+    {
+        series->container = rec->container;
+        arraylist_add(all, series);
+    }
+    return series;
+}
+
+static int replay_series_add(replay_series *series, const cld_stats_record *rec)
+{
+    if (series->len == series->cap)
+    {
+        size_t cap = series->cap == 0 ? 256 : series->cap * 2;
+        double *cpu = (double *)realloc(series->cpu, cap * sizeof(double));
+        if (cpu != NULL)
+        {
+            series->cpu = cpu;
+        }
+        double *mem = (double *)realloc(series->mem, cap * sizeof(double));
+        if (mem != NULL)
+        {
+            series->mem = mem;
+        }
+        double *pids = (double *)realloc(series->pids, cap * sizeof(double));
+        if (pids != NULL)
+        {
+            series->pids = pids;
+        }
+        if (cpu == NULL || mem == NULL || pids == NULL)
+        {
+            return -1;
+        }
+        series->cap = cap;
+    }
+    series->cpu[series->len] = rec->cpu_percent;
+    series->mem[series->len] = (double)rec->mem_usage;
+    series->pids[series->len] = (double)rec->pids;
+    series->len++;
+    return 0;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* Nearest rank percentile of sorted values. */
+static double percentile(const double *sorted, size_t len, size_t p)
+{
+    size_t rank = (p * len + 99) / 100;
+    return sorted[rank == 0 ? 0 : rank - 1];
+}
+
+/* Format the min / p50 / p99 / max of values, sorting them. */
+static void format_summary(double *values, size_t len, int kind,
+                           char *buf, size_t buflen)
+{
+    double points[4];
+    qsort(values, len, sizeof(double), &compare_double);
+    points[0] = values[0];
+    points[1] = percentile(values, len, 50);
+    points[2] = percentile(values, len, 99);
+    points[3] = values[len - 1];
+
+    size_t off = 0;
+    for (int i = 0; i < 4 && off < buflen; i++)
+    {
+        char val[32];
+        if (kind == 0)
+        {
+            snprintf(val, sizeof(val), "%.2f%%", points[i]);
+        }
+        else if (kind == 1)
+        {
+            cld_stats_format_size((uint64_t)points[i], true, val, sizeof(val));
+        }
+        else
+        {
+            snprintf(val, sizeof(val), "%.0f", points[i]);
+        }
+        off += snprintf(buf + off, buflen - off, i == 0 ? "%s" : " / %s", val);
+    }
+}
+
+static zclk_res replay_summary(cld_stats_ring *ring,
+                               zclk_command_output_handler success_handler)
+{
+    arraylist *all;
+    if (arraylist_new(&all, &free_replay_series) != 0)
+    {
+        return ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+
+    zclk_res res = ZCLK_RES_SUCCESS;
+    uint64_t count = cld_stats_ring_count(ring);
+    for (uint64_t i = 0; i < count && res == ZCLK_RES_SUCCESS; i++)
+    {
+        cld_stats_record rec;
+        res = cld_stats_ring_read(ring, i, &rec);
+        if (res == ZCLK_RES_SUCCESS)
+        {
+            replay_series *series = replay_series_get(all, &rec);
+            if (series == NULL || replay_series_add(series, &rec) != 0)
+            {
+                res = ZCLK_RES_ERR_ALLOC_FAILED;
+            }
+        }
+    }
+
+    zclk_table *tbl;
+    size_t len = arraylist_length(all);
+    if (res == ZCLK_RES_SUCCESS && create_zclk_table(&tbl, len, 6) == 0)
+    {
+        zclk_table_set_header(tbl, 0, "CONTAINER ID");
+        zclk_table_set_header(tbl, 1, "NAME");
+        zclk_table_set_header(tbl, 2, "SAMPLES");
+        zclk_table_set_header(tbl, 3, "CPU % MIN / P50 / P99 / MAX");
+        zclk_table_set_header(tbl, 4, "MEM USAGE MIN / P50 / P99 / MAX");
+        zclk_table_set_header(tbl, 5, "PIDS MIN / P50 / P99 / MAX");
+        for (size_t i = 0; i < len; i++)
+        {
+            replay_series *series = (replay_series *)arraylist_get(all, i);
+            const cld_stats_container *c =
+                cld_stats_ring_container_get(ring, series->container);
+            char val[256];
+            zclk_table_set_row_val(tbl, i, 0, c->id);
+            zclk_table_set_row_val(tbl, i, 1, c->name);
+            snprintf(val, sizeof(val), "%zu", series->len);
+            zclk_table_set_row_val(tbl, i, 2, val);
+            format_summary(series->cpu, series->len, 0, val, sizeof(val));
+            zclk_table_set_row_val(tbl, i, 3, val);
+            format_summary(series->mem, series->len, 1, val, sizeof(val));
+            zclk_table_set_row_val(tbl, i, 4, val);
+            format_summary(series->pids, series->len, 2, val, sizeof(val));
+            zclk_table_set_row_val(tbl, i, 5, val);
+        }
+        success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_TABLE, tbl);
+        free_zclk_table(tbl);
+    }
+    else if (res == ZCLK_RES_SUCCESS)
+    {
+        res = ZCLK_RES_ERR_ALLOC_FAILED;
+    }
+    arraylist_free(all);
+    return res;
+}
+
+zclk_res cld_stats_replay(const char *path, bool summary,
+                          zclk_command_output_handler success_handler,
+                          zclk_command_output_handler error_handler)
+{
+    cld_stats_ring *ring;
+    if (cld_stats_ring_open(&ring, path, 0, false) != ZCLK_RES_SUCCESS)
+    {
+        char res_str[1024];
+        snprintf(res_str, sizeof(res_str), "Could not read stats recording %s",
+                 path);
+        error_handler(ZCLK_RES_ERR_UNKNOWN, ZCLK_RESULT_STRING, res_str);
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+
+    zclk_res res = summary ? replay_summary(ring, success_handler)
+                           : replay_records(ring, success_handler);
+    cld_stats_ring_close(ring);
+    if (res != ZCLK_RES_SUCCESS)
+    {
+        error_handler(res, ZCLK_RESULT_STRING, "Could not replay the recording");
+    }
+    return res;
+}
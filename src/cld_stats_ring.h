@@ -0,0 +1,117 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SRC_CLD_STATS_RING_H_
+#define SRC_CLD_STATS_RING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cld_common.h"
+#include "cld_stats.h"
+
+#define CLD_STATS_RING_DEFAULT_CAPACITY 100000
+#define CLD_STATS_RING_MAX_CONTAINERS 4096
+#define CLD_STATS_RING_ID_LEN 16
+#define CLD_STATS_RING_NAME_LEN 48
+
+/**
+ * A container of a recording. The containers are kept in a table after the
+ * file header, so that records only carry the index of their container.
+ */
+typedef struct cld_stats_container_t
+{
+    char id[CLD_STATS_RING_ID_LEN];
+    char name[CLD_STATS_RING_NAME_LEN];
+} cld_stats_container;
+
+/**
+ * One recorded stats sample of a container. Records have a fixed size so
+ * that the recording file is a ring of records which never grows beyond
+ * its capacity, the oldest records being overwritten.
+ */
+typedef struct cld_stats_record_t
+{
+    int64_t time_ms;
+    uint32_t container;
+    uint32_t pids;
+    double cpu_percent;
+    uint64_t mem_usage;
+    uint64_t mem_limit;
+    uint64_t net_rx;
+    uint64_t net_tx;
+    uint64_t blk_read;
+    uint64_t blk_write;
+} cld_stats_record;
+
+typedef struct cld_stats_ring_t cld_stats_ring;
+
+/**
+ * Open a recording file, creating it with room for capacity records if it
+ * does not exist and create is true. An existing file keeps its capacity.
+ */
+zclk_res cld_stats_ring_open(cld_stats_ring **ring, const char *path,
+                             uint64_t capacity, bool create);
+
+/** Write the header and close the file. */
+void cld_stats_ring_close(cld_stats_ring *ring);
+
+/**
+ * Get the index of a container in the container table of the ring, adding
+ * it if it is not there yet. A container is added in the slot of one whose
+ * records have all been overwritten, if any. Fails when the
+ * CLD_STATS_RING_MAX_CONTAINERS slots all have records in the ring.
+ */
+zclk_res cld_stats_ring_container(cld_stats_ring *ring, const char *id,
+                                  const char *name, uint32_t *index);
+
+/** The container at index in the container table, NULL if there is none. */
+const cld_stats_container *cld_stats_ring_container_get(cld_stats_ring *ring,
+                                                        uint32_t index);
+
+/** Fill a record from the computed stats of a container. */
+void cld_stats_record_set(cld_stats_record *rec, int64_t time_ms,
+                          uint32_t container, const cld_stats_row *row);
+
+/** Append a record, overwriting the oldest one if the ring is full. */
+zclk_res cld_stats_ring_append(cld_stats_ring *ring, const cld_stats_record *rec);
+
+/** Write the header, making the appended records visible to readers. */
+zclk_res cld_stats_ring_flush(cld_stats_ring *ring);
+
+/** Number of records in the ring. */
+uint64_t cld_stats_ring_count(cld_stats_ring *ring);
+
+/** Read the record at index, 0 being the oldest record. */
+zclk_res cld_stats_ring_read(cld_stats_ring *ring, uint64_t index,
+                             cld_stats_record *rec);
+
+/**
+ * Output a recording: all its records as one table, or with summary a
+ * table with the min, max, p50 and p99 of the CPU %, memory usage and PIDs
+ * of every container.
+ */
+zclk_res cld_stats_replay(const char *path, bool summary,
+                          zclk_command_output_handler success_handler,
+                          zclk_command_output_handler error_handler);
+
+#endif /* SRC_CLD_STATS_RING_H_ */
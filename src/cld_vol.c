@@ -24,6 +24,7 @@
 #include "zclk_table.h"
 #include "docker_all.h"
 #include "cld_vol.h"
+#include "cld_format.h"
 
 zclk_res vol_ls_cmd_handler(zclk_command* cmd, void *handler_args)
 {
@@ -32,8 +33,28 @@ zclk_res vol_ls_cmd_handler(zclk_command* cmd, void *handler_args)
 	docker_volume_list *volumes;
 	docker_volume_warnings *warnings;
 
+	char *format = zclk_option_get_val_string(get_option_by_name(cmd->options,
+		CLD_OPTION_LONG_FORMAT));
+
 	d_err_t docker_error = docker_volumes_list(ctx, &volumes, &warnings, 0, NULL, NULL, NULL);
-	if (docker_error == E_SUCCESS)
+	if (docker_error == E_SUCCESS && format != NULL)
+	{
+		json_object *rows = json_object_new_array();
+		size_t len_volumes = docker_volume_list_length(volumes);
+		for (size_t i = 0; i < len_volumes; i++)
+		{
+			docker_volume *vol = (docker_volume *)docker_volume_list_get_idx(volumes, i);
+			json_object *row = json_object_new_object();
+			cld_format_row_add(row, "Driver", docker_volume_driver_get(vol));
+			cld_format_row_add(row, "Name", docker_volume_name_get(vol));
+			cld_format_row_add(row, "Mountpoint", docker_volume_mountpoint_vol_get(vol));
+			json_object_array_add(rows, row);
+		}
+		zclk_res err = cld_format_output(cmd, format, rows);
+		json_object_put(rows);
+		return err;
+	}
+	else if (docker_error == E_SUCCESS)
 	{
 		char res_str[1024];
 		sprintf(res_str, "Listing volumes");
@@ -85,6 +106,8 @@ zclk_command *vol_commands()
 										 &vol_ls_cmd_handler);
 		if(volls_command != NULL)
 		{
+			zclk_command_string_option(volls_command, CLD_OPTION_LONG_FORMAT,
+				NULL, NULL, "Pretty-print volumes using a template (e.g. \"{{.Name}}\\t{{.Driver}}\")");
 			zclk_command_subcommand_add(image_command, volls_command);
 		}
 	}
@@ -20,6 +20,7 @@
 #define _GNU_SOURCE
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #ifdef _WIN32
 #include <malloc.h>
@@ -55,9 +56,38 @@
 # undef NO_EQUAL_VALUE_EXTENSION_FOR_MUSTACH
 #endif
 
+struct jkey;
+
+/*
+ * a partial read from a file, kept by name for the next uses
+ */
+struct partial {
+	struct partial *next;
+	char *name;
+	char *value;	/* "" if not found */
+};
+
+/*
+ * a template compiled with the keys of its tags pre-parsed, see jkey
+ */
+struct mustach_json_c_template {
+	struct mustach_template *compiled;
+	const char *names;	/* the pool of names of compiled */
+	size_t size;
+	struct jkey **keys;	/* by offset of the name in names */
+	unsigned serial;	/* last serial given to a stack entry */
+	struct partial *partials;	/* read for all the renders */
+	char *partial_dir;	/* also searched for partials, or NULL */
+};
+
 struct expl {
 	struct json_object *root;
 	mustach_json_c_write_cb writecb;
+	struct mustach_json_c_template *tpl;	/* NULL if not compiled */
+	unsigned serial;
+	struct partial **partials;	/* of the template, or of this render */
+	struct partial *own_partials;
+	const char *partial_dir;
 	int depth;
 #if !defined(NO_OBJECT_ITERATION_FOR_MUSTACH)
 	int found_objiter;
@@ -70,6 +100,7 @@ struct expl {
 		int is_objiter;
 #endif
 		int index, count;
+		unsigned serial;	/* changes each time obj is set */
 	} stack[MUSTACH_MAX_DEPTH];
 };
 
@@ -261,6 +292,147 @@ static struct json_object *find(struct expl *e, const char *name)
 	return o;
 }
 
+/*
+ * a key of a tag of a compiled template, split into its segments with the
+ * comparison classified once, as find does it for every lookup
+ */
+struct jkey {
+	char *buffer;		/* the copy of the name, holding segments and value */
+	int dot;		/* the key is . alone */
+	size_t count;
+	char **segments;
+	char *value;		/* value to compare with, or NULL */
+	enum comp comp;
+	int negate;
+	/*
+	 * cache of the lookup of the first segment: for the stack entry of
+	 * serial, it was found at depth (or not found when depth < 0).
+	 * The serial of the top entry changes when any entry changes.
+	 */
+	unsigned serial;
+	int depth;
+	struct json_object *obj;
+};
+
+static void jkey_free(struct jkey *k)
+{
+	if (k != NULL) {
+		free(k->buffer);
+		free(k->segments);
+		free(k);
+	}
+}
+
+static struct jkey *jkey_compile(const char *name)
+{
+	struct jkey *k;
+	char *n, *c;
+	int isptr;
+
+	k = calloc(1, sizeof *k);
+	if (k == NULL)
+		return NULL;
+	n = k->buffer = malloc(1 + strlen(name));
+	k->segments = malloc((1 + strlen(name)) * sizeof *k->segments);
+	if (n == NULL || k->segments == NULL) {
+		jkey_free(k);
+		return NULL;
+	}
+	strcpy(n, name);
+	isptr = 0;
+#if !defined(NO_JSON_POINTER_EXTENSION_FOR_MUSTACH)
+	isptr = n[0] == '/';
+	n += isptr;
+#endif
+	k->value = keyval(n, isptr, &k->comp);
+	if (k->value) {
+		k->negate = k->value[0] == '!';
+		k->value += k->negate;
+	}
+#if !defined(NO_SINGLE_DOT_EXTENSION_FOR_MUSTACH)
+	if (n[0] == '.' && !n[1])
+		k->dot = 1;
+	else
+#endif
+	while ((c = key(&n, isptr)) != NULL)
+		k->segments[k->count++] = c;
+	return k;
+}
+
+#if !defined(NO_OBJECT_ITERATION_FOR_MUSTACH)
+static int is_objiter_key(struct jkey *k, size_t i, struct json_object *o)
+{
+	char *c = k->segments[i];
+	return c[0] == '*' && !c[1] && !k->value && i + 1 == k->count
+		&& json_object_is_type(o, json_type_object);
+}
+#endif
+
+static struct json_object *find_key(struct expl *e, struct jkey *k)
+{
+	int i;
+	size_t s;
+	struct json_object *o, *no;
+
+#if !defined(NO_OBJECT_ITERATION_FOR_MUSTACH)
+	e->found_objiter = 0;
+#endif
+	if (k->dot) {
+		/* case of . alone */
+		o = e->stack[e->depth].obj;
+	} else {
+		if (k->count == 0)
+			return NULL;
+		if (k->serial == e->stack[e->depth].serial) {
+			i = k->depth;
+			o = k->obj;
+		} else {
+			o = NULL;
+			i = e->depth;
+			while (i >= 0 && !json_object_object_get_ex(e->stack[i].obj, k->segments[0], &o))
+				i--;
+			k->serial = e->stack[e->depth].serial;
+			k->depth = i;
+			k->obj = o;
+		}
+		if (i < 0) {
+#if !defined(NO_OBJECT_ITERATION_FOR_MUSTACH)
+			o = e->stack[e->depth].obj;
+			if (is_objiter_key(k, 0, o)) {
+				e->found_objiter = 1;
+				return o;
+			}
+#endif
+			return NULL;
+		}
+		for (s = 1 ; s < k->count ; s++) {
+			if (!json_object_object_get_ex(o, k->segments[s], &no)) {
+#if !defined(NO_OBJECT_ITERATION_FOR_MUSTACH)
+				if (is_objiter_key(k, s, o)) {
+					e->found_objiter = 1;
+					return o;
+				}
+#endif
+				return NULL;
+			}
+			o = no;
+		}
+	}
+	if (k->value && k->negate == evalcomp(o, k->value, k->comp))
+		o = NULL;
+	return o;
+}
+
+static struct json_object *lookup(struct expl *e, const char *name)
+{
+	struct mustach_json_c_template *t = e->tpl;
+
+	/* names of the compiled template are in its pool, not those of partials */
+	if (t != NULL && name >= t->names && name < t->names + t->size)
+		return find_key(e, t->keys[name - t->names]);
+	return find(e, name);
+}
+
 static int start(void *closure)
 {
 	struct expl *e = closure;
@@ -269,6 +441,7 @@ static int start(void *closure)
 	e->stack[0].obj = e->root;
 	e->stack[0].index = 0;
 	e->stack[0].count = 1;
+	e->stack[0].serial = ++e->serial;
 	return MUSTACH_OK;
 }
 
@@ -304,9 +477,9 @@ static const char *item(struct expl *e, const char *name)
 	if (name[0] == '*' && !name[1] && e->stack[e->depth].is_objiter)
 		s = json_object_iter_peek_name(&e->stack[e->depth].biter);
 	else
-		s = (o = find(e, name)) && !e->found_objiter ? json_object_get_string(o) : NULL;
+		s = (o = lookup(e, name)) && !e->found_objiter ? json_object_get_string(o) : NULL;
 #else
-	s = (o = find(e, name)) ? json_object_get_string(o) : NULL;
+	s = (o = lookup(e, name)) ? json_object_get_string(o) : NULL;
 #endif
 	return s;
 }
@@ -314,7 +487,7 @@ static const char *item(struct expl *e, const char *name)
 static int enter(void *closure, const char *name)
 {
 	struct expl *e = closure;
-	struct json_object *o = find(e, name);
+	struct json_object *o = lookup(e, name);
 	if (++e->depth >= MUSTACH_MAX_DEPTH)
 		return MUSTACH_ERROR_TOO_DEEP;
 	if (json_object_is_type(o, json_type_array)) {
@@ -351,6 +524,7 @@ static int enter(void *closure, const char *name)
 		e->depth--;
 		return 0;
 	}
+	e->stack[e->depth].serial = ++e->serial;
 	return 1;
 }
 
@@ -365,6 +539,7 @@ static int next(void *closure)
 		if (json_object_iter_equal(&e->stack[e->depth].biter, &e->stack[e->depth].eiter))
 			return 0;
 		e->stack[e->depth].obj = json_object_iter_peek_value(&e->stack[e->depth].biter);
+		e->stack[e->depth].serial = ++e->serial;
 		return 1;
 	}
 #endif
@@ -372,6 +547,7 @@ static int next(void *closure)
 	if (e->stack[e->depth].index >= e->stack[e->depth].count)
 		return 0;
 	e->stack[e->depth].obj = json_object_array_get_idx(e->stack[e->depth].cont, e->stack[e->depth].index);
+	e->stack[e->depth].serial = ++e->serial;
 	return 1;
 }
 
@@ -385,54 +561,109 @@ static int leave(void *closure)
 }
 
 #if !defined(NO_INCLUDE_PARTIAL_FALLBACK)
-static int get_partial_from_file(const char *name, struct mustach_sbuf *sbuf)
+static char *read_partial_file(const char *path)
 {
-	static char extension[] = INCLUDE_PARTIAL_EXTENSION;
 	size_t s;
 	long pos;
 	FILE *file;
+	char *buffer;
+
+	file = fopen(path, "r");
+	if (file == NULL)
+		return NULL;
+
+	/* compute file size */
+	buffer = NULL;
+	if (fseek(file, 0, SEEK_END) >= 0
+	 && (pos = ftell(file)) >= 0
+	 && fseek(file, 0, SEEK_SET) >= 0) {
+		/* allocate value */
+		s = (size_t)pos;
+		buffer = malloc(s + 1);
+		if (buffer != NULL) {
+			/* read value, force zero at end */
+			if (s == 0 || 1 == fread(buffer, s, 1, file))
+				buffer[s] = 0;
+			else {
+				free(buffer);
+				buffer = NULL;
+			}
+		}
+	}
+	fclose(file);
+	return buffer;
+}
+
+/* reads the partial of name, from the current directory or from dir */
+static char *get_partial_from_file(const char *name, const char *dir)
+{
+	static char extension[] = INCLUDE_PARTIAL_EXTENSION;
+	size_t s, d;
 	char *path, *buffer;
 
 	/* allocate path */
 	s = strlen(name);
-	path = malloc(s + sizeof extension);
+	d = dir ? strlen(dir) + 1 : 0;
+	path = malloc(d + s + sizeof extension);
 	if (path == NULL)
-		return MUSTACH_ERROR_SYSTEM;
+		return NULL;
 
 	/* try without extension first */
 	memcpy(path, name, s + 1);
-	file = fopen(path, "r");
-	if (file == NULL) {
+	buffer = read_partial_file(path);
+	if (buffer == NULL) {
 		memcpy(&path[s], extension, sizeof extension);
-		file = fopen(path, "r");
+		buffer = read_partial_file(path);
+	}
+	if (buffer == NULL && dir != NULL) {
+		memcpy(path, dir, d - 1);
+		path[d - 1] = '/';
+		memcpy(&path[d], name, s + 1);
+		buffer = read_partial_file(path);
+		if (buffer == NULL) {
+			memcpy(&path[d + s], extension, sizeof extension);
+			buffer = read_partial_file(path);
+		}
 	}
 	free(path);
+	return buffer;
+}
 
-	/* if file opened */
-	if (file != NULL) {
-		/* compute file size */
-		if (fseek(file, 0, SEEK_END) >= 0
-		 && (pos = ftell(file)) >= 0
-		 && fseek(file, 0, SEEK_SET) >= 0) {
-			/* allocate value */
-			s = (size_t)pos;
-			buffer = malloc(s + 1);
-			if (buffer != NULL) {
-				/* read value */
-				if (1 == fread(buffer, s, 1, file)) {
-					/* force zero at end */
-					sbuf->value = buffer;
-					buffer[s] = 0;
-					sbuf->freecb = free;
-					fclose(file);
-					return MUSTACH_OK;
-				}
-				free(buffer);
-			}
-		}
-		fclose(file);
+static void partials_free(struct partial *p)
+{
+	struct partial *next;
+
+	while (p != NULL) {
+		next = p->next;
+		free(p->name);
+		free(p->value);
+		free(p);
+		p = next;
 	}
-	return MUSTACH_ERROR_SYSTEM;
+}
+
+/* the partial of name, read once for all the renders of a template */
+static const char *cached_partial(struct expl *e, const char *name)
+{
+	struct partial *p;
+	char *value;
+
+	for (p = *e->partials ; p != NULL ; p = p->next)
+		if (!strcmp(p->name, name))
+			return p->value;
+
+	value = get_partial_from_file(name, e->partial_dir);
+	p = malloc(sizeof *p);
+	if (p == NULL || (p->name = strdup(name)) == NULL
+	 || (value == NULL && (value = strdup("")) == NULL)) {
+		free(p);
+		free(value);
+		return NULL;
+	}
+	p->value = value;
+	p->next = *e->partials;
+	*e->partials = p;
+	return value;
 }
 
 static int partial(void *closure, const char *name, struct mustach_sbuf *sbuf)
@@ -441,10 +672,11 @@ static int partial(void *closure, const char *name, struct mustach_sbuf *sbuf)
 	const char *s;
 
 	s = item(e, name);
-	if (s)
-		sbuf->value = s;
-	else if (get_partial_from_file(name, sbuf) < 0)
-		sbuf->value = "";
+	if (s == NULL)
+		s = cached_partial(e, name);
+	if (s == NULL)
+		return MUSTACH_ERROR_SYSTEM;
+	sbuf->value = s;
 	return MUSTACH_OK;
 }
 #endif
@@ -494,33 +726,127 @@ static struct mustach_itf itfuw = {
 	.stop = NULL
 };
 
+static void expl_init(struct expl *e, struct json_object *root, mustach_json_c_write_cb writecb)
+{
+	e->root = root;
+	e->writecb = writecb;
+	e->tpl = NULL;
+	e->serial = 0;
+	e->own_partials = NULL;
+	e->partials = &e->own_partials;
+	e->partial_dir = NULL;
+}
+
+static int expl_end(struct expl *e, int rc)
+{
+#if !defined(NO_INCLUDE_PARTIAL_FALLBACK)
+	partials_free(e->own_partials);
+#endif
+	return rc;
+}
+
 int fmustach_json_c(const char *template, struct json_object *root, FILE *file)
 {
 	struct expl e;
-	e.root = root;
-	return fmustach(template, &itf, &e, file);
+	expl_init(&e, root, NULL);
+	return expl_end(&e, fmustach(template, &itf, &e, file));
 }
 
 int fdmustach_json_c(const char *template, struct json_object *root, int fd)
 {
 	struct expl e;
-	e.root = root;
-	return fdmustach(template, &itf, &e, fd);
+	expl_init(&e, root, NULL);
+	return expl_end(&e, fdmustach(template, &itf, &e, fd));
 }
 
 int mustach_json_c(const char *template, struct json_object *root, char **result, size_t *size)
 {
 	struct expl e;
-	e.root = root;
-	e.writecb = NULL;
-	return mustach(template, &itf, &e, result, size);
+	expl_init(&e, root, NULL);
+	return expl_end(&e, mustach(template, &itf, &e, result, size));
 }
 
 int umustach_json_c(const char *template, struct json_object *root, mustach_json_c_write_cb writecb, void *closure)
 {
 	struct expl e;
-	e.root = root;
-	e.writecb = writecb;
-	return fmustach(template, &itfuw, &e, closure);
+	expl_init(&e, root, writecb);
+	return expl_end(&e, fmustach(template, &itfuw, &e, closure));
+}
+
+int mustach_json_c_compile(const char *template, struct mustach_json_c_template **compiled)
+{
+	struct mustach_json_c_template *t;
+	size_t i;
+	int rc;
+
+	*compiled = NULL;
+	t = calloc(1, sizeof *t);
+	if (t == NULL)
+		return MUSTACH_ERROR_SYSTEM;
+	rc = mustach_compile(template, &t->compiled);
+	if (rc < 0) {
+		free(t);
+		return rc;
+	}
+	t->names = mustach_template_names(t->compiled, &t->size);
+	t->keys = calloc(t->size ? t->size : 1, sizeof *t->keys);
+	if (t->keys == NULL) {
+		mustach_json_c_template_free(t);
+		return MUSTACH_ERROR_SYSTEM;
+	}
+	for (i = 0 ; i < t->size ; i += strlen(&t->names[i]) + 1) {
+		t->keys[i] = jkey_compile(&t->names[i]);
+		if (t->keys[i] == NULL) {
+			mustach_json_c_template_free(t);
+			return MUSTACH_ERROR_SYSTEM;
+		}
+	}
+	*compiled = t;
+	return MUSTACH_OK;
+}
+
+void mustach_json_c_template_free(struct mustach_json_c_template *compiled)
+{
+	size_t i;
+
+	if (compiled != NULL) {
+		if (compiled->keys != NULL)
+			for (i = 0 ; i < compiled->size ; i++)
+				jkey_free(compiled->keys[i]);
+		free(compiled->keys);
+#if !defined(NO_INCLUDE_PARTIAL_FALLBACK)
+		partials_free(compiled->partials);
+#endif
+		free(compiled->partial_dir);
+		mustach_template_free(compiled->compiled);
+		free(compiled);
+	}
+}
+
+int umustach_json_c_exec(struct mustach_json_c_template *compiled, struct json_object *root, mustach_json_c_write_cb writecb, void *closure)
+{
+	struct expl e;
+	int rc;
+
+	expl_init(&e, root, writecb);
+	e.tpl = compiled;
+	/* serials go on from the last render, keeping the cached ones stale */
+	e.serial = compiled->serial;
+	e.partials = &compiled->partials;
+	e.partial_dir = compiled->partial_dir;
+	rc = mustach_exec(compiled->compiled, &itfuw, &e, closure);
+	compiled->serial = e.serial;
+	return rc;
 }
 
+int mustach_json_c_template_partial_dir(struct mustach_json_c_template *compiled, const char *dir)
+{
+	char *copy;
+
+	copy = dir ? strdup(dir) : NULL;
+	if (dir && copy == NULL)
+		return MUSTACH_ERROR_SYSTEM;
+	free(compiled->partial_dir);
+	compiled->partial_dir = copy;
+	return MUSTACH_OK;
+}
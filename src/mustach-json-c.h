@@ -74,5 +74,57 @@ extern int mustach_json_c(const char *template, struct json_object *root, char *
 typedef int (*mustach_json_c_write_cb)(void*closure, const char*buffer, size_t size);
 extern int umustach_json_c(const char *template, struct json_object *root, mustach_json_c_write_cb writecb, void *closure);
 
+/**
+ * mustach_json_c_compile - Compiles the mustache 'template' for repeated renders.
+ *
+ * Like mustach_compile, and the keys of the tags are also split into their
+ * segments and comparisons once, instead of at every lookup. A compiled
+ * template keeps a cache of the stack depth resolving every key, so it
+ * must not be rendered by several threads at once.
+ *
+ * @template: the template string to compile, not needed after the call
+ * @compiled: the pointer receiving the compiled template when 0 is returned
+ *
+ * Returns 0 in case of success, -1 with errno set in case of system error
+ * a other negative value in case of error in the template.
+ */
+struct mustach_json_c_template;
+extern int mustach_json_c_compile(const char *template, struct mustach_json_c_template **compiled);
+
+/**
+ * mustach_json_c_template_free - Frees a template compiled with mustach_json_c_compile.
+ */
+extern void mustach_json_c_template_free(struct mustach_json_c_template *compiled);
+
+/**
+ * umustach_json_c_exec - Renders the 'compiled' template for 'root' to custom writer 'writecb' with 'closure'.
+ *
+ * @compiled: the template compiled with mustach_json_c_compile
+ * @root:     the root json object to render
+ * @writecb:  the function that write values
+ * @closure:  the closure for the write function
+ *
+ * Returns 0 in case of success, -1 with errno set in case of system error
+ * a other negative value in case of error.
+ */
+extern int umustach_json_c_exec(struct mustach_json_c_template *compiled, struct json_object *root, mustach_json_c_write_cb writecb, void *closure);
+
+/**
+ * mustach_json_c_template_partial_dir - Sets a directory where the partials of 'compiled' are searched.
+ *
+ * A partial {{> name}} that is not a value of the rendered object is read
+ * from the file 'name' or 'name.mustache', in the current directory or
+ * else in 'dir'. The files are read once, at their first use, and kept
+ * with the compiled template for all its renders (a file that is not
+ * found is not searched again). Renders of templates not compiled keep
+ * the partials they read until they end.
+ *
+ * @compiled: the template compiled with mustach_json_c_compile
+ * @dir:      the directory, or NULL for none
+ *
+ * Returns 0 in case of success, -1 in case of system error.
+ */
+extern int mustach_json_c_template_partial_dir(struct mustach_json_c_template *compiled, const char *dir);
+
 #endif
 
@@ -26,6 +26,9 @@
 #include <ctype.h>
 #ifdef _WIN32
 #include <malloc.h>
+#include <io.h>
+#else
+#include <unistd.h>
 #endif
 #ifdef __sun
 # include <alloca.h>
@@ -33,6 +36,11 @@
 
 #include "mustach.h"
 
+/* open_memstream is only needed for interfaces writing to a real FILE */
+#if defined(_WIN32) && !defined(NO_OPEN_MEMSTREAM)
+# define NO_OPEN_MEMSTREAM
+#endif
+
 #if defined(NO_EXTENSION_FOR_MUSTACH)
 # undef  NO_COLON_EXTENSION_FOR_MUSTACH
 # define NO_COLON_EXTENSION_FOR_MUSTACH
@@ -85,50 +93,86 @@ static int memfile_close(FILE *file, char **buffer, size_t *size)
 #else
 static FILE *memfile_open(char **buffer, size_t *size)
 {
-	/*
-	 * We can't provide *buffer and *size as open_memstream does but
-	 * at least clear them so the caller won't get bad data.
-	 */
 	*buffer = NULL;
 	*size = 0;
-
-	return tmpfile();
+	errno = ENOTSUP;
+	return NULL;
 }
 static void memfile_abort(FILE *file, char **buffer, size_t *size)
 {
-	fclose(file);
-	*buffer = NULL;
-	*size = 0;
 }
 static int memfile_close(FILE *file, char **buffer, size_t *size)
+{
+	return MUSTACH_ERROR_SYSTEM;
+}
+#endif
+
+/*
+ * Output to a growable memory buffer (fd < 0) or to a file descriptor
+ * through a fixed buffer, used instead of a FILE when the interface does
+ * not write to the FILE itself (no put and no emit callback).
+ */
+#define OUTBUF_FD_SIZE 8192
+
+struct outbuf {
+	char *data;
+	size_t len, cap;
+	int fd;
+};
+
+static int write_all(int fd, const char *buffer, size_t size)
+{
+	size_t done;
+	long n;
+
+	for (done = 0 ; done < size ; done += (size_t)n) {
+		n = write(fd, &buffer[done], (unsigned)(size - done));
+		if (n < 0) {
+			if (errno != EINTR)
+				return MUSTACH_ERROR_SYSTEM;
+			n = 0;
+		}
+	}
+	return MUSTACH_OK;
+}
+
+static int outbuf_flush(struct outbuf *ob)
 {
 	int rc;
-	size_t s;
-	char *b;
 
-	s = (size_t)ftell(file);
-	b = malloc(s + 1);
-	if (b == NULL) {
-		rc = MUSTACH_ERROR_SYSTEM;
-		errno = ENOMEM;
-		s = 0;
-	} else {
-		rewind(file);
-		if (1 == fread(b, s, 1, file)) {
-			rc = 0;
-			b[s] = 0;
+	rc = write_all(ob->fd, ob->data, ob->len);
+	ob->len = 0;
+	return rc;
+}
+
+static int outbuf_write(struct outbuf *ob, const char *buffer, size_t size)
+{
+	size_t cap;
+	char *data;
+
+	if (ob->len + size > ob->cap) {
+		if (ob->fd >= 0) {
+			if (outbuf_flush(ob) < 0)
+				return MUSTACH_ERROR_SYSTEM;
+			/* too big for the buffer, written as is */
+			if (size > ob->cap)
+				return write_all(ob->fd, buffer, size);
 		} else {
-			rc = MUSTACH_ERROR_SYSTEM;
-			free(b);
-			b = NULL;
-			s = 0;
+			/* keeps room for the terminating null */
+			cap = ob->cap ? ob->cap : 1024;
+			while (ob->len + size >= cap)
+				cap *= 2;
+			data = realloc(ob->data, cap);
+			if (data == NULL)
+				return MUSTACH_ERROR_SYSTEM;
+			ob->data = data;
+			ob->cap = cap;
 		}
 	}
-	*buffer = b;
-	*size = s;
-	return rc;
+	memcpy(&ob->data[ob->len], buffer, size);
+	ob->len += size;
+	return MUSTACH_OK;
 }
-#endif
 
 static inline void sbuf_reset(struct mustach_sbuf *sbuf)
 {
@@ -143,44 +187,56 @@ static inline void sbuf_release(struct mustach_sbuf *sbuf)
 		sbuf->releasecb(sbuf->value, sbuf->closure);
 }
 
-static int iwrap_emit(void *closure, const char *buffer, size_t size, int escape, FILE *file)
+typedef int (*writefn)(void *out, const char *buffer, size_t size);
+
+static int file_write(void *out, const char *buffer, size_t size)
 {
-	size_t i, j;
+	return fwrite(buffer, size, 1, (FILE *)out) != 1 ? MUSTACH_ERROR_SYSTEM : MUSTACH_OK;
+}
 
-	(void)closure; /* unused */
+static int escaped_write(writefn w, void *out, const char *buffer, size_t size, int escape)
+{
+	size_t i, j;
+	int rc;
 
 	if (!escape)
-		return fwrite(buffer, size, 1, file) != 1 ? MUSTACH_ERROR_SYSTEM : MUSTACH_OK;
+		return w(out, buffer, size);
 
 	i = 0;
 	while (i < size) {
 		j = i;
 		while (j < size && buffer[j] != '<' && buffer[j] != '>' && buffer[j] != '&')
 			j++;
-		if (j != i && fwrite(&buffer[i], j - i, 1, file) != 1)
-			return MUSTACH_ERROR_SYSTEM;
+		if (j != i && (rc = w(out, &buffer[i], j - i)) < 0)
+			return rc;
 		if (j < size) {
 			switch(buffer[j++]) {
-			case '<':
-				if (fwrite("&lt;", 4, 1, file) != 1)
-					return MUSTACH_ERROR_SYSTEM;
-				break;
-			case '>':
-				if (fwrite("&gt;", 4, 1, file) != 1)
-					return MUSTACH_ERROR_SYSTEM;
-				break;
-			case '&':
-				if (fwrite("&amp;", 5, 1, file) != 1)
-					return MUSTACH_ERROR_SYSTEM;
-				break;
-			default: break;
+			case '<': rc = w(out, "&lt;", 4); break;
+			case '>': rc = w(out, "&gt;", 4); break;
+			case '&': rc = w(out, "&amp;", 5); break;
+			default: rc = MUSTACH_OK; break;
 			}
+			if (rc < 0)
+				return rc;
 		}
 		i = j;
 	}
 	return MUSTACH_OK;
 }
 
+static int iwrap_emit(void *closure, const char *buffer, size_t size, int escape, FILE *file)
+{
+	(void)closure; /* unused */
+	return escaped_write(file_write, file, buffer, size, escape);
+}
+
+/* the emit for an outbuf, given in place of the FILE */
+static int outbuf_emit(void *closure, const char *buffer, size_t size, int escape, FILE *file)
+{
+	(void)closure; /* unused */
+	return escaped_write((writefn)outbuf_write, file, buffer, size, escape);
+}
+
 static int iwrap_put(void *closure, const char *name, int escape, FILE *file)
 {
 	struct iwrap *iwrap = closure;
@@ -389,53 +445,441 @@ static int process(const char *template, struct iwrap *iwrap, FILE *file, const
 	}
 }
 
-int fmustach(const char *template, struct mustach_itf *itf, void *closure, FILE *file)
+
+/*
+ * compiled templates
+ */
+enum {
+	OP_TEXT,	/* emits the text */
+	OP_PUT,		/* puts the value of name, escaped */
+	OP_PUT_RAW,	/* puts the value of name, not escaped */
+	OP_SECTION,	/* enters the section of name, jumps after its end if not entered */
+	OP_INVERTED,	/* enters the section of name, jumps after its end if entered */
+	OP_END,		/* ends the section starting at jump */
+	OP_PARTIAL	/* renders the partial of name with the delimiters opstr and clstr */
+};
+
+struct mustach_op {
+	int code;
+	size_t name;	/* offset of the name in names, or of the text in text */
+	size_t length;	/* length of the text */
+	size_t jump;	/* section: index of its end, end: index of the first op of the section */
+	size_t opstr, clstr;	/* partial: offsets of the delimiters in names */
+};
+
+struct mustach_template {
+	char *text;
+	char *names;
+	size_t names_len, names_size;
+	struct mustach_op *ops;
+	size_t count, size;
+};
+
+static struct mustach_op *add_op(struct mustach_template *t, int code)
+{
+	struct mustach_op *ops;
+	size_t size;
+
+	if (t->count == t->size) {
+		size = t->size ? 2 * t->size : 32;
+		ops = realloc(t->ops, size * sizeof *ops);
+		if (ops == NULL)
+			return NULL;
+		t->ops = ops;
+		t->size = size;
+	}
+	ops = &t->ops[t->count++];
+	memset(ops, 0, sizeof *ops);
+	ops->code = code;
+	return ops;
+}
+
+/* returns the offset of name in the pool of names, adding it if needed */
+static int intern(struct mustach_template *t, const char *name, size_t len, size_t *offset)
+{
+	size_t i, l, size;
+	char *names;
+
+	for (i = 0 ; i < t->names_len ; i += l + 1) {
+		l = strlen(&t->names[i]);
+		if (l == len && !memcmp(&t->names[i], name, len)) {
+			*offset = i;
+			return MUSTACH_OK;
+		}
+	}
+	if (t->names_len + len + 1 > t->names_size) {
+		size = t->names_size ? t->names_size : 256;
+		while (t->names_len + len + 1 > size)
+			size *= 2;
+		names = realloc(t->names, size);
+		if (names == NULL)
+			return MUSTACH_ERROR_SYSTEM;
+		t->names = names;
+		t->names_size = size;
+	}
+	memcpy(&t->names[t->names_len], name, len);
+	t->names[t->names_len + len] = 0;
+	*offset = t->names_len;
+	t->names_len += len + 1;
+	return MUSTACH_OK;
+}
+
+static int add_text(struct mustach_template *t, const char *text, size_t len)
+{
+	struct mustach_op *op;
+
+	if (len == 0)
+		return MUSTACH_OK;
+	op = add_op(t, OP_TEXT);
+	if (op == NULL)
+		return MUSTACH_ERROR_SYSTEM;
+	op->name = (size_t)(text - t->text);
+	op->length = len;
+	return MUSTACH_OK;
+}
+
+/* the same parsing as process, producing operations instead of output */
+static int compile(struct mustach_template *t)
+{
+	const char *template, *opstr, *clstr, *beg, *term;
+	char c, *tmp;
+	size_t stack[MUSTACH_MAX_DEPTH];
+	size_t oplen, cllen, len, l, offset;
+	int depth, rc;
+	struct mustach_op *op;
+
+	template = t->text;
+	opstr = "{{";
+	clstr = "}}";
+	oplen = 2;
+	cllen = 2;
+	depth = 0;
+	for(;;) {
+		beg = strstr(template, opstr);
+		if (beg == NULL) {
+			rc = add_text(t, template, strlen(template));
+			if (rc < 0)
+				return rc;
+			return depth ? MUSTACH_ERROR_UNEXPECTED_END : MUSTACH_OK;
+		}
+		rc = add_text(t, template, (size_t)(beg - template));
+		if (rc < 0)
+			return rc;
+		beg += oplen;
+		term = strstr(beg, clstr);
+		if (term == NULL)
+			return MUSTACH_ERROR_UNEXPECTED_END;
+		template = term + cllen;
+		len = (size_t)(term - beg);
+		c = *beg;
+		switch(c) {
+		case '!':
+		case '=':
+			break;
+		case '{':
+			for (l = 0 ; clstr[l] == '}' ; l++);
+			if (clstr[l]) {
+				if (!len || beg[len-1] != '}')
+					return MUSTACH_ERROR_BAD_UNESCAPE_TAG;
+				len--;
+			} else {
+				if (term[l] != '}')
+					return MUSTACH_ERROR_BAD_UNESCAPE_TAG;
+				template++;
+			}
+			c = '&';
+			/*@fallthrough@*/
+		case '^':
+		case '#':
+		case '/':
+		case '&':
+		case '>':
+#if !defined(NO_COLON_EXTENSION_FOR_MUSTACH)
+		case ':':
+#endif
+			beg++; len--;
+		default:
+			while (len && isspace(beg[0])) { beg++; len--; }
+			while (len && isspace(beg[len-1])) len--;
+#if !defined(NO_ALLOW_EMPTY_TAG)
+			if (len == 0)
+				return MUSTACH_ERROR_EMPTY_TAG;
+#endif
+			if (len > MUSTACH_MAX_LENGTH)
+				return MUSTACH_ERROR_TAG_TOO_LONG;
+			rc = intern(t, beg, len, &offset);
+			if (rc < 0)
+				return rc;
+			break;
+		}
+		switch(c) {
+		case '!':
+			/* comment */
+			/* nothing to do */
+			break;
+		case '=':
+			/* defines separators */
+			if (len < 5 || beg[len - 1] != '=')
+				return MUSTACH_ERROR_BAD_SEPARATORS;
+			beg++;
+			len -= 2;
+			for (l = 0; l < len && !isspace(beg[l]) ; l++);
+			if (l == len)
+				return MUSTACH_ERROR_BAD_SEPARATORS;
+			oplen = l;
+			tmp = alloca(oplen + 1);
+			memcpy(tmp, beg, oplen);
+			tmp[oplen] = 0;
+			opstr = tmp;
+			while (l < len && isspace(beg[l])) l++;
+			if (l == len)
+				return MUSTACH_ERROR_BAD_SEPARATORS;
+			cllen = len - l;
+			tmp = alloca(cllen + 1);
+			memcpy(tmp, beg + l, cllen);
+			tmp[cllen] = 0;
+			clstr = tmp;
+			break;
+		case '^':
+		case '#':
+			/* begin section */
+			if (depth == MUSTACH_MAX_DEPTH)
+				return MUSTACH_ERROR_TOO_DEEP;
+			op = add_op(t, c == '#' ? OP_SECTION : OP_INVERTED);
+			if (op == NULL)
+				return MUSTACH_ERROR_SYSTEM;
+			op->name = offset;
+			stack[depth++] = t->count - 1;
+			break;
+		case '/':
+			/* end section, the names are interned so they compare by offset */
+			if (depth-- == 0 || t->ops[stack[depth]].name != offset)
+				return MUSTACH_ERROR_CLOSING;
+			op = add_op(t, OP_END);
+			if (op == NULL)
+				return MUSTACH_ERROR_SYSTEM;
+			op->name = offset;
+			op->jump = stack[depth] + 1;
+			t->ops[stack[depth]].jump = t->count - 1;
+			break;
+		case '>':
+			/* partials */
+			op = add_op(t, OP_PARTIAL);
+			if (op == NULL)
+				return MUSTACH_ERROR_SYSTEM;
+			op->name = offset;
+			rc = intern(t, opstr, oplen, &op->opstr);
+			if (rc < 0)
+				return rc;
+			rc = intern(t, clstr, cllen, &op->clstr);
+			if (rc < 0)
+				return rc;
+			break;
+		default:
+			/* replacement */
+			op = add_op(t, c == '&' ? OP_PUT_RAW : OP_PUT);
+			if (op == NULL)
+				return MUSTACH_ERROR_SYSTEM;
+			op->name = offset;
+			break;
+		}
+	}
+}
+
+static int execute(const struct mustach_template *t, struct iwrap *iwrap, FILE *file)
 {
+	struct mustach_sbuf sbuf;
+	const struct mustach_op *op;
+	size_t pc;
 	int rc;
-	struct iwrap iwrap;
 
+	pc = 0;
+	while (pc < t->count) {
+		op = &t->ops[pc++];
+		switch(op->code) {
+		case OP_TEXT:
+			rc = iwrap->emit(iwrap->closure, &t->text[op->name], op->length, 0, file);
+			break;
+		case OP_PUT:
+		case OP_PUT_RAW:
+			rc = iwrap->put(iwrap->closure_put, &t->names[op->name], op->code == OP_PUT, file);
+			break;
+		case OP_SECTION:
+			rc = iwrap->enter(iwrap->closure, &t->names[op->name]);
+			if (rc == 0)
+				pc = op->jump + 1;
+			break;
+		case OP_INVERTED:
+			rc = iwrap->enter(iwrap->closure, &t->names[op->name]);
+			if (rc > 0) {
+				iwrap->leave(iwrap->closure);
+				pc = op->jump + 1;
+			}
+			break;
+		case OP_END:
+			/* only an entered section reaches its end, an inverted one never is */
+			rc = 0;
+			if (t->ops[op->jump - 1].code == OP_SECTION) {
+				rc = iwrap->next(iwrap->closure);
+				if (rc > 0)
+					pc = op->jump;
+				else if (rc == 0)
+					iwrap->leave(iwrap->closure);
+			}
+			break;
+		case OP_PARTIAL:
+			sbuf_reset(&sbuf);
+			rc = iwrap->partial(iwrap->closure_partial, &t->names[op->name], &sbuf);
+			if (rc >= 0) {
+				rc = process(sbuf.value, iwrap, file, &t->names[op->opstr], &t->names[op->clstr]);
+				sbuf_release(&sbuf);
+			}
+			break;
+		default:
+			rc = 0;
+			break;
+		}
+		if (rc < 0)
+			return rc;
+	}
+	return MUSTACH_OK;
+}
+
+int mustach_compile(const char *template, struct mustach_template **compiled)
+{
+	struct mustach_template *t;
+	size_t len;
+	int rc;
+
+	*compiled = NULL;
+	t = calloc(1, sizeof *t);
+	if (t == NULL)
+		return MUSTACH_ERROR_SYSTEM;
+	len = strlen(template);
+	t->text = malloc(len + 1);
+	if (t->text == NULL) {
+		free(t);
+		return MUSTACH_ERROR_SYSTEM;
+	}
+	memcpy(t->text, template, len + 1);
+	rc = compile(t);
+	if (rc < 0)
+		mustach_template_free(t);
+	else
+		*compiled = t;
+	return rc;
+}
+
+void mustach_template_free(struct mustach_template *compiled)
+{
+	if (compiled != NULL) {
+		free(compiled->text);
+		free(compiled->names);
+		free(compiled->ops);
+		free(compiled);
+	}
+}
+
+const char *mustach_template_names(const struct mustach_template *compiled, size_t *size)
+{
+	*size = compiled->names_len;
+	return compiled->names;
+}
+
+static int iwrap_init(struct iwrap *iwrap, struct mustach_itf *itf, void *closure)
+{
 	/* check validity */
 	if (!itf->enter || !itf->next || !itf->leave || (!itf->put && !itf->get))
 		return MUSTACH_ERROR_INVALID_ITF;
 
 	/* init wrap structure */
-	iwrap.closure = closure;
+	iwrap->closure = closure;
 	if (itf->put) {
-		iwrap.put = itf->put;
-		iwrap.closure_put = closure;
+		iwrap->put = itf->put;
+		iwrap->closure_put = closure;
 	} else {
-		iwrap.put = iwrap_put;
-		iwrap.closure_put = &iwrap;
+		iwrap->put = iwrap_put;
+		iwrap->closure_put = iwrap;
 	}
 	if (itf->partial) {
-		iwrap.partial = itf->partial;
-		iwrap.closure_partial = closure;
+		iwrap->partial = itf->partial;
+		iwrap->closure_partial = closure;
 	} else if (itf->get) {
-		iwrap.partial = itf->get;
-		iwrap.closure_partial = closure;
+		iwrap->partial = itf->get;
+		iwrap->closure_partial = closure;
 	} else {
-		iwrap.partial = iwrap_partial;
-		iwrap.closure_partial = &iwrap;
+		iwrap->partial = iwrap_partial;
+		iwrap->closure_partial = iwrap;
+	}
+	iwrap->emit = itf->emit ? itf->emit : iwrap_emit;
+	iwrap->enter = itf->enter;
+	iwrap->next = itf->next;
+	iwrap->leave = itf->leave;
+	iwrap->get = itf->get;
+	return MUSTACH_OK;
+}
+
+/*
+ * renders the template, or the compiled template, in file or in ob if not
+ * NULL, when the interface lets mustach do all the writing
+ */
+static int render(const char *template, const struct mustach_template *compiled,
+		  struct mustach_itf *itf, void *closure, FILE *file, struct outbuf *ob)
+{
+	int rc;
+	struct iwrap iwrap;
+
+	rc = iwrap_init(&iwrap, itf, closure);
+	if (rc < 0)
+		return rc;
+	if (ob != NULL) {
+		iwrap.emit = outbuf_emit;
+		file = (FILE *)ob;
 	}
-	iwrap.emit = itf->emit ? itf->emit : iwrap_emit;
-	iwrap.enter = itf->enter;
-	iwrap.next = itf->next;
-	iwrap.leave = itf->leave;
-	iwrap.get = itf->get;
 
 	/* process */
 	rc = itf->start ? itf->start(closure) : 0;
 	if (rc == 0)
-		rc = process(template, &iwrap, file, "{{", "}}");
+		rc = compiled ? execute(compiled, &iwrap, file)
+			      : process(template, &iwrap, file, "{{", "}}");
 	if (itf->stop)
 		itf->stop(closure, rc);
 	return rc;
 }
 
+/* tells if the interface writes to the FILE itself */
+static int uses_file(struct mustach_itf *itf)
+{
+	return itf->put != NULL || itf->emit != NULL;
+}
+
+int mustach_exec(const struct mustach_template *compiled, struct mustach_itf *itf, void *closure, FILE *file)
+{
+	return render(NULL, compiled, itf, closure, file, NULL);
+}
+
+int fmustach(const char *template, struct mustach_itf *itf, void *closure, FILE *file)
+{
+	return render(template, NULL, itf, closure, file, NULL);
+}
+
 int fdmustach(const char *template, struct mustach_itf *itf, void *closure, int fd)
 {
-	int rc;
+	int rc, rcf;
 	FILE *file;
+	struct outbuf ob;
+	char buffer[OUTBUF_FD_SIZE];
+
+	if (!uses_file(itf)) {
+		/* written through a buffer, the fd is left open */
+		ob.data = buffer;
+		ob.len = 0;
+		ob.cap = sizeof buffer;
+		ob.fd = fd;
+		rc = render(template, NULL, itf, closure, NULL, &ob);
+		rcf = outbuf_flush(&ob);
+		return rc < 0 ? rc : rcf;
+	}
 
 	file = fdopen(fd, "w");
 	if (file == NULL) {
@@ -453,10 +897,32 @@ int mustach(const char *template, struct mustach_itf *itf, void *closure, char *
 	int rc;
 	FILE *file;
 	size_t s;
+	struct outbuf ob;
 
 	*result = NULL;
 	if (size == NULL)
 		size = &s;
+	*size = 0;
+
+	if (!uses_file(itf)) {
+		/* rendered in memory, without any FILE */
+		ob.data = NULL;
+		ob.len = 0;
+		ob.cap = 0;
+		ob.fd = -1;
+		rc = render(template, NULL, itf, closure, NULL, &ob);
+		if (rc >= 0 && ob.data == NULL && (ob.data = malloc(1)) == NULL)
+			rc = MUSTACH_ERROR_SYSTEM;
+		if (rc < 0) {
+			free(ob.data);
+			return rc;
+		}
+		ob.data[ob.len] = 0;
+		*result = ob.data;
+		*size = ob.len;
+		return rc;
+	}
+
 	file = memfile_open(result, size);
 	if (file == NULL)
 		rc = MUSTACH_ERROR_SYSTEM;
@@ -469,4 +935,3 @@ int mustach(const char *template, struct mustach_itf *itf, void *closure, char *
 	}
 	return rc;
 }
-
@@ -21,6 +21,7 @@
 #define _mustach_h_included_
 
 struct mustach_sbuf; /* see below */
+struct mustach_template; /* see mustach_compile */
 
 /**
  * Current version of mustach and its derivates
@@ -218,6 +219,9 @@ extern int fmustach(const char *template, struct mustach_itf *itf, void *closure
  * @closure:  the closure to pass to functions called
  * @fd:       the file descriptor number where to write the result
  *
+ * When 'itf' has neither 'put' nor 'emit', the result is written to 'fd'
+ * through a buffer, without a FILE, and 'fd' is left open.
+ *
  * Returns 0 in case of success, -1 with errno set in case of system error
  * a other negative value in case of error.
  */
@@ -232,10 +236,59 @@ extern int fdmustach(const char *template, struct mustach_itf *itf, void *closur
  * @result:   the pointer receiving the result when 0 is returned
  * @size:     the size of the returned result
  *
+ * When 'itf' has neither 'put' nor 'emit', the result is rendered in a
+ * growable memory buffer. Otherwise the callbacks need a true FILE, which
+ * is made with open_memstream, and MUSTACH_ERROR_SYSTEM is returned where
+ * it is not available (NO_OPEN_MEMSTREAM, as on Windows).
+ *
  * Returns 0 in case of success, -1 with errno set in case of system error
  * a other negative value in case of error.
  */
 extern int mustach(const char *template, struct mustach_itf *itf, void *closure, char **result, size_t *size);
 
+/**
+ * mustach_compile - Compiles the mustache 'template' for repeated renders.
+ *
+ * The template is parsed once into a flat array of operations: text to
+ * emit, values to put, and sections with the index of their end resolved,
+ * so that a section that is not entered is skipped without scanning it.
+ * Tag names are interned in one pool. The delimiters set by {{=...=}} tags
+ * are applied at compile time. Partials are rendered from their content
+ * when executed.
+ *
+ * @template: the template string to compile, not needed after the call
+ * @compiled: the pointer receiving the compiled template when 0 is returned
+ *
+ * Returns 0 in case of success, -1 with errno set in case of system error
+ * a other negative value in case of error in the template.
+ */
+extern int mustach_compile(const char *template, struct mustach_template **compiled);
+
+/**
+ * mustach_template_free - Frees a template compiled with mustach_compile.
+ */
+extern void mustach_template_free(struct mustach_template *compiled);
+
+/**
+ * mustach_template_names - Gets the names of the tags of a compiled template.
+ *
+ * The names are interned in one pool of 'size' bytes of zero terminated
+ * strings. The names given to the callbacks by mustach_exec point into
+ * that pool (except the names of the tags of partials), so a name can be
+ * identified by its offset in the pool.
+ */
+extern const char *mustach_template_names(const struct mustach_template *compiled, size_t *size);
+
+/**
+ * mustach_exec - Renders the 'compiled' template in 'file' for 'itf' and 'closure'.
+ *
+ * Same as fmustach but for a template compiled with mustach_compile, that
+ * can be rendered any number of times without being parsed again.
+ *
+ * Returns 0 in case of success, -1 with errno set in case of system error
+ * a other negative value in case of error.
+ */
+extern int mustach_exec(const struct mustach_template *compiled, struct mustach_itf *itf, void *closure, FILE *file);
+
 #endif
 
@@ -0,0 +1,151 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Tests of cld_logs_sink: lines written through one sink, mixing copied
+ * slices and slices added by reference, come out whole and in order,
+ * across the flushes when the iov array or the staging buffer are full.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cld_logs.h"
+
+#define TEST_LINES 5000
+
+static int failures = 0;
+
+#define CHECK(cond, msg)                                          \
+    do                                                            \
+    {                                                             \
+        if (!(cond))                                              \
+        {                                                         \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, msg); \
+            failures++;                                           \
+        }                                                         \
+    } while (0)
+
+/* Read all of fp from its start to a new string. */
+static char *read_all(FILE *fp, size_t *len)
+{
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *data = (char *)malloc((size_t)size + 1);
+    *len = fread(data, 1, (size_t)size, fp);
+    data[*len] = '\0';
+    return data;
+}
+
+/*
+ * The pattern of merged logs: a copied prefix, a copied line and a newline
+ * added by reference, which makes two slices per line.
+ */
+static void test_copy_and_add()
+{
+    static const char newline = '\n';
+    static cld_logs_sink sink;
+    FILE *fp = tmpfile();
+    CHECK(fp != NULL, "tmpfile failed");
+    if (fp == NULL)
+    {
+        return;
+    }
+    cld_logs_sink_init(&sink, fileno(fp));
+
+    char expected_line[64];
+    for (int i = 0; i < TEST_LINES; i++)
+    {
+        char line[32];
+        int n = snprintf(line, sizeof(line), "line %d", i);
+        cld_logs_sink_copy(&sink, "ctr | ", 6);
+        cld_logs_sink_copy(&sink, line, (size_t)n);
+        cld_logs_sink_add(&sink, &newline, 1);
+    }
+    cld_logs_sink_flush(&sink);
+    CHECK(!sink.failed, "write failed");
+
+    size_t len;
+    char *data = read_all(fp, &len);
+    char *p = data;
+    for (int i = 0; i < TEST_LINES; i++)
+    {
+        int n = snprintf(expected_line, sizeof(expected_line),
+                         "ctr | line %d\n", i);
+        if (strncmp(p, expected_line, (size_t)n) != 0)
+        {
+            fprintf(stderr, "line %d differs: %.*s\n", i, n, p);
+            failures++;
+            break;
+        }
+        p += n;
+    }
+    CHECK(p == data + len, "unexpected output after the last line");
+    free(data);
+    fclose(fp);
+}
+
+/* Copies larger than the staging buffer are written directly. */
+static void test_large_copy()
+{
+    static cld_logs_sink sink;
+    FILE *fp = tmpfile();
+    CHECK(fp != NULL, "tmpfile failed");
+    if (fp == NULL)
+    {
+        return;
+    }
+    cld_logs_sink_init(&sink, fileno(fp));
+
+    size_t big_len = CLD_LOGS_SINK_BUF + 100;
+    char *big = (char *)malloc(big_len);
+    memset(big, 'x', big_len);
+    cld_logs_sink_copy(&sink, "a", 1);
+    cld_logs_sink_copy(&sink, big, big_len);
+    cld_logs_sink_copy(&sink, "b", 1);
+    cld_logs_sink_flush(&sink);
+
+    size_t len;
+    char *data = read_all(fp, &len);
+    CHECK(len == big_len + 2, "wrong output length");
+    CHECK(len == big_len + 2 && data[0] == 'a' && data[1] == 'x'
+              && data[len - 2] == 'x' && data[len - 1] == 'b',
+          "wrong output");
+    free(data);
+    free(big);
+    fclose(fp);
+}
+
+int main()
+{
+    test_copy_and_add();
+    test_large_copy();
+    if (failures > 0)
+    {
+        fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    printf("all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ *
+ * Copyright (c) 2018-2022 Abhishek Mishra
+ *
+ * This file is part of cld.
+ *
+ * cld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * cld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with cld.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * cld_luaembed: build tool which precompiles lua modules to bytecode and
+ * writes them as a C source file, to be linked into cld.
+ *
+ * Usage: cld_luaembed <output.c> <module.name>=<path/to/module.lua> ...
+ *
+ * The generated file defines cld_lua_embedded_modules (see
+ * src/cld_lua_embedded.h), a table of module names and bytecode chunks
+ * terminated by a NULL name.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+
+#define CHUNK_BYTES_PER_LINE 16
+
+typedef struct chunk_buf_t
+{
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+} chunk_buf;
+
+static int chunk_writer(lua_State *L, const void *p, size_t sz, void *ud)
+{
+    chunk_buf *buf = (chunk_buf *)ud;
+    if (buf->len + sz > buf->cap)
+    {
+        size_t cap = buf->cap == 0 ? 4096 : buf->cap;
+        while (cap < buf->len + sz)
+        {
+            cap *= 2;
+        }
+        unsigned char *data = (unsigned char *)realloc(buf->data, cap);
+        if (data == NULL)
+        {
+            return 1;
+        }
+        buf->data = data;
+        buf->cap = cap;
+    }
+    memcpy(buf->data + buf->len, p, sz);
+    buf->len += sz;
+    return 0;
+}
+
+static int write_chunk(FILE *out, lua_State *L, int index, const char *path)
+{
+    chunk_buf buf = {NULL, 0, 0};
+
+    if (luaL_loadfile(L, path) != LUA_OK)
+    {
+        fprintf(stderr, "cld_luaembed: %s\n", lua_tostring(L, -1));
+        return -1;
+    }
+#if LUA_VERSION_NUM >= 503
+    int err = lua_dump(L, &chunk_writer, &buf, 1);
+#else
+    int err = lua_dump(L, &chunk_writer, &buf);
+#endif
+    lua_pop(L, 1);
+    if (err != 0)
+    {
+        fprintf(stderr, "cld_luaembed: unable to dump %s\n", path);
+        free(buf.data);
+        return -1;
+    }
+
+    fprintf(out, "/* %s */\nstatic const unsigned char cld_lua_chunk_%d[] = {", path, index);
+    for (size_t i = 0; i < buf.len; i++)
+    {
+        if (i % CHUNK_BYTES_PER_LINE == 0)
+        {
+            fprintf(out, "\n   ");
+        }
+        fprintf(out, " 0x%02x,", buf.data[i]);
+    }
+    fprintf(out, "\n};\n\n");
+    free(buf.data);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <output.c> <module.name>=<file.lua> ...\n", argv[0]);
+        return 1;
+    }
+
+    FILE *out = fopen(argv[1], "w");
+    if (out == NULL)
+    {
+        fprintf(stderr, "cld_luaembed: unable to open %s\n", argv[1]);
+        return 1;
+    }
+
+    lua_State *L = luaL_newstate();
+    if (L == NULL)
+    {
+        fclose(out);
+        return 1;
+    }
+
+    fprintf(out, "/* Generated by cld_luaembed, do not edit. */\n\n");
+    fprintf(out, "#include <stddef.h>\n#include \"cld_lua_embedded.h\"\n\n");
+
+    int err = 0;
+    for (int i = 2; i < argc && err == 0; i++)
+    {
+        char *sep = strchr(argv[i], '=');
+        if (sep == NULL)
+        {
+            fprintf(stderr, "cld_luaembed: expected <module.name>=<file.lua>, got %s\n", argv[i]);
+            err = -1;
+            break;
+        }
+        err = write_chunk(out, L, i - 2, sep + 1);
+    }
+
+    if (err == 0)
+    {
+        fprintf(out, "const cld_lua_embedded_module cld_lua_embedded_modules[] = {\n");
+        for (int i = 2; i < argc; i++)
+        {
+            char *sep = strchr(argv[i], '=');
+            fprintf(out, "    {\"%.*s\", cld_lua_chunk_%d, sizeof(cld_lua_chunk_%d)},\n",
+                    (int)(sep - argv[i]), argv[i], i - 2, i - 2);
+        }
+        fprintf(out, "    {NULL, NULL, 0}\n};\n");
+    }
+
+    lua_close(L);
+    if (fclose(out) != 0)
+    {
+        err = -1;
+    }
+    if (err != 0)
+    {
+        remove(argv[1]);
+        return 1;
+    }
+    return 0;
+}